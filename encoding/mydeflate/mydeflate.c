@@ -0,0 +1,1198 @@
+/*
+ * mydeflate.c — zlib compress / decompress with runtime-selectable
+ *               windowBits and memLevel, shared by the mydeflate tool
+ *               and by pre_processing (libmydeflate.a).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+
+#include "mydeflate.h"
+
+#define CHUNK 16384              /* 16 KiB I/O buffer */
+#define PAR_BLOCK (128 * 1024)   /* input per parallel deflate block */
+#define PAR_DICT  32768          /* history primed into every block */
+#define MAP_STEP  (1u << 30)      /* most z_stream takes in one avail_* */
+
+/* ------------------------------------------------------------
+ * avail_in / avail_out are 32 bit: buffers of any size_t length
+ * are handed to zlib in MAP_STEP steps, <left_in> / <left_out>
+ * what is still to come once the current step is used up.
+ * -----------------------------------------------------------*/
+static void feed(z_stream *strm, size_t *left_in, size_t *left_out)
+{
+    if (strm->avail_in == 0 && *left_in) {
+        strm->avail_in = *left_in < MAP_STEP ? *left_in : MAP_STEP;
+        *left_in -= strm->avail_in;
+    }
+    if (strm->avail_out == 0 && *left_out) {
+        strm->avail_out = *left_out < MAP_STEP ? *left_out : MAP_STEP;
+        *left_out -= strm->avail_out;
+    }
+}
+
+/* ------------------------------------------------------------
+ * Preset dictionary, NULL: none.  The zlib header of a stream
+ * made with one carries its adler32 as dictionary id, inflate
+ * asks for it (Z_NEED_DICT) and the id is checked first.
+ * -----------------------------------------------------------*/
+static int prime_deflate(z_stream *strm, const MYDEFLATE_DICT *dict)
+{
+    return dict ? deflateSetDictionary(strm, dict->data, dict->len) : Z_OK;
+}
+
+static int prime_inflate(z_stream *strm, const MYDEFLATE_DICT *dict)
+{
+    uLong id;
+
+    if (!dict) {
+        fprintf(stderr, "stream needs preset dictionary %08lx (-D)\n", strm->adler);
+        return Z_NEED_DICT;
+    }
+    id = adler32(adler32(0L, Z_NULL, 0), dict->data, dict->len);
+    if (id != strm->adler) {
+        fprintf(stderr, "dictionary id %08lx, the stream needs %08lx\n", id, strm->adler);
+        return Z_DATA_ERROR;
+    }
+    return inflateSetDictionary(strm, dict->data, dict->len);
+}
+
+/* inflate() that supplies the dictionary when the stream asks */
+static int inflate_dict(z_stream *strm, int flush, const MYDEFLATE_DICT *dict)
+{
+    int ret = inflate(strm, flush);
+
+    if (ret == Z_NEED_DICT) {
+        ret = prime_inflate(strm, dict);
+        if (ret == Z_OK) ret = inflate(strm, flush);
+    }
+    return ret;
+}
+
+/* ------------------------------------------------------------
+* Compress <in> to <out> with given windowBits / memLevel.
+* -----------------------------------------------------------*/
+int mydeflate_compress_file(FILE *in, FILE *out, int wbits, int mlevel,
+                            const MYDEFLATE_DICT *dict)
+{
+    z_stream strm;
+    unsigned char in_buf[CHUNK], out_buf[CHUNK];
+    int ret, flush;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm,
+                       Z_DEFAULT_COMPRESSION,
+                       Z_DEFLATED,
+                       wbits,
+                       mlevel,
+                       Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) return ret;
+    ret = prime_deflate(&strm, dict);
+    if (ret != Z_OK) { deflateEnd(&strm); return ret; }
+
+    do {
+        strm.avail_in = fread(in_buf, 1, CHUNK, in);
+        if (ferror(in)) { deflateEnd(&strm); return Z_ERRNO; }
+
+        strm.next_in = in_buf;
+        flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+
+        do {
+            strm.next_out  = out_buf;
+            strm.avail_out = CHUNK;
+
+            ret = deflate(&strm, flush);
+            if (ret == Z_STREAM_ERROR) { deflateEnd(&strm); return ret; }
+
+            size_t have = CHUNK - strm.avail_out;
+            if (fwrite(out_buf, 1, have, out) != have || ferror(out)) {
+                deflateEnd(&strm); return Z_ERRNO;
+            }
+        } while (strm.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    deflateEnd(&strm);
+    return Z_OK;
+}
+
+/* ------------------------------------------------------------
+ * Decompress <in> to <out>.  memLevel is ignored.
+ * -----------------------------------------------------------*/
+int mydeflate_decompress_file(FILE *in, FILE *out, int wbits,
+                              const MYDEFLATE_DICT *dict)
+{
+    z_stream strm;
+    unsigned char in_buf[CHUNK], out_buf[CHUNK];
+    int ret;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, wbits);
+    if (ret != Z_OK) return ret;
+
+    do {
+        strm.avail_in = fread(in_buf, 1, CHUNK, in);
+        if (ferror(in)) { inflateEnd(&strm); return Z_ERRNO; }
+
+        if (strm.avail_in == 0) break;
+        strm.next_in = in_buf;
+
+        do {
+            strm.next_out  = out_buf;
+            strm.avail_out = CHUNK;
+
+            ret = inflate_dict(&strm, Z_NO_FLUSH, dict);
+            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR ||
+                ret == Z_MEM_ERROR || ret == Z_NEED_DICT) {
+                inflateEnd(&strm); return ret;
+            }
+
+            size_t have = CHUNK - strm.avail_out;
+            if (fwrite(out_buf, 1, have, out) != have || ferror(out)) {
+                inflateEnd(&strm); return Z_ERRNO;
+            }
+        } while (strm.avail_out == 0);
+
+    } while (ret != Z_STREAM_END);
+
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
+}
+
+/* ------------------------------------------------------------
+ * Compress a whole buffer in one deflate() call into a
+ * deflateBound()-sized output.
+ * -----------------------------------------------------------*/
+int mydeflate_compress(const void *in, size_t in_len,
+                       unsigned char **out, size_t *out_len,
+                       int wbits, int mlevel)
+{
+    z_stream strm;
+    int ret;
+
+    if (!out || !out_len || (!in && in_len)) return Z_STREAM_ERROR;
+    *out = NULL;
+    *out_len = 0;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm,
+                       Z_DEFAULT_COMPRESSION,
+                       Z_DEFLATED,
+                       wbits,
+                       mlevel,
+                       Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) return ret;
+
+    size_t bound = deflateBound(&strm, in_len), left_in = in_len, left_out = bound;
+    unsigned char *buf = malloc(bound);
+    if (!buf) { deflateEnd(&strm); return Z_MEM_ERROR; }
+
+    strm.next_in  = (unsigned char *)in;
+    strm.next_out = buf;
+    do {
+        feed(&strm, &left_in, &left_out);
+        ret = deflate(&strm, left_in ? Z_NO_FLUSH : Z_FINISH);
+    } while (ret == Z_OK);
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END) { free(buf); return ret == Z_OK ? Z_BUF_ERROR : ret; }
+
+    *out     = buf;
+    *out_len = strm.total_out;
+    return Z_OK;
+}
+
+/* ------------------------------------------------------------
+ * Decompress a whole zlib stream, the output grows as needed.
+ * -----------------------------------------------------------*/
+int mydeflate_decompress(const void *in, size_t in_len,
+                         unsigned char **out, size_t *out_len,
+                         int wbits)
+{
+    z_stream strm;
+    int ret;
+
+    if (!in || !out || !out_len) return Z_STREAM_ERROR;
+    *out = NULL;
+    *out_len = 0;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, wbits);
+    if (ret != Z_OK) return ret;
+
+    size_t cap = in_len * 4 + CHUNK, left_in = in_len, left_out;
+    unsigned char *buf = malloc(cap);
+    if (!buf) { inflateEnd(&strm); return Z_MEM_ERROR; }
+
+    strm.next_in  = (unsigned char *)in;
+    do {
+        if (strm.total_out == cap) {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (!grown) { ret = Z_MEM_ERROR; break; }
+            buf = grown;
+            cap *= 2;
+        }
+        /* the output step restarts after every call, buf may move */
+        strm.next_out  = buf + strm.total_out;
+        strm.avail_out = 0;
+        left_out = cap - strm.total_out;
+        feed(&strm, &left_in, &left_out);
+        ret = inflate(&strm, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+    inflateEnd(&strm);
+
+    if (ret != Z_STREAM_END) {
+        free(buf);
+        return (ret == Z_BUF_ERROR || ret == Z_OK) ? Z_DATA_ERROR : ret;
+    }
+    *out     = buf;
+    *out_len = strm.total_out;
+    return Z_OK;
+}
+
+/* ------------------------------------------------------------
+ * Parallel compression, pigz style.
+ *  The input is cut into PAR_BLOCK blocks, each deflated raw
+ *  by a pool worker with the previous 32 KiB as dictionary and
+ *  ended with a sync flush (the last one with Z_FINISH).  The
+ *  blocks are byte aligned, so they concatenate into a single
+ *  deflate stream; the zlib header and the adler32 combined
+ *  from the per-block checksums make it a normal zlib stream.
+ * -----------------------------------------------------------*/
+typedef struct {
+    const unsigned char *in;
+    size_t         in_len;
+    size_t         nblocks;
+    int            wbits;        /* raw windowBits, 9..15 */
+    int            mlevel;
+    unsigned char **bout;        /* per-block output */
+    size_t        *blen;
+    uLong         *badler;
+    size_t         next;         /* next block to hand out (atomic) */
+    int            ret;          /* first error, Z_OK */
+} PAR_JOB;
+
+static int par_block(PAR_JOB *job, z_stream *strm, size_t b)
+{
+    size_t off = b * PAR_BLOCK;
+    size_t len = job->in_len - off < PAR_BLOCK ? job->in_len - off : PAR_BLOCK;
+    int last = (b == job->nblocks - 1);
+    int ret = deflateReset(strm);
+
+    if (ret != Z_OK) return ret;
+    if (b > 0) {
+        size_t dict = off < PAR_DICT ? off : PAR_DICT;
+        ret = deflateSetDictionary(strm, job->in + off - dict, dict);
+        if (ret != Z_OK) return ret;
+    }
+
+    /* sync flush marker and final block header on top of the bound */
+    size_t cap = deflateBound(strm, len) + 16;
+    unsigned char *buf = malloc(cap);
+    if (!buf) return Z_MEM_ERROR;
+
+    strm->next_in  = (unsigned char *)job->in + off;
+    strm->avail_in = len;
+    do {
+        if (strm->total_out == cap) {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (!grown) { free(buf); return Z_MEM_ERROR; }
+            buf = grown;
+            cap *= 2;
+        }
+        strm->next_out  = buf + strm->total_out;
+        strm->avail_out = cap - strm->total_out;
+        ret = deflate(strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+    } while (ret == Z_OK && strm->avail_out == 0);
+    if (ret != (last ? Z_STREAM_END : Z_OK)) {
+        free(buf);
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    }
+
+    job->bout[b]   = buf;
+    job->blen[b]   = strm->total_out;
+    job->badler[b] = adler32(adler32(0L, Z_NULL, 0), job->in + off, len);
+    return Z_OK;
+}
+
+static void *par_worker(void *arg)
+{
+    PAR_JOB *job = arg;
+    z_stream strm;
+    int ret;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       -job->wbits, job->mlevel, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        __atomic_store_n(&job->ret, ret, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    while (__atomic_load_n(&job->ret, __ATOMIC_RELAXED) == Z_OK) {
+        size_t b = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (b >= job->nblocks) break;
+        ret = par_block(job, &strm, b);
+        if (ret != Z_OK) __atomic_store_n(&job->ret, ret, __ATOMIC_RELAXED);
+    }
+    deflateEnd(&strm);
+    return NULL;
+}
+
+int mydeflate_compress_parallel(const void *in, size_t in_len,
+                                unsigned char **out, size_t *out_len,
+                                int wbits, int mlevel, int threads)
+{
+    PAR_JOB job;
+    pthread_t *tid;
+    unsigned char *buf, *p;
+    unsigned header;
+    uLong adler;
+    size_t b, total;
+    int t, started = 0;
+
+    if (!out || !out_len || (!in && in_len)) return Z_STREAM_ERROR;
+    if (wbits < 8 || wbits > 15) return Z_STREAM_ERROR;
+    *out = NULL;
+    *out_len = 0;
+
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    memset(&job, 0, sizeof(job));
+    job.in      = in;
+    job.in_len  = in_len;
+    job.nblocks = in_len ? (in_len + PAR_BLOCK - 1) / PAR_BLOCK : 1;
+    job.wbits   = wbits == 8 ? 9 : wbits;   /* as deflateInit2() does */
+    job.mlevel  = mlevel;
+    job.ret     = Z_OK;
+    if ((size_t)threads > job.nblocks) threads = job.nblocks;
+
+    job.bout   = calloc(job.nblocks, sizeof(*job.bout));
+    job.blen   = calloc(job.nblocks, sizeof(*job.blen));
+    job.badler = calloc(job.nblocks, sizeof(*job.badler));
+    tid        = calloc(threads, sizeof(*tid));
+    if (!job.bout || !job.blen || !job.badler || !tid) {
+        job.ret = Z_MEM_ERROR;
+        goto done;
+    }
+
+    for (t = 0; t < threads && threads > 1; t++)
+        if (pthread_create(&tid[started], NULL, par_worker, &job) == 0)
+            started++;
+    if (started == 0) par_worker(&job);
+    for (t = 0; t < started; t++) pthread_join(tid[t], NULL);
+    if (job.ret != Z_OK) goto done;
+
+    /* zlib header as deflate() writes it for Z_DEFAULT_COMPRESSION */
+    adler = adler32(0L, Z_NULL, 0);
+    header = (Z_DEFLATED + ((job.wbits - 8) << 4)) << 8;
+    header |= 2 << 6;
+    header += 31 - header % 31;
+
+    total = 2 + 4;
+    for (b = 0; b < job.nblocks; b++) total += job.blen[b];
+    p = buf = malloc(total);
+    if (!buf) { job.ret = Z_MEM_ERROR; goto done; }
+
+    *p++ = header >> 8;
+    *p++ = header & 0xff;
+    for (b = 0; b < job.nblocks; b++) {
+        size_t len = (b == job.nblocks - 1) ? in_len - b * PAR_BLOCK : PAR_BLOCK;
+        memcpy(p, job.bout[b], job.blen[b]);
+        p += job.blen[b];
+        adler = adler32_combine(adler, job.badler[b], len);
+    }
+    *p++ = adler >> 24;
+    *p++ = adler >> 16;
+    *p++ = adler >> 8;
+    *p++ = adler;
+
+    *out     = buf;
+    *out_len = total;
+done:
+    for (b = 0; job.bout && b < job.nblocks; b++) free(job.bout[b]);
+    free(job.bout);
+    free(job.blen);
+    free(job.badler);
+    free(tid);
+    return job.ret;
+}
+
+/* ------------------------------------------------------------
+ * Read all of <in>, compress it in parallel, write to <out>.
+ * -----------------------------------------------------------*/
+int mydeflate_compress_file_parallel(FILE *in, FILE *out, int wbits, int mlevel,
+                                     int threads)
+{
+    size_t cap = 1 << 20, len = 0, n;
+    unsigned char *data = malloc(cap), *packed;
+    size_t packed_len;
+    int ret;
+
+    if (!data) return Z_MEM_ERROR;
+    while ((n = fread(data + len, 1, cap - len, in)) > 0) {
+        len += n;
+        if (len == cap) {
+            unsigned char *grown = realloc(data, cap * 2);
+            if (!grown) { free(data); return Z_MEM_ERROR; }
+            data = grown;
+            cap *= 2;
+        }
+    }
+    if (ferror(in)) { free(data); return Z_ERRNO; }
+
+    ret = mydeflate_compress_parallel(data, len, &packed, &packed_len,
+                                      wbits, mlevel, threads);
+    free(data);
+    if (ret != Z_OK) return ret;
+    if (fwrite(packed, 1, packed_len, out) != packed_len || ferror(out))
+        ret = Z_ERRNO;
+    free(packed);
+    return ret;
+}
+
+/* ------------------------------------------------------------
+ * mmap I/O.
+ *  zlib reads the mapped input and writes straight into the
+ *  mapped output file, which is sized up front and truncated
+ *  to what was produced, avail_in / avail_out refilled by feed().
+ * -----------------------------------------------------------*/
+int mydeflate_mappable(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/* Map all of <fd>; an empty file gives *p = NULL, *len = 0 */
+static int map_input(int fd, const unsigned char **p, size_t *len)
+{
+    struct stat st;
+    void *m;
+
+    *p = NULL;
+    *len = 0;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    if (st.st_size == 0) return 0;
+    m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) return -1;
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+    *p = m;
+    *len = st.st_size;
+    return 0;
+}
+
+static void unmap_input(const unsigned char *p, size_t len)
+{
+    if (p) munmap((void *)p, len);
+}
+
+static unsigned char *map_output(int fd, size_t len)
+{
+    void *p;
+
+    if (ftruncate(fd, len) != 0) return NULL;
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/* <in> through the initialised / reset <strm> into <out_fd> */
+static int deflate_mapped(z_stream *strm, const unsigned char *in, size_t len,
+                          int out_fd)
+{
+    size_t cap = deflateBound(strm, len), left_in = len, left_out = cap;
+    unsigned char *out = map_output(out_fd, cap);
+    int ret;
+
+    if (!out) return Z_ERRNO;
+    strm->next_in  = (unsigned char *)in;
+    strm->next_out = out;
+    do {
+        feed(strm, &left_in, &left_out);
+        ret = deflate(strm, left_in ? Z_NO_FLUSH : Z_FINISH);
+    } while (ret == Z_OK);
+
+    munmap(out, cap);
+    if (ret != Z_STREAM_END) return ret;
+    return ftruncate(out_fd, strm->total_out) == 0 ? Z_OK : Z_ERRNO;
+}
+
+/* ------------------------------------------------------------
+ * The zlib stream does not carry the original size: <size_hint>
+ * (0: unknown, 4x the input is tried) sizes the output, which
+ * is grown with mremap() if the data turns out larger.
+ * -----------------------------------------------------------*/
+static int inflate_mapped(z_stream *strm, const unsigned char *in, size_t len,
+                          int out_fd, size_t size_hint, const MYDEFLATE_DICT *dict)
+{
+    size_t cap = size_hint ? size_hint : len * 4 + CHUNK;
+    size_t left_in = len, left_out = cap;
+    unsigned char *out = map_output(out_fd, cap);
+    int ret;
+
+    if (!out) return Z_ERRNO;
+    strm->next_in  = (unsigned char *)in;
+    strm->next_out = out;
+    for (;;) {
+        feed(strm, &left_in, &left_out);
+        ret = inflate_dict(strm, Z_NO_FLUSH, dict);
+        if (ret != Z_OK && ret != Z_BUF_ERROR) break;
+        if (strm->avail_out == 0 && left_out == 0) {
+            /* output full: grow the file and the mapping */
+            size_t grown_cap = cap * 2;
+            void *grown;
+            if (ftruncate(out_fd, grown_cap) != 0) { ret = Z_ERRNO; break; }
+            grown = mremap(out, cap, grown_cap, MREMAP_MAYMOVE);
+            if (grown == MAP_FAILED) { ret = Z_ERRNO; break; }
+            out = grown;
+            strm->next_out = out + strm->total_out;
+            left_out = grown_cap - cap;
+            cap = grown_cap;
+        } else if (ret == Z_BUF_ERROR) {
+            ret = Z_DATA_ERROR;   /* input ended inside the stream */
+            break;
+        }
+    }
+
+    munmap(out, cap);
+    if (ret != Z_STREAM_END) return ret;
+    return ftruncate(out_fd, strm->total_out) == 0 ? Z_OK : Z_ERRNO;
+}
+
+int mydeflate_compress_mapped(int in_fd, int out_fd, int wbits, int mlevel,
+                              int threads, const MYDEFLATE_DICT *dict)
+{
+    const unsigned char *in;
+    size_t len;
+    z_stream strm;
+    int ret;
+
+    if (map_input(in_fd, &in, &len) != 0) return Z_ERRNO;
+
+    if (threads != 1) {
+        /* blocks are compressed to the heap, only the input is mapped */
+        if (dict) { unmap_input(in, len); return Z_STREAM_ERROR; }
+        unsigned char *packed, *out;
+        size_t packed_len;
+        ret = mydeflate_compress_parallel(in, len, &packed, &packed_len,
+                                          wbits, mlevel, threads);
+        unmap_input(in, len);
+        if (ret != Z_OK) return ret;
+        out = map_output(out_fd, packed_len);
+        if (out) {
+            memcpy(out, packed, packed_len);
+            munmap(out, packed_len);
+        } else {
+            ret = Z_ERRNO;
+        }
+        free(packed);
+        return ret;
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       wbits, mlevel, Z_DEFAULT_STRATEGY);
+    if (ret == Z_OK) {
+        ret = prime_deflate(&strm, dict);
+        if (ret == Z_OK) ret = deflate_mapped(&strm, in, len, out_fd);
+        deflateEnd(&strm);
+    }
+    unmap_input(in, len);
+    return ret;
+}
+
+int mydeflate_decompress_mapped(int in_fd, int out_fd, int wbits, size_t size_hint,
+                                const MYDEFLATE_DICT *dict)
+{
+    const unsigned char *in;
+    size_t len;
+    z_stream strm;
+    int ret;
+
+    if (map_input(in_fd, &in, &len) != 0) return Z_ERRNO;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, wbits);
+    if (ret == Z_OK) {
+        ret = inflate_mapped(&strm, in, len, out_fd, size_hint, dict);
+        inflateEnd(&strm);
+    }
+    unmap_input(in, len);
+    return ret;
+}
+
+/* ------------------------------------------------------------
+ * Batch mode.
+ *  Workers pull jobs in order and keep one deflate and one
+ *  inflate stream each: deflateReset() while windowBits and
+ *  memLevel stay the same (deflateInit2() again otherwise),
+ *  inflateReset2() for any windowBits.  Jobs are not reordered,
+ *  so manifests that group lines by parameters get the most
+ *  resets.  A job whose input or output is an earlier job's
+ *  output, or whose output is an earlier job's input, waits
+ *  until that job is done: outputs are sized to the bound
+ *  first and trimmed at the end, so reading one early gets a
+ *  padded or partial file.
+ * -----------------------------------------------------------*/
+typedef struct {
+    MYDEFLATE_JOB  *jobs;
+    size_t          njobs;
+    size_t          next;        /* next job to hand out (atomic) */
+    unsigned char  *done;        /* per job, under lock */
+    pthread_mutex_t lock;
+    pthread_cond_t  done_cv;
+} BATCH;
+
+typedef struct {
+    z_stream def, inf;
+    int      def_wbits, def_mlevel;   /* 0: def not initialised */
+    int      inf_ready;
+} BATCH_STREAMS;
+
+static int batch_job(BATCH_STREAMS *zs, MYDEFLATE_JOB *job)
+{
+    const unsigned char *in;
+    size_t len;
+    int in_fd, out_fd, ret;
+
+    in_fd = open(job->in_path, O_RDONLY);
+    if (in_fd < 0) return Z_ERRNO;
+    out_fd = open(job->out_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) { close(in_fd); return Z_ERRNO; }
+    if (map_input(in_fd, &in, &len) != 0) {
+        close(in_fd);
+        close(out_fd);
+        return Z_ERRNO;
+    }
+
+    if (job->mode == MYDEFLATE_COMPRESS) {
+        if (zs->def_wbits == job->wbits && zs->def_mlevel == job->mlevel) {
+            ret = deflateReset(&zs->def);
+        } else {
+            if (zs->def_wbits) deflateEnd(&zs->def);
+            zs->def_wbits = 0;
+            memset(&zs->def, 0, sizeof(zs->def));
+            ret = deflateInit2(&zs->def, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                               job->wbits, job->mlevel, Z_DEFAULT_STRATEGY);
+            if (ret == Z_OK) {
+                zs->def_wbits  = job->wbits;
+                zs->def_mlevel = job->mlevel;
+            }
+        }
+        if (ret == Z_OK) ret = prime_deflate(&zs->def, job->dict);
+        if (ret == Z_OK) ret = deflate_mapped(&zs->def, in, len, out_fd);
+    } else {
+        if (zs->inf_ready) {
+            ret = inflateReset2(&zs->inf, job->wbits);
+        } else {
+            memset(&zs->inf, 0, sizeof(zs->inf));
+            ret = inflateInit2(&zs->inf, job->wbits);
+            zs->inf_ready = (ret == Z_OK);
+        }
+        if (ret == Z_OK) ret = inflate_mapped(&zs->inf, in, len, out_fd, 0, job->dict);
+    }
+
+    unmap_input(in, len);
+    close(in_fd);
+    close(out_fd);
+    return ret;
+}
+
+/* Jobs are handed out in order, so every earlier job is already
+ * running on some worker and only waits on jobs before it. */
+static void batch_wait(BATCH *batch, size_t j)
+{
+    const MYDEFLATE_JOB *job = &batch->jobs[j], *prev;
+    size_t k;
+
+    for (k = j; k-- > 0; ) {
+        prev = &batch->jobs[k];
+        if (strcmp(job->in_path, prev->out_path) && strcmp(job->out_path, prev->out_path)
+            && strcmp(job->out_path, prev->in_path))
+            continue;
+        pthread_mutex_lock(&batch->lock);
+        while (!batch->done[k]) pthread_cond_wait(&batch->done_cv, &batch->lock);
+        pthread_mutex_unlock(&batch->lock);
+    }
+}
+
+static void *batch_worker(void *arg)
+{
+    BATCH *batch = arg;
+    BATCH_STREAMS zs;
+
+    memset(&zs, 0, sizeof(zs));
+    for (;;) {
+        size_t j = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (j >= batch->njobs) break;
+        batch_wait(batch, j);
+        batch->jobs[j].ret = batch_job(&zs, &batch->jobs[j]);
+        pthread_mutex_lock(&batch->lock);
+        batch->done[j] = 1;
+        pthread_cond_broadcast(&batch->done_cv);
+        pthread_mutex_unlock(&batch->lock);
+    }
+    if (zs.def_wbits) deflateEnd(&zs.def);
+    if (zs.inf_ready) inflateEnd(&zs.inf);
+    return NULL;
+}
+
+int mydeflate_batch(MYDEFLATE_JOB *jobs, size_t njobs, int workers)
+{
+    BATCH batch;
+    pthread_t *tid;
+    size_t j;
+    int t, started = 0, ret = Z_OK;
+
+    if (!jobs && njobs) return Z_STREAM_ERROR;
+    if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0) workers = 1;
+    if ((size_t)workers > njobs) workers = njobs ? njobs : 1;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.jobs  = jobs;
+    batch.njobs = njobs;
+    batch.done  = calloc(njobs ? njobs : 1, 1);
+    if (!batch.done) return Z_MEM_ERROR;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.done_cv, NULL);
+    tid = calloc(workers, sizeof(*tid));
+    for (t = 0; tid && t < workers && workers > 1; t++)
+        if (pthread_create(&tid[started], NULL, batch_worker, &batch) == 0)
+            started++;
+    if (started == 0) batch_worker(&batch);
+    for (t = 0; t < started; t++) pthread_join(tid[t], NULL);
+    free(tid);
+    pthread_cond_destroy(&batch.done_cv);
+    pthread_mutex_destroy(&batch.lock);
+    free(batch.done);
+
+    for (j = 0; j < njobs; j++)
+        if (jobs[j].ret != Z_OK && ret == Z_OK) ret = jobs[j].ret;
+    return ret;
+}
+
+/* ------------------------------------------------------------
+ * Parameter sweep.
+ *  Every point of windowBits 8..15 x memLevel 1..9 x level 0..9
+ *  x strategy is compressed and decompressed from the mapped
+ *  input by a pool of workers, in feed() steps like the mmap
+ *  codecs.  Speeds are thread CPU time, so points running side
+ *  by side do not skew each other; zlib's allocations go
+ *  through a counting zalloc for the peak.
+ * -----------------------------------------------------------*/
+#define SWEEP_MIN_TIME 0.01       /* seconds a measurement repeats for */
+
+static const struct { int id; const char *name; } sweep_strategy[] = {
+    {Z_DEFAULT_STRATEGY, "default"},
+    {Z_FILTERED,         "filtered"},
+    {Z_HUFFMAN_ONLY,     "huffman_only"},
+    {Z_RLE,              "rle"},
+};
+#define SWEEP_STRATEGIES (int)(sizeof(sweep_strategy) / sizeof(sweep_strategy[0]))
+#define SWEEP_POINTS     (8 * 9 * 10 * SWEEP_STRATEGIES)
+
+typedef struct {
+    size_t bytes;
+    size_t peak;
+} MEM_TRACK;
+
+/* size kept in front of every block, 16 keeps zlib's alignment */
+#define TRACK_HDR 16
+
+static voidpf track_alloc(voidpf opaque, uInt items, uInt size)
+{
+    MEM_TRACK *m = opaque;
+    size_t n = (size_t)items * size;
+    unsigned char *p = malloc(n + TRACK_HDR);
+
+    if (!p) return Z_NULL;
+    memcpy(p, &n, sizeof(n));
+    m->bytes += n;
+    if (m->bytes > m->peak) m->peak = m->bytes;
+    return p + TRACK_HDR;
+}
+
+static void track_free(voidpf opaque, voidpf address)
+{
+    MEM_TRACK *m = opaque;
+    unsigned char *p = (unsigned char *)address - TRACK_HDR;
+    size_t n;
+
+    memcpy(&n, p, sizeof(n));
+    m->bytes -= n;
+    free(p);
+}
+
+static double thread_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    int    wbits, mlevel, level, strategy;   /* strategy: sweep_strategy[] index */
+    int    ret;
+    size_t out_len;
+    double comp_mbs, decomp_mbs;
+    size_t deflate_peak, inflate_peak;
+} SWEEP_POINT;
+
+typedef struct {
+    const unsigned char *in;
+    size_t       len;
+    SWEEP_POINT *points;
+    int          npoints;
+    int          next;           /* next point to hand out (atomic) */
+} SWEEP;
+
+static int sweep_point(const SWEEP *sw, SWEEP_POINT *pt, unsigned char *back)
+{
+    MEM_TRACK mem;
+    z_stream strm;
+    unsigned char *buf;
+    size_t cap, left_in, left_out;
+    double t0, t;
+    int reps, ret;
+
+    /* compress, repeated until the time is measurable */
+    memset(&mem, 0, sizeof(mem));
+    memset(&strm, 0, sizeof(strm));
+    strm.zalloc = track_alloc;
+    strm.zfree  = track_free;
+    strm.opaque = &mem;
+    ret = deflateInit2(&strm, pt->level, Z_DEFLATED, pt->wbits, pt->mlevel,
+                       sweep_strategy[pt->strategy].id);
+    if (ret != Z_OK) return ret;
+    cap = deflateBound(&strm, sw->len) + 16;   /* stored blocks of tiny inputs */
+    buf = malloc(cap);
+    if (!buf) { deflateEnd(&strm); return Z_MEM_ERROR; }
+
+    t0 = thread_seconds();
+    for (reps = 0; ; ) {
+        if (reps) deflateReset(&strm);
+        strm.next_in   = (unsigned char *)sw->in;
+        strm.next_out  = buf;
+        strm.avail_in  = strm.avail_out = 0;
+        left_in  = sw->len;
+        left_out = cap;
+        do {
+            feed(&strm, &left_in, &left_out);
+            ret = deflate(&strm, left_in ? Z_NO_FLUSH : Z_FINISH);
+        } while (ret == Z_OK);
+        if (ret != Z_STREAM_END) break;
+        reps++;
+        if ((t = thread_seconds() - t0) >= SWEEP_MIN_TIME) break;
+    }
+    pt->out_len = strm.total_out;
+    pt->deflate_peak = mem.peak;
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END) { free(buf); return ret == Z_OK ? Z_BUF_ERROR : ret; }
+    pt->comp_mbs = t > 0 ? reps * (sw->len / 1e6) / t : 0;
+
+    /* decompress; deflate runs windowBits 8 as 9 and says so in the header */
+    memset(&mem, 0, sizeof(mem));
+    memset(&strm, 0, sizeof(strm));
+    strm.zalloc = track_alloc;
+    strm.zfree  = track_free;
+    strm.opaque = &mem;
+    ret = inflateInit2(&strm, pt->wbits == 8 ? 9 : pt->wbits);
+    if (ret != Z_OK) { free(buf); return ret; }
+
+    t0 = thread_seconds();
+    for (reps = 0; ; ) {
+        if (reps) inflateReset(&strm);
+        strm.next_in   = buf;
+        strm.next_out  = back;
+        strm.avail_in  = strm.avail_out = 0;
+        left_in  = pt->out_len;
+        left_out = sw->len;
+        do {
+            feed(&strm, &left_in, &left_out);
+            ret = inflate(&strm, Z_NO_FLUSH);
+        } while (ret == Z_OK);
+        if (ret != Z_STREAM_END) break;
+        reps++;
+        if ((t = thread_seconds() - t0) >= SWEEP_MIN_TIME) break;
+    }
+    pt->inflate_peak = mem.peak;
+    inflateEnd(&strm);
+    free(buf);
+    if (ret != Z_STREAM_END || strm.total_out != sw->len
+        || (sw->len && memcmp(back, sw->in, sw->len)))
+        return Z_DATA_ERROR;
+    pt->decomp_mbs = t > 0 ? reps * (sw->len / 1e6) / t : 0;
+    return Z_OK;
+}
+
+static void *sweep_worker(void *arg)
+{
+    SWEEP *sw = arg;
+    unsigned char *back = malloc(sw->len ? sw->len : 1);
+
+    for (;;) {
+        int i = __atomic_fetch_add(&sw->next, 1, __ATOMIC_RELAXED);
+        if (i >= sw->npoints) break;
+        sw->points[i].ret = back ? sweep_point(sw, &sw->points[i], back) : Z_MEM_ERROR;
+    }
+    free(back);
+    return NULL;
+}
+
+int mydeflate_sweep(int in_fd, FILE *csv, int workers)
+{
+    SWEEP sw;
+    pthread_t *tid;
+    int i, t, started = 0, ret = Z_OK;
+    int w, m, l, s;
+
+    memset(&sw, 0, sizeof(sw));
+    if (map_input(in_fd, &sw.in, &sw.len) != 0) return Z_ERRNO;
+    sw.points = calloc(SWEEP_POINTS, sizeof(*sw.points));
+    if (!sw.points) { unmap_input(sw.in, sw.len); return Z_MEM_ERROR; }
+    for (w = 8; w <= 15; w++)
+        for (m = 1; m <= 9; m++)
+            for (l = 0; l <= 9; l++)
+                for (s = 0; s < SWEEP_STRATEGIES; s++) {
+                    SWEEP_POINT *pt = &sw.points[sw.npoints++];
+                    pt->wbits    = w;
+                    pt->mlevel   = m;
+                    pt->level    = l;
+                    pt->strategy = s;
+                }
+
+    if (workers <= 0) workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers <= 0) workers = 1;
+    tid = calloc(workers, sizeof(*tid));
+    for (t = 0; tid && t < workers && workers > 1; t++)
+        if (pthread_create(&tid[started], NULL, sweep_worker, &sw) == 0)
+            started++;
+    if (started == 0) sweep_worker(&sw);
+    for (t = 0; t < started; t++) pthread_join(tid[t], NULL);
+    free(tid);
+
+    fprintf(csv, "wbits,memlevel,level,strategy,in_bytes,out_bytes,ratio,"
+                 "compress_MBps,decompress_MBps,deflate_peak_bytes,inflate_peak_bytes\n");
+    for (i = 0; i < sw.npoints; i++) {
+        const SWEEP_POINT *pt = &sw.points[i];
+        if (pt->ret != Z_OK) {
+            fprintf(stderr, "sweep w%d m%d l%d %s: zlib error %d\n", pt->wbits,
+                    pt->mlevel, pt->level, sweep_strategy[pt->strategy].name, pt->ret);
+            if (ret == Z_OK) ret = pt->ret;
+            continue;
+        }
+        fprintf(csv, "%d,%d,%d,%s,%zu,%zu,%.4f,%.2f,%.2f,%zu,%zu\n",
+                pt->wbits, pt->mlevel, pt->level, sweep_strategy[pt->strategy].name,
+                sw.len, pt->out_len, pt->out_len ? (double)sw.len / pt->out_len : 0.0,
+                pt->comp_mbs, pt->decomp_mbs, pt->deflate_peak, pt->inflate_peak);
+    }
+    free(sw.points);
+    unmap_input(sw.in, sw.len);
+    return ret;
+}
+
+/* ------------------------------------------------------------
+ * Dictionary training.
+ *  Every TRAIN_FRAG bytes fragment at a TRAIN_STEP offset of the
+ *  samples is hashed and counted once per sample it occurs in.
+ *  Fragments seen in at least two samples are taken, most
+ *  common first, while <dict_size> has room.  Fragments a step
+ *  apart share most of their bytes, so what is taken is the
+ *  sample text they cover, TRAIN_STEP blocks at a time: a
+ *  fragment only costs the blocks not taken yet, and touching
+ *  blocks are merged into runs.  The runs are laid out with the
+ *  most common at the end of the dictionary, where deflate
+ *  reaches them with the shortest distances.  Room left is
+ *  filled with the head of the last sample.
+ * -----------------------------------------------------------*/
+#define TRAIN_FRAG   32
+#define TRAIN_STEP   4
+#define TRAIN_SLOTS  (1u << 20)   /* distinct fragments tracked */
+#define TRAIN_BLOCKS (PAR_DICT / TRAIN_STEP)   /* most blocks taken */
+#define TRAIN_SET    (4 * TRAIN_BLOCKS)        /* block set slots */
+
+typedef struct {
+    uint64_t             hash;    /* 0: empty slot */
+    const unsigned char *frag;    /* first occurrence */
+    int                  sample;  /* ... in this sample */
+    unsigned             count;   /* samples it occurs in */
+    int                  last;    /* last sample counted */
+} TRAIN_SLOT;
+
+/* TRAIN_STEP bytes of sample text taken; runs of them are laid out */
+typedef struct {
+    const unsigned char *at;
+    int                  sample;
+    size_t               rank;    /* most common fragment covering it */
+    size_t               len;     /* runs: bytes */
+} TRAIN_BLOCK;
+
+static uint64_t frag_hash(const unsigned char *p)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;   /* FNV-1a */
+    int i;
+
+    for (i = 0; i < TRAIN_FRAG; i++) h = (h ^ p[i]) * 0x100000001b3ULL;
+    return h ? h : 1;
+}
+
+static int slot_cmp(const void *a, const void *b)
+{
+    const TRAIN_SLOT *x = a, *y = b;
+    if (x->count != y->count) return x->count < y->count ? 1 : -1;
+    return x->hash < y->hash ? -1 : x->hash > y->hash;
+}
+
+/* blocks in sample text order */
+static int block_cmp(const void *a, const void *b)
+{
+    const TRAIN_BLOCK *x = a, *y = b;
+    if (x->sample != y->sample) return x->sample - y->sample;
+    return x->at < y->at ? -1 : x->at > y->at;
+}
+
+/* runs least common first */
+static int run_cmp(const void *a, const void *b)
+{
+    const TRAIN_BLOCK *x = a, *y = b;
+    return x->rank < y->rank ? 1 : x->rank > y->rank ? -1 : 0;
+}
+
+/* slot of block <at> in the open-addressed <set> of block indexes
+ * (-1: free), the free slot it would go in when not there */
+static size_t block_slot(const int *set, const TRAIN_BLOCK *block,
+                         const unsigned char *at)
+{
+    size_t i = (size_t)(((uintptr_t)at / TRAIN_STEP) * 0x9e3779b97f4a7c15ULL >> 40)
+               & (TRAIN_SET - 1);
+
+    while (set[i] >= 0 && block[set[i]].at != at) i = (i + 1) & (TRAIN_SET - 1);
+    return i;
+}
+
+int mydeflate_train(const char * const *samples, int nsamples, size_t dict_size,
+                    unsigned char **dict, size_t *dict_len)
+{
+    const unsigned char **in;
+    size_t *len, used = 0, nfrag = 0, nblock = 0, nrun = 0, i, k, b;
+    TRAIN_SLOT *slot;
+    TRAIN_BLOCK *block;
+    unsigned char *buf;
+    int *set;
+    int n, ret = Z_OK;
+
+    if (!samples || nsamples <= 0 || !dict || !dict_len || dict_size == 0)
+        return Z_STREAM_ERROR;
+    *dict = NULL;
+    *dict_len = 0;
+    if (dict_size > PAR_DICT) dict_size = PAR_DICT;   /* deflate's window */
+
+    in    = calloc(nsamples, sizeof(*in));
+    len   = calloc(nsamples, sizeof(*len));
+    slot  = calloc(TRAIN_SLOTS, sizeof(*slot));
+    block = calloc(TRAIN_BLOCKS, sizeof(*block));
+    set   = malloc(TRAIN_SET * sizeof(*set));
+    buf   = malloc(dict_size);
+    if (!in || !len || !slot || !block || !set || !buf) { ret = Z_MEM_ERROR; goto done; }
+
+    for (n = 0; n < nsamples; n++) {
+        int fd = open(samples[n], O_RDONLY);
+        if (fd < 0 || map_input(fd, &in[n], &len[n]) != 0) {
+            fprintf(stderr, "%s: cannot read\n", samples[n]);
+            if (fd >= 0) close(fd);
+            ret = Z_ERRNO;
+            goto done;
+        }
+        close(fd);
+        for (k = 0; k + TRAIN_FRAG <= len[n]; k += TRAIN_STEP) {
+            uint64_t h = frag_hash(in[n] + k);
+            size_t at = h & (TRAIN_SLOTS - 1);
+            while (slot[at].hash && slot[at].hash != h)
+                at = (at + 1) & (TRAIN_SLOTS - 1);
+            if (!slot[at].hash) {
+                if (nfrag >= TRAIN_SLOTS / 2) continue;   /* table full */
+                slot[at].hash   = h;
+                slot[at].frag   = in[n] + k;
+                slot[at].sample = n;
+                slot[at].last   = -1;
+                nfrag++;
+            }
+            if (slot[at].last != n) {
+                slot[at].last = n;
+                slot[at].count++;
+            }
+        }
+    }
+
+    /* most common first; take the blocks not yet taken while they fit */
+    for (i = 0, k = 0; i < TRAIN_SLOTS; i++)
+        if (slot[i].hash) slot[k++] = slot[i];
+    qsort(slot, nfrag, sizeof(*slot), slot_cmp);
+    memset(set, 0xff, TRAIN_SET * sizeof(*set));
+    for (i = 0; i < nfrag && slot[i].count >= 2 && used < dict_size; i++) {
+        size_t fresh = 0;
+        for (b = 0; b < TRAIN_FRAG; b += TRAIN_STEP)
+            if (set[block_slot(set, block, slot[i].frag + b)] < 0) fresh += TRAIN_STEP;
+        if (fresh == 0 || used + fresh > dict_size) continue;
+        for (b = 0; b < TRAIN_FRAG; b += TRAIN_STEP) {
+            size_t at = block_slot(set, block, slot[i].frag + b);
+            if (set[at] >= 0) continue;
+            set[at] = nblock;
+            block[nblock].at     = slot[i].frag + b;
+            block[nblock].sample = slot[i].sample;
+            block[nblock].rank   = i;
+            nblock++;
+        }
+        used += fresh;
+    }
+
+    /* touching blocks of a sample into runs, ranked by their best block */
+    qsort(block, nblock, sizeof(*block), block_cmp);
+    for (b = 0; b < nblock; b++) {
+        TRAIN_BLOCK *r = nrun ? &block[nrun - 1] : NULL;
+        if (r && r->sample == block[b].sample && r->at + r->len == block[b].at) {
+            r->len += TRAIN_STEP;
+            if (block[b].rank < r->rank) r->rank = block[b].rank;
+        } else {
+            block[nrun] = block[b];
+            block[nrun++].len = TRAIN_STEP;
+        }
+    }
+    qsort(block, nrun, sizeof(*block), run_cmp);
+
+    /* room left goes to the head of the last sample, segments of a
+     * stream tend to start alike; it sits in front, farthest away  */
+    k = dict_size - used < len[nsamples - 1] ? dict_size - used : len[nsamples - 1];
+    memcpy(buf, in[nsamples - 1], k);
+    /* ... then the runs, least common first */
+    for (b = 0; b < nrun; b++) {
+        memcpy(buf + k, block[b].at, block[b].len);
+        k += block[b].len;
+    }
+    used = k;
+
+    if (used == 0) {
+        fprintf(stderr, "the samples are empty\n");
+        ret = Z_DATA_ERROR;
+        goto done;
+    }
+    *dict = buf;
+    *dict_len = used;
+    buf = NULL;
+done:
+    for (n = 0; in && n < nsamples; n++) unmap_input(in[n], len[n]);
+    free(in);
+    free(len);
+    free(slot);
+    free(block);
+    free(set);
+    free(buf);
+    return ret;
+}
@@ -0,0 +1,115 @@
+/*
+ * mydeflate.h — zlib compressor / decompressor as a linkable library
+ *               (libmydeflate.a), on stdio streams or memory buffers.
+ *
+ * Every call returns a zlib status code, Z_OK on success.
+ */
+#ifndef MYDEFLATE_H
+#define MYDEFLATE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* ------------------------------------------------------------
+ * Preset dictionary (deflateSetDictionary), at most 32 KiB are
+ * used.  Every <dict> argument below may be NULL for none; a
+ * stream made with a dictionary only decodes with the same one.
+ * -----------------------------------------------------------*/
+typedef struct {
+    const unsigned char *data;
+    size_t               len;
+} MYDEFLATE_DICT;
+
+/* ------------------------------------------------------------
+ * Stream interface, what the mydeflate tool runs.
+ * -----------------------------------------------------------*/
+int mydeflate_compress_file(FILE *in, FILE *out, int wbits, int mlevel,
+                            const MYDEFLATE_DICT *dict);
+int mydeflate_decompress_file(FILE *in, FILE *out, int wbits,
+                              const MYDEFLATE_DICT *dict);
+
+/* ------------------------------------------------------------
+ * Buffer interface.
+ *  *out is malloc()ed by the call and owned by the caller; the
+ *  compressed form is the same zlib stream the tool writes.
+ * -----------------------------------------------------------*/
+int mydeflate_compress(const void *in, size_t in_len,
+                       unsigned char **out, size_t *out_len,
+                       int wbits, int mlevel);
+int mydeflate_decompress(const void *in, size_t in_len,
+                         unsigned char **out, size_t *out_len,
+                         int wbits);
+
+/* ------------------------------------------------------------
+ * Parallel compression.
+ *  <threads> workers (<=0: online CPUs) deflate 128 KiB blocks,
+ *  each primed with the 32 KiB before it; the result is one
+ *  zlib stream any inflate() (and mydeflate -x) reads.  The
+ *  ratio is a little below the single-stream one.
+ * -----------------------------------------------------------*/
+int mydeflate_compress_parallel(const void *in, size_t in_len,
+                                unsigned char **out, size_t *out_len,
+                                int wbits, int mlevel, int threads);
+int mydeflate_compress_file_parallel(FILE *in, FILE *out, int wbits, int mlevel,
+                                     int threads);
+
+/* ------------------------------------------------------------
+ * mmap interface on file descriptors.
+ *  Both files must be regular (mydeflate_mappable()), the input
+ *  non-empty and the output opened read/write; it is resized to
+ *  the result.  <size_hint> is the expected decompressed size,
+ *  0 if unknown.  Pipes take the stream interface.  <threads>
+ *  other than 1 cannot be combined with a dictionary.
+ * -----------------------------------------------------------*/
+int mydeflate_mappable(int fd);
+int mydeflate_compress_mapped(int in_fd, int out_fd, int wbits, int mlevel,
+                              int threads, const MYDEFLATE_DICT *dict);
+int mydeflate_decompress_mapped(int in_fd, int out_fd, int wbits, size_t size_hint,
+                                const MYDEFLATE_DICT *dict);
+
+/* ------------------------------------------------------------
+ * Batch interface.
+ *  Runs every job on a pool of <workers> threads (<=0: online
+ *  CPUs) that reuse their z_streams across jobs, through the
+ *  mmap path.  Jobs start in the order of <jobs>, which is
+ *  left as it is; one that reads or writes a file an earlier
+ *  job writes (or writes one it reads) waits for that job.
+ *  Each job's status is left in its ret, the first failure is
+ *  returned.
+ * -----------------------------------------------------------*/
+#define MYDEFLATE_COMPRESS   'c'
+#define MYDEFLATE_DECOMPRESS 'x'
+
+typedef struct {
+    int         mode;         /* MYDEFLATE_COMPRESS / _DECOMPRESS */
+    int         wbits;
+    int         mlevel;       /* ignored for decompression */
+    const char *in_path;
+    const char *out_path;
+    const MYDEFLATE_DICT *dict;
+    int         ret;          /* zlib status of this job */
+} MYDEFLATE_JOB;
+
+int mydeflate_batch(MYDEFLATE_JOB *jobs, size_t njobs, int workers);
+
+/* ------------------------------------------------------------
+ * Parameter sweep.
+ *  Compress and decompress the regular file <in_fd> with every
+ *  windowBits 8..15 x memLevel 1..9 x level 0..9 x strategy
+ *  (default, filtered, huffman_only, rle) on <workers> threads
+ *  (<=0: online CPUs) and write one CSV row per point to <csv>:
+ *  size, ratio, MB/s both ways and zlib's peak memory.
+ * -----------------------------------------------------------*/
+int mydeflate_sweep(int in_fd, FILE *csv, int workers);
+
+/* ------------------------------------------------------------
+ * Dictionary training.
+ *  Build a preset dictionary of at most <dict_size> bytes from
+ *  the byte strings most of the <samples> files share, e.g.
+ *  older segments of one channel and transform.  *dict is
+ *  malloc()ed and owned by the caller.
+ * -----------------------------------------------------------*/
+int mydeflate_train(const char * const *samples, int nsamples, size_t dict_size,
+                    unsigned char **dict, size_t *dict_len);
+
+#endif
@@ -1,173 +1,322 @@
 /*
- * mydeflate.c — simple zlib compressor / decompressor with
- *               runtime-selectable windowBits and memLevel.
+ * mydeflate_main.c — simple zlib compressor / decompressor with
+ *                    runtime-selectable windowBits and memLevel,
+ *                    the work is done by libmydeflate (mydeflate.c).
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <zlib.h>
 
-#define CHUNK 16384              /* 16 KiB I/O buffer */
+#include "mydeflate.h"
 
 static void usage(const char *prog)
 {
     fprintf(stderr,
         "Usage:\n"
-        "  Compress:   %s -w <8..15> -m <1..9> -c <input> <output>\n"
-        "  Decompress: %s -w <8..15> -m <1..9> -x <input> <output>\n",
-        prog, prog);
+        "  Compress:   %s -w <8..15> -m <1..9> [-p <threads>] [-B] [-D <dict>] -c <input> <output>\n"
+        "  Decompress: %s -w <8..15> -m <1..9> [-n <size>] [-B] [-D <dict>] -x <input> <output>\n"
+        "  Batch:      %s [-j <workers>] [-D <dict>] -f <manifest>\n"
+        "  Sweep:      %s [-j <workers>] --sweep <input> [<csv>]\n"
+        "  Train:      %s [-s <size>] -T <dict> <sample>...\n"
+        "    -p  compress 128 KiB blocks on <threads> workers (0: online CPUs)\n"
+        "    -n  expected decompressed size, sizes the mapped output\n"
+        "    -B  buffered stdio instead of mmap (always used for pipes)\n"
+        "    -f  one job per line, \"c|x <wbits> <memlevel> <input> <output>\",\n"
+        "        '-' reads the manifest from stdin; a line using an earlier\n"
+        "        line's output waits for it\n"
+        "    -j  batch / sweep workers (default: online CPUs)\n"
+        "    --sweep  every windowBits x memLevel x level x strategy, CSV of\n"
+        "             size, MB/s and peak memory to <csv> or stdout\n"
+        "    -D  preset dictionary, the same one is needed to decompress\n"
+        "    -T  train a dictionary of -s bytes (default and most: 32768)\n"
+        "        from the strings the samples share\n",
+        prog, prog, prog, prog, prog);
 }
 
-enum {MODE_NONE, MODE_COMPRESS, MODE_DECOMPRESS};
+enum {MODE_NONE, MODE_COMPRESS, MODE_DECOMPRESS, MODE_SWEEP, MODE_TRAIN};
+
+typedef struct {
+    int         mode;
+    int         wbits;
+    int         mlevel;
+    int         threads;     /* -p, 1: single zlib stream */
+    int         buffered;    /* -B */
+    size_t      size_hint;   /* -n */
+    const char *manifest;    /* -f, batch mode */
+    int         workers;     /* -j */
+    const char *dict;        /* -D */
+    size_t      dict_size;   /* -s, training */
+    const char *infile;
+    const char *outfile;     /* also the dictionary -T writes */
+    char      **samples;     /* training inputs */
+    int         nsamples;
+} OPTIONS;
 
 /* ------------------------------------------------------------
  * Parse command line.
  * Return 0 on success, −1 on any error.
 * -----------------------------------------------------------*/
-static int parse_args(int argc, char **argv,
-                      int *mode, int *wbits, int *mlevel,
-                      const char **infile, const char **outfile)
+static int parse_args(int argc, char **argv, OPTIONS *opt)
 {
-    *mode   = MODE_NONE;
-    *wbits  = 15;   /* zlib default */
-    *mlevel = 8;
+    memset(opt, 0, sizeof(*opt));
+    opt->mode    = MODE_NONE;
+    opt->wbits   = 15;   /* zlib default */
+    opt->mlevel  = 8;
+    opt->threads = 1;
+    opt->dict_size = 32768;
 
     int i = 1;
     while (i < argc && argv[i][0] == '-') {
         if (!strcmp(argv[i], "-w") && i + 1 < argc) {
-            *wbits = atoi(argv[++i]);
+            opt->wbits = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
-            *mlevel = atoi(argv[++i]);
+            opt->mlevel = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            opt->threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            opt->size_hint = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-B")) {
+            opt->buffered = 1;
+        } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+            opt->manifest = argv[++i];
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            opt->workers = atoi(argv[++i]);
         } else if (!strcmp(argv[i], "-c")) {
-            *mode = MODE_COMPRESS;
+            opt->mode = MODE_COMPRESS;
         } else if (!strcmp(argv[i], "-x")) {
-            *mode = MODE_DECOMPRESS;
+            opt->mode = MODE_DECOMPRESS;
+        } else if (!strcmp(argv[i], "--sweep")) {
+            opt->mode = MODE_SWEEP;
+        } else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+            opt->dict = argv[++i];
+        } else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            opt->dict_size = strtoull(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-T") && i + 1 < argc) {
+            opt->mode = MODE_TRAIN;
+            opt->outfile = argv[++i];
         } else {
             return -1;
         }
         ++i;
     }
+    if (opt->manifest) return argc - i == 0 ? 0 : -1;
+    if (opt->mode == MODE_TRAIN) {
+        opt->samples  = argv + i;
+        opt->nsamples = argc - i;
+        return opt->nsamples > 0 && opt->dict_size > 0 ? 0 : -1;
+    }
+    if (opt->mode == MODE_SWEEP) {
+        if (argc - i != 1 && argc - i != 2) return -1;
+        opt->infile  = argv[i];
+        opt->outfile = argc - i == 2 ? argv[i + 1] : NULL;
+        return 0;
+    }
     if (argc - i != 2) return -1;
-    if (*mode == MODE_NONE)   return -1;
-    if (*wbits  < 8 || *wbits  > 15) return -1;
-    if (*mlevel < 1 || *mlevel > 9)  return -1;
+    if (opt->mode == MODE_NONE)   return -1;
+    if (opt->wbits  < 8 || opt->wbits  > 15) return -1;
+    if (opt->mlevel < 1 || opt->mlevel > 9)  return -1;
+    if (opt->dict && opt->threads != 1) return -1;
 
-    *infile  = argv[i];
-    *outfile = argv[i + 1];
+    opt->infile  = argv[i];
+    opt->outfile = argv[i + 1];
     return 0;
 }
 
 /* ------------------------------------------------------------
-* Compress <in> to <out> with given windowBits / memLevel.
-* -----------------------------------------------------------*/
-static int do_compress(FILE *in, FILE *out, int wbits, int mlevel)
+ * Read the batch manifest, skipping blank and '#' lines.
+ * Return the job count, −1 on a malformed line.
+ * -----------------------------------------------------------*/
+static long read_manifest(const char *path, MYDEFLATE_JOB **jobs)
 {
-    z_stream strm;
-    unsigned char in_buf[CHUNK], out_buf[CHUNK];
-    int ret, flush;
-
-    memset(&strm, 0, sizeof(strm));
-    ret = deflateInit2(&strm,
-                       Z_DEFAULT_COMPRESSION,
-                       Z_DEFLATED,
-                       wbits,
-                       mlevel,
-                       Z_DEFAULT_STRATEGY);
-    if (ret != Z_OK) return ret;
-
-    do {
-        strm.avail_in = fread(in_buf, 1, CHUNK, in);
-        if (ferror(in)) { deflateEnd(&strm); return Z_ERRNO; }
-
-        strm.next_in = in_buf;
-        flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
-
-        do {
-            strm.next_out  = out_buf;
-            strm.avail_out = CHUNK;
-
-            ret = deflate(&strm, flush);
-            if (ret == Z_STREAM_ERROR) { deflateEnd(&strm); return ret; }
-
-            size_t have = CHUNK - strm.avail_out;
-            if (fwrite(out_buf, 1, have, out) != have || ferror(out)) {
-                deflateEnd(&strm); return Z_ERRNO;
-            }
-        } while (strm.avail_out == 0);
-    } while (flush != Z_FINISH);
-
-    deflateEnd(&strm);
-    return Z_OK;
+    FILE *fp = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    char line[2048], in[1024], out[1024], mode;
+    size_t n = 0, cap = 0;
+    long lineno = 0;
+
+    *jobs = NULL;
+    if (!fp) { perror(path); return -1; }
+    while (fgets(line, sizeof(line), fp)) {
+        MYDEFLATE_JOB job;
+        char *p = line;
+        lineno++;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == 0) continue;
+
+        memset(&job, 0, sizeof(job));
+        if (sscanf(p, " %c %d %d %1023s %1023s", &mode, &job.wbits, &job.mlevel, in, out) != 5
+            || (mode != MYDEFLATE_COMPRESS && mode != MYDEFLATE_DECOMPRESS)
+            || job.wbits < 8 || job.wbits > 15 || job.mlevel < 1 || job.mlevel > 9) {
+            fprintf(stderr, "%s:%ld: bad job line\n", path, lineno);
+            goto err;
+        }
+        job.mode     = mode;
+        job.in_path  = strdup(in);
+        job.out_path = strdup(out);
+        if (n == cap) {
+            MYDEFLATE_JOB *grown;
+            cap = cap ? cap * 2 : 64;
+            grown = realloc(*jobs, cap * sizeof(*grown));
+            if (!grown) { free((char *)job.in_path); free((char *)job.out_path); goto err; }
+            *jobs = grown;
+        }
+        (*jobs)[n++] = job;
+        if (!job.in_path || !job.out_path) goto err;
+    }
+    if (fp != stdin) fclose(fp);
+    return n;
+err:
+    if (fp != stdin) fclose(fp);
+    while (n--) {
+        free((char *)(*jobs)[n].in_path);
+        free((char *)(*jobs)[n].out_path);
+    }
+    free(*jobs);
+    *jobs = NULL;
+    return -1;
 }
 
 /* ------------------------------------------------------------
- * Decompress <in> to <out>.  memLevel is ignored.
+ * Load the -D dictionary, 0 on success.
  * -----------------------------------------------------------*/
-static int do_decompress(FILE *in, FILE *out, int wbits)
+static int load_dict(const char *path, MYDEFLATE_DICT *dict)
 {
-    z_stream strm;
-    unsigned char in_buf[CHUNK], out_buf[CHUNK];
-    int ret;
+    FILE *fp = fopen(path, "rb");
+    unsigned char *buf = malloc(32768 + 1);
+    size_t n;
 
-    memset(&strm, 0, sizeof(strm));
-    ret = inflateInit2(&strm, wbits);
-    if (ret != Z_OK) return ret;
-
-    do {
-        strm.avail_in = fread(in_buf, 1, CHUNK, in);
-        if (ferror(in)) { inflateEnd(&strm); return Z_ERRNO; }
+    if (!fp || !buf) { perror(path); if (fp) fclose(fp); free(buf); return -1; }
+    n = fread(buf, 1, 32768 + 1, fp);
+    fclose(fp);
+    if (n == 0 || n > 32768) {
+        fprintf(stderr, "%s: a dictionary holds 1..32768 bytes\n", path);
+        free(buf);
+        return -1;
+    }
+    dict->data = buf;
+    dict->len  = n;
+    return 0;
+}
 
-        if (strm.avail_in == 0) break;
-        strm.next_in = in_buf;
+static int run_train(const OPTIONS *opt)
+{
+    unsigned char *dict;
+    size_t len;
+    FILE *fp;
+    int zret;
 
-        do {
-            strm.next_out  = out_buf;
-            strm.avail_out = CHUNK;
+    zret = mydeflate_train((const char * const *)opt->samples, opt->nsamples,
+                           opt->dict_size, &dict, &len);
+    if (zret != Z_OK) {
+        fprintf(stderr, "Training failed: zlib error %d\n", zret);
+        return 4;
+    }
+    fp = fopen(opt->outfile, "wb");
+    if (!fp) { perror(opt->outfile); free(dict); return 3; }
+    if (fwrite(dict, 1, len, fp) != len) zret = Z_ERRNO;
+    if (fclose(fp) != 0) zret = Z_ERRNO;
+    free(dict);
+    if (zret != Z_OK) { perror(opt->outfile); return 3; }
+    printf("%s: %zu bytes from %d samples\n", opt->outfile, len, opt->nsamples);
+    return 0;
+}
 
-            ret = inflate(&strm, Z_NO_FLUSH);
-            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR ||
-                ret == Z_MEM_ERROR) {
-                inflateEnd(&strm); return ret;
-            }
+static int run_sweep(const OPTIONS *opt)
+{
+    FILE *in = fopen(opt->infile, "rb"), *csv = stdout;
+    int zret;
 
-            size_t have = CHUNK - strm.avail_out;
-            if (fwrite(out_buf, 1, have, out) != have || ferror(out)) {
-                inflateEnd(&strm); return Z_ERRNO;
-            }
-        } while (strm.avail_out == 0);
+    if (!in) { perror(opt->infile); return 2; }
+    if (opt->outfile && !(csv = fopen(opt->outfile, "w"))) {
+        perror(opt->outfile);
+        fclose(in);
+        return 3;
+    }
+    zret = mydeflate_sweep(fileno(in), csv, opt->workers);
+    fclose(in);
+    if (csv != stdout) fclose(csv);
+    if (zret != Z_OK) {
+        fprintf(stderr, "Sweep failed: zlib error %d\n", zret);
+        return 4;
+    }
+    return 0;
+}
 
-    } while (ret != Z_STREAM_END);
+static int run_batch(const OPTIONS *opt, const MYDEFLATE_DICT *dict)
+{
+    MYDEFLATE_JOB *jobs;
+    long n = read_manifest(opt->manifest, &jobs), j;
+    int failed = 0;
 
-    inflateEnd(&strm);
-    return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
+    if (n < 0) return 1;
+    for (j = 0; j < n; j++) jobs[j].dict = dict;
+    mydeflate_batch(jobs, n, opt->workers);
+    for (j = 0; j < n; j++) {
+        if (jobs[j].ret != Z_OK) {
+            fprintf(stderr, "%s %s failed: zlib error %d\n",
+                    jobs[j].mode == MYDEFLATE_COMPRESS ? "Compression" : "Decompression",
+                    jobs[j].in_path, jobs[j].ret);
+            failed++;
+        }
+        free((char *)jobs[j].in_path);
+        free((char *)jobs[j].out_path);
+    }
+    free(jobs);
+    return failed ? 4 : 0;
 }
 
 int main(int argc, char **argv)
 {
-    int mode, wbits, mlevel;
-    const char *in_path, *out_path;
+    OPTIONS opt;
+    MYDEFLATE_DICT dict_buf, *dict = NULL;
 
-    if (parse_args(argc, argv, &mode, &wbits, &mlevel, &in_path, &out_path)) {
+    if (parse_args(argc, argv, &opt)) {
         usage(argv[0]);
         return 1;
     }
+    if (opt.mode == MODE_TRAIN) return run_train(&opt);
+    if (opt.mode == MODE_SWEEP) return run_sweep(&opt);
+    if (opt.dict) {
+        if (load_dict(opt.dict, &dict_buf)) return 2;
+        dict = &dict_buf;
+    }
+    if (opt.manifest) {
+        int rc = run_batch(&opt, dict);
+        if (dict) free((void *)dict->data);
+        return rc;
+    }
 
-    FILE *in  = fopen(in_path,  "rb");
-    if (!in) { perror(in_path); return 2; }
+    FILE *in  = fopen(opt.infile,  "rb");
+    if (!in) { perror(opt.infile); return 2; }
 
-    FILE *out = fopen(out_path, "wb");
-    if (!out) { perror(out_path); fclose(in); return 3; }
+    /* read/write: the mmap path maps the output shared */
+    FILE *out = fopen(opt.outfile, "w+b");
+    if (!out) { perror(opt.outfile); fclose(in); return 3; }
 
-    int zret = (mode == MODE_COMPRESS)
-               ? do_compress  (in, out, wbits, mlevel)
-               : do_decompress(in, out, wbits);
+    int zret;
+    struct stat st;
+    if (!opt.buffered && mydeflate_mappable(fileno(out))
+        && fstat(fileno(in), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        zret = (opt.mode == MODE_COMPRESS)
+               ? mydeflate_compress_mapped  (fileno(in), fileno(out), opt.wbits, opt.mlevel,
+                                             opt.threads, dict)
+               : mydeflate_decompress_mapped(fileno(in), fileno(out), opt.wbits, opt.size_hint,
+                                             dict);
+    else if (opt.mode == MODE_DECOMPRESS)
+        zret = mydeflate_decompress_file(in, out, opt.wbits, dict);
+    else if (opt.threads == 1)
+        zret = mydeflate_compress_file(in, out, opt.wbits, opt.mlevel, dict);
+    else
+        zret = mydeflate_compress_file_parallel(in, out, opt.wbits, opt.mlevel, opt.threads);
 
     fclose(in);
     fclose(out);
+    if (dict) free((void *)dict->data);
 
     if (zret != Z_OK) {
         fprintf(stderr, "%s failed: zlib error %d\n",
-                mode == MODE_COMPRESS ? "Compression" : "Decompression", zret);
+                opt.mode == MODE_COMPRESS ? "Compression" : "Decompression", zret);
         return 4;
     }
     return 0;
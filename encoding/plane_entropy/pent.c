@@ -0,0 +1,535 @@
+/*  pent.c — per-plane canonical Huffman coder (see pent.h)
+ *
+ *   PENT_HUF plane:
+ *       mode byte
+ *       code lengths of symbols 0..255, 4-bit nibbles, low nibble first:
+ *           1..PENT_MAX_BITS  that length
+ *           0                 one unused symbol
+ *           15, k             2 + k unused symbols
+ *       padded to a byte
+ *       varint byte size of each of the 4 streams
+ *       the streams: plane bytes [s*q, (s+1)*q) with q = ceil(len / 4),
+ *       codes written LSB first, bit-reversed canonical codes
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "pent.h"
+
+#define STREAMS     4
+#define TABLE_SIZE  (1u << PENT_MAX_BITS)
+#define ZERO_RUN    15
+
+/*==========================================================================*/
+/* Varints, as in the SZR v2 run tables                                     */
+/*==========================================================================*/
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v)
+{
+    uint64_t x = 0;
+    unsigned shift;
+
+    for (shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) { *v = x; return 0; }
+    }
+    return -1;
+}
+
+/*==========================================================================*/
+/* Code lengths                                                             */
+/*==========================================================================*/
+
+/* In-place minimum-redundancy lengths (Moffat & Katajainen) of the <n>     */
+/* weights in <a>, sorted ascending; <a> ends up holding the lengths.       */
+static void huffman_lengths(uint32_t *a, int n)
+{
+    int root, leaf, next, avbl, used, dpth;
+
+    if (n == 1) { a[0] = 1; return; }
+    a[0] += a[1];
+    root = 0;
+    leaf = 2;
+    for (next = 1; next < n - 1; next++) {
+        if (leaf >= n || a[root] < a[leaf]) { a[next] = a[root]; a[root++] = next; }
+        else a[next] = a[leaf++];
+        if (leaf >= n || (root < next && a[root] < a[leaf])) { a[next] += a[root]; a[root++] = next; }
+        else a[next] += a[leaf++];
+    }
+    a[n - 2] = 0;
+    for (next = n - 3; next >= 0; next--)
+        a[next] = a[a[next]] + 1;
+    avbl = 1;
+    used = dpth = 0;
+    root = n - 2;
+    next = n - 1;
+    while (avbl > 0) {
+        while (root >= 0 && (int)a[root] == dpth) { used++; root--; }
+        while (avbl > used) { a[next--] = dpth; avbl--; }
+        avbl = 2 * used;
+        dpth++;
+        used = 0;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* <freq> -> <len> of at most PENT_MAX_BITS; returns the symbols used.      */
+/* Codes cut to the limit overfill the Kraft sum, which is paid back by     */
+/* lengthening the deepest shorter codes, the rarest first.                 */
+static int build_lengths(const uint32_t *freq, uint8_t *len)
+{
+    uint64_t key[256];
+    uint32_t w[256];
+    int n = 0, i, s;
+    int64_t over = 0;
+
+    memset(len, 0, 256);
+    for (s = 0; s < 256; s++)
+        if (freq[s]) key[n++] = (uint64_t)freq[s] << 8 | s;
+    if (n < 2) return n;
+    qsort(key, n, sizeof key[0], cmp_u64);
+    for (i = 0; i < n; i++) w[i] = (uint32_t)(key[i] >> 8);
+    huffman_lengths(w, n);
+    for (i = 0; i < n; i++) {
+        if (w[i] > PENT_MAX_BITS) w[i] = PENT_MAX_BITS;
+        over += 1 << (PENT_MAX_BITS - w[i]);
+    }
+    over -= TABLE_SIZE;
+    while (over > 0) {
+        int best = -1;
+        for (i = 0; i < n; i++)
+            if (w[i] < PENT_MAX_BITS && (best < 0 || w[i] > w[best])) best = i;
+        over -= 1 << (PENT_MAX_BITS - w[best] - 1);
+        w[best]++;
+    }
+    for (i = 0; i < n; i++) len[key[i] & 0xff] = (uint8_t)w[i];
+    return n;
+}
+
+/* Canonical codes of <len>, bit-reversed for the LSB-first streams.        */
+/* Returns -1 when the lengths overfill the code space.                     */
+static int build_codes(const uint8_t *len, uint16_t *code)
+{
+    unsigned count[PENT_MAX_BITS + 1] = {0}, next[PENT_MAX_BITS + 1];
+    unsigned c = 0, kraft = 0;
+    int s, l;
+
+    for (s = 0; s < 256; s++)
+        if (len[s]) {
+            count[len[s]]++;
+            kraft += 1u << (PENT_MAX_BITS - len[s]);
+        }
+    if (kraft > TABLE_SIZE) return -1;
+    for (l = 1; l <= PENT_MAX_BITS; l++) {
+        c = (c + count[l - 1]) << 1;
+        next[l] = c;
+    }
+    for (s = 0; s < 256; s++) {
+        unsigned v, r = 0;
+        if (!len[s]) continue;
+        v = next[len[s]]++;
+        for (l = 0; l < len[s]; l++) r |= ((v >> l) & 1) << (len[s] - 1 - l);
+        code[s] = (uint16_t)r;
+    }
+    return 0;
+}
+
+static size_t put_lengths(uint8_t *p, const uint8_t *len)
+{
+    uint8_t nib[512];
+    size_t n = 0, i;
+    int s = 0;
+
+    while (s < 256) {
+        int run = 0;
+        while (s + run < 256 && !len[s + run] && run < 17) run++;
+        if (run >= 2) {
+            nib[n++] = ZERO_RUN;
+            nib[n++] = run - 2;
+            s += run;
+        } else {
+            nib[n++] = len[s++];
+        }
+    }
+    for (i = 0; i < n; i += 2)
+        p[i / 2] = nib[i] | (i + 1 < n ? nib[i + 1] << 4 : 0);
+    return (n + 1) / 2;
+}
+
+static int get_lengths(const uint8_t **p, const uint8_t *end, uint8_t *len)
+{
+    const uint8_t *q = *p;
+    size_t k = 0;
+    int s = 0;
+
+#define NIBBLE() (k / 2 < (size_t)(end - q) ? (q[k / 2] >> (4 * (k & 1))) & 15 : -1)
+    while (s < 256) {
+        int v = NIBBLE();
+        k++;
+        if (v < 0 || (v > PENT_MAX_BITS && v != ZERO_RUN)) return -1;
+        if (v == ZERO_RUN) {
+            int run = NIBBLE();
+            k++;
+            if (run < 0 || s + run + 2 > 256) return -1;
+            memset(len + s, 0, run + 2);
+            s += run + 2;
+        } else {
+            len[s++] = (uint8_t)v;
+        }
+    }
+#undef NIBBLE
+    *p = q + (k + 1) / 2;
+    return 0;
+}
+
+/*==========================================================================*/
+/* Encode                                                                   */
+/*==========================================================================*/
+
+typedef struct {
+    uint8_t *p;
+    uint64_t acc;
+    unsigned fill;
+} BITOUT;
+
+static inline void put_code(BITOUT *b, unsigned code, unsigned n)
+{
+    b->acc |= (uint64_t)code << b->fill;
+    b->fill += n;
+    if (b->fill >= 32) {
+        uint32_t w = (uint32_t)b->acc;
+        memcpy(b->p, &w, 4);
+        b->p += 4;
+        b->acc >>= 32;
+        b->fill -= 32;
+    }
+}
+
+static uint8_t *put_stream(uint8_t *dst, const uint8_t *src, size_t n,
+                           const uint16_t *code, const uint8_t *len)
+{
+    BITOUT b = { dst, 0, 0 };
+    size_t i;
+
+    for (i = 0; i < n; i++) put_code(&b, code[src[i]], len[src[i]]);
+    for (; b.fill > 0; b.fill = b.fill > 8 ? b.fill - 8 : 0, b.acc >>= 8)
+        *b.p++ = (uint8_t)b.acc;
+    return b.p;
+}
+
+static void histogram(const uint8_t *p, size_t n, uint32_t *freq)
+{
+    uint32_t h[4][256];
+    size_t i;
+    int s;
+
+    memset(h, 0, sizeof h);
+    for (i = 0; i + 4 <= n; i += 4) {
+        h[0][p[i]]++;
+        h[1][p[i + 1]]++;
+        h[2][p[i + 2]]++;
+        h[3][p[i + 3]]++;
+    }
+    for (; i < n; i++) h[0][p[i]]++;
+    for (s = 0; s < 256; s++) freq[s] = h[0][s] + h[1][s] + h[2][s] + h[3][s];
+}
+
+/* One plane, at most 1 + <n> bytes.                                        */
+static uint8_t *encode_plane(uint8_t *dst, const uint8_t *src, size_t n)
+{
+    uint32_t freq[256];
+    uint8_t len[256], table[128];
+    uint16_t code[256];
+    size_t q = (n + STREAMS - 1) / STREAMS, bytes[STREAMS], cost, tl, s;
+    uint8_t sizes[STREAMS * 10];
+    size_t sl = 0;
+    int used, k;
+
+    histogram(src, n, freq);
+    used = build_lengths(freq, len);
+    if (used == 1) {
+        *dst++ = PENT_RLE;
+        *dst++ = src[0];
+        return dst;
+    }
+    if (used == 0 || build_codes(len, code) != 0) goto raw;
+
+    /* sizes of the streams known up front, nothing is written in vain    */
+    tl = put_lengths(table, len);
+    cost = 1 + tl;
+    for (k = 0; k < STREAMS; k++) {
+        size_t a = k * q < n ? k * q : n, e = a + q < n ? a + q : n;
+        uint64_t bits = 0;
+        for (s = a; s < e; s++) bits += len[src[s]];
+        bytes[k] = (bits + 7) / 8;
+        sl += put_varint(sizes + sl, bytes[k]);
+        cost += bytes[k];
+    }
+    cost += sl;
+    if (cost >= 1 + n) goto raw;
+
+    *dst++ = PENT_HUF;
+    memcpy(dst, table, tl);
+    dst += tl;
+    memcpy(dst, sizes, sl);
+    dst += sl;
+    for (k = 0; k < STREAMS; k++) {
+        size_t a = k * q < n ? k * q : n, e = a + q < n ? a + q : n;
+        dst = put_stream(dst, src + a, e - a, code, len);
+    }
+    return dst;
+raw:
+    *dst++ = PENT_RAW;
+    memcpy(dst, src, n);
+    return dst + n;
+}
+
+int pent_encode(const void *in, size_t len, size_t plane_len,
+                uint8_t **out, size_t *out_len)
+{
+    const uint8_t *src = in;
+    PentHeader hdr;
+    uint8_t *buf, *p;
+    size_t off, planes;
+
+    if ((!in && len) || !out || !out_len) return -1;
+    if (!plane_len) plane_len = PENT_PLANE;
+    if (plane_len > UINT32_MAX) return -1;
+    planes = (len + plane_len - 1) / plane_len;
+    buf = malloc(sizeof hdr + planes + len);
+    if (!buf) return -1;
+
+    memcpy(hdr.magic, PENT_MAGIC, 4);
+    hdr.version = PENT_VERSION;
+    hdr.flags = 0;
+    hdr.plane_len = (uint32_t)plane_len;
+    hdr.size = len;
+    memcpy(buf, &hdr, sizeof hdr);
+    p = buf + sizeof hdr;
+    for (off = 0; off < len; off += plane_len)
+        p = encode_plane(p, src + off, len - off < plane_len ? len - off : plane_len);
+    *out = buf;
+    *out_len = p - buf;
+    return 0;
+}
+
+/*==========================================================================*/
+/* Decode                                                                   */
+/*   Table entries are symbol | length << 8, length 0 marks a hole of an    */
+/*   incomplete code.  One 64-bit peek holds 57 bits, 4 codes at least,     */
+/*   and the 4 streams are walked in the same loop so their loads overlap.  */
+/*==========================================================================*/
+
+typedef struct {
+    const uint8_t *p;
+    size_t size;
+    uint64_t pos;           /* bits consumed */
+} BITIN;
+
+static inline uint64_t peek(const BITIN *b)
+{
+    size_t at = b->pos >> 3;
+    uint64_t v = 0;
+
+    if (at + 8 <= b->size) memcpy(&v, b->p + at, 8);
+    else if (at < b->size) memcpy(&v, b->p + at, b->size - at);
+    return v >> (b->pos & 7);
+}
+
+#define DECODE_ONE(b, v, dst, bad) do {                                     \
+        uint16_t e_ = table[(v) & (TABLE_SIZE - 1)];                        \
+        unsigned l_ = e_ >> 8;                                              \
+        *(dst)++ = (uint8_t)e_;                                             \
+        (bad) |= !l_;                                                       \
+        (v) >>= l_;                                                         \
+        (b)->pos += l_;                                                     \
+    } while (0)
+
+static int decode_plane(const uint8_t **pp, const uint8_t *end, uint8_t *dst, size_t n)
+{
+    const uint8_t *p = *pp;
+    uint8_t len[256];
+    uint16_t code[256], table[TABLE_SIZE];
+    BITIN b[STREAMS];
+    uint8_t *o[STREAMS];
+    size_t q = (n + STREAMS - 1) / STREAMS, cnt[STREAMS], i;
+    unsigned bad = 0;
+    int k, s;
+
+    if (p >= end) return -1;
+    switch (*p++) {
+    case PENT_RAW:
+        if ((size_t)(end - p) < n) return -1;
+        memcpy(dst, p, n);
+        *pp = p + n;
+        return 0;
+    case PENT_RLE:
+        if (p >= end) return -1;
+        memset(dst, *p++, n);
+        *pp = p;
+        return 0;
+    case PENT_HUF:
+        break;
+    default:
+        return -1;
+    }
+
+    if (get_lengths(&p, end, len) != 0 || build_codes(len, code) != 0) return -1;
+    memset(table, 0, sizeof table);
+    for (s = 0; s < 256; s++) {
+        unsigned step = 1u << len[s], r;
+        if (!len[s]) continue;
+        for (r = code[s]; r < TABLE_SIZE; r += step)
+            table[r] = (uint16_t)(s | len[s] << 8);
+    }
+    for (k = 0; k < STREAMS; k++) {
+        uint64_t sz;
+        if (get_varint(&p, end, &sz) != 0) return -1;
+        b[k].size = sz;
+    }
+    for (k = 0; k < STREAMS; k++) {
+        size_t a = k * q < n ? k * q : n, e = a + q < n ? a + q : n;
+        if ((size_t)(end - p) < b[k].size) return -1;
+        b[k].p = p;
+        b[k].pos = 0;
+        p += b[k].size;
+        o[k] = dst + a;
+        cnt[k] = e - a;
+    }
+
+    /* all 4 streams while the last, shortest one lasts, 4 codes a peek    */
+    for (i = 0; i + 4 <= cnt[STREAMS - 1]; i += 4) {
+        uint64_t v0 = peek(&b[0]), v1 = peek(&b[1]), v2 = peek(&b[2]), v3 = peek(&b[3]);
+        DECODE_ONE(&b[0], v0, o[0], bad);
+        DECODE_ONE(&b[1], v1, o[1], bad);
+        DECODE_ONE(&b[2], v2, o[2], bad);
+        DECODE_ONE(&b[3], v3, o[3], bad);
+        DECODE_ONE(&b[0], v0, o[0], bad);
+        DECODE_ONE(&b[1], v1, o[1], bad);
+        DECODE_ONE(&b[2], v2, o[2], bad);
+        DECODE_ONE(&b[3], v3, o[3], bad);
+        DECODE_ONE(&b[0], v0, o[0], bad);
+        DECODE_ONE(&b[1], v1, o[1], bad);
+        DECODE_ONE(&b[2], v2, o[2], bad);
+        DECODE_ONE(&b[3], v3, o[3], bad);
+        DECODE_ONE(&b[0], v0, o[0], bad);
+        DECODE_ONE(&b[1], v1, o[1], bad);
+        DECODE_ONE(&b[2], v2, o[2], bad);
+        DECODE_ONE(&b[3], v3, o[3], bad);
+    }
+    for (k = 0; k < STREAMS; k++) {
+        size_t j;
+        for (j = i; j < cnt[k]; j++) {
+            uint64_t v = peek(&b[k]);
+            DECODE_ONE(&b[k], v, o[k], bad);
+        }
+        /* a stream ends in its last byte */
+        if ((b[k].pos + 7) / 8 != b[k].size) bad = 1;
+    }
+    if (bad) return -1;
+    *pp = p;
+    return 0;
+}
+
+int pent_decode(const void *in, size_t len, uint8_t **out, size_t *out_len)
+{
+    const uint8_t *p = in, *end = p + len;
+    PentHeader hdr;
+    uint8_t *buf;
+    uint64_t off;
+
+    if (!in || !out || !out_len || len < sizeof hdr) return -1;
+    memcpy(&hdr, p, sizeof hdr);
+    p += sizeof hdr;
+    if (memcmp(hdr.magic, PENT_MAGIC, 4) || hdr.version != PENT_VERSION
+        || hdr.flags || !hdr.plane_len || hdr.size > SIZE_MAX
+        /* every plane takes 2 bytes at least */
+        || (hdr.size + hdr.plane_len - 1) / hdr.plane_len > (uint64_t)(end - p) / 2) {
+        return -1;
+    }
+    buf = malloc(hdr.size ? hdr.size : 1);
+    if (!buf) return -1;
+    for (off = 0; off < hdr.size; off += hdr.plane_len) {
+        uint64_t n = hdr.size - off < hdr.plane_len ? hdr.size - off : hdr.plane_len;
+        if (decode_plane(&p, end, buf + off, n) != 0) {
+            free(buf);
+            return -1;
+        }
+    }
+    if (p != end) {
+        free(buf);
+        return -1;
+    }
+    *out = buf;
+    *out_len = hdr.size;
+    return 0;
+}
+
+/*==========================================================================*/
+/* File interface                                                           */
+/*==========================================================================*/
+
+static int read_all(FILE *in, uint8_t **buf, size_t *len)
+{
+    size_t cap = 1 << 20, n = 0, r;
+    uint8_t *b = malloc(cap);
+
+    if (!b) return -1;
+    while ((r = fread(b + n, 1, cap - n, in)) > 0) {
+        n += r;
+        if (n == cap) {
+            uint8_t *g = realloc(b, cap * 2);
+            if (!g) { free(b); return -1; }
+            b = g;
+            cap *= 2;
+        }
+    }
+    if (ferror(in)) { free(b); return -1; }
+    *buf = b;
+    *len = n;
+    return 0;
+}
+
+static int code_file(FILE *in, FILE *out, size_t plane_len, int encode)
+{
+    uint8_t *src, *dst = NULL;
+    size_t len, dst_len = 0;
+    int ret;
+
+    if (read_all(in, &src, &len) != 0) return -1;
+    ret = encode ? pent_encode(src, len, plane_len, &dst, &dst_len)
+                 : pent_decode(src, len, &dst, &dst_len);
+    free(src);
+    if (ret == 0 && dst_len && fwrite(dst, 1, dst_len, out) != dst_len) ret = -1;
+    free(dst);
+    return ret;
+}
+
+int pent_encode_file(FILE *in, FILE *out, size_t plane_len)
+{
+    return code_file(in, out, plane_len, 1);
+}
+
+int pent_decode_file(FILE *in, FILE *out)
+{
+    return code_file(in, out, 0, 0);
+}
@@ -0,0 +1,56 @@
+/*  pent.h — per-plane entropy coder, format and buffer API (libpent.a)
+ *   Byte and bit planes compress through their symbol statistics, not
+ *   through matches, so every plane gets its own canonical Huffman table
+ *   (codes of at most PENT_MAX_BITS) and no LZ stage.  A plane is split
+ *   in 4 streams decoded side by side.  Constant planes are a single
+ *   byte, planes that do not shrink are stored.
+ *
+ *   File: a PentHeader, then per plane (layout in pent.c)
+ *       PENT_RAW   the plane
+ *       PENT_RLE   its byte
+ *       PENT_HUF   code lengths, 4 varint stream sizes, the streams
+ */
+#ifndef PENT_H
+#define PENT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PENT_MAGIC     "PENT"
+#define PENT_VERSION   1
+
+/* Longest code, the decode table has 1 << PENT_MAX_BITS entries            */
+#define PENT_MAX_BITS  11
+/* Plane size when the caller has no planes to give                         */
+#define PENT_PLANE     (1u << 16)
+
+/* Plane modes                                                              */
+#define PENT_RAW       0
+#define PENT_RLE       1
+#define PENT_HUF       2
+
+#pragma pack(push,1)
+typedef struct {
+    char     magic[4];      /* "PENT" */
+    uint16_t version;       /* =1      */
+    uint16_t flags;         /* 0       */
+    uint32_t plane_len;     /* bytes per plane, the last one may be shorter  */
+    uint64_t size;          /* input bytes                                   */
+} PentHeader;
+#pragma pack(pop)
+
+/*==========================================================================*/
+/* Buffer interface: *out is malloc()ed, owned by the caller.               */
+/* <plane_len> splits the input in planes with their own table, 0 takes     */
+/* PENT_PLANE.  Both return 0, or -1 on bad input / out of memory.          */
+/*==========================================================================*/
+int pent_encode(const void *in, size_t len, size_t plane_len,
+                uint8_t **out, size_t *out_len);
+int pent_decode(const void *in, size_t len, uint8_t **out, size_t *out_len);
+
+/* What "plane_entropy -c" / "-x" run, whole file in memory.  0 or -1.      */
+int pent_encode_file(FILE *in, FILE *out, size_t plane_len);
+int pent_decode_file(FILE *in, FILE *out);
+
+#endif
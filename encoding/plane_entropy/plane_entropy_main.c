@@ -0,0 +1,62 @@
+/*  per-plane entropy coding of a byte / bit plane file
+ *   Each plane of <plane_len> bytes gets its own Huffman table, see
+ *   pent.h; without -p the planes are PENT_PLANE bytes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pent.h"
+
+static void die(const char *msg)
+{
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+static int code_file(int encode, size_t plane_len, const char *in_name, const char *out_name)
+{
+    FILE *fin = fopen(in_name, "rb");
+    if (!fin) die("fopen input");
+    FILE *fout = fopen(out_name, "wb");
+    if (!fout) die("fopen output");
+
+    int ret = encode ? pent_encode_file(fin, fout, plane_len) : pent_decode_file(fin, fout);
+    fclose(fin);
+    if (fclose(fout) != 0) ret = -1;
+    if (ret != 0) {
+        fprintf(stderr, "%s %s failed\n", encode ? "encode" : "decode", in_name);
+        return 1;
+    }
+    return 0;
+}
+
+/*==========================================================================*/
+/* CLI entry                                                                 */
+/*==========================================================================*/
+/* Usage demonstration:
+ *   plane_entropy -c -p 10240 byte.res out.pent   (one table per 10240 B)
+ *   plane_entropy -x out.pent byte.res
+ */
+int main(int argc, char *argv[])
+{
+    size_t plane_len = 0;
+    int a = 1, encode;
+
+    if (argc >= 2 && !strcmp(argv[1], "-c") && argc >= 4 && !strcmp(argv[2], "-p")) {
+        plane_len = strtoull(argv[3], NULL, 0);
+        a = 3;
+        argv[3] = argv[1];
+    }
+    if (argc - a != 3 || (strcmp(argv[a], "-c") && strcmp(argv[a], "-x"))) {
+        fprintf(stderr,
+                "Usage:\n"
+                "  %s -c [-p plane_len] <input.bin> <output.pent>   (encode)\n"
+                "  %s -x <input.pent> <output.bin>                  (decode)\n",
+                argv[0], argv[0]);
+        return 1;
+    }
+    encode = !strcmp(argv[a], "-c");
+    return code_file(encode, plane_len, argv[a + 1], argv[a + 2]);
+}
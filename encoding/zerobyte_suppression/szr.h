@@ -0,0 +1,84 @@
+/*  szr.h — SZR0 zero-run suppression format and buffer API (libszr.a)
+ *   v2: a HeaderV2 and self-delimiting chunks of SZR_CHUNK input bytes,
+ *       each a varint run table followed by the chunk with its runs cut
+ *       out (layout in szr.c); sizes are 64-bit throughout.  Runs are of
+ *       zeros, or with SZR_F_PATTERN of any byte or 2 / 4-byte word.
+ *   v1: a Header, <rec_cnt> ZeroRec entries and then the input with
+ *       every recorded zero run cut out.  Still read, no longer written.
+ */
+#ifndef SZR_H
+#define SZR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Threshold: a run of ≥ CONTINUE_ZERO consecutive zeros triggers shrinking */
+#define CONTINUE_ZERO  8
+/* ... and of ≥ CONTINUE_RUN bytes for any other repeated byte / 2-4B word  */
+#define CONTINUE_RUN   16
+
+#define MAGIC          "SZR0"
+#define VERSION        2
+#define VERSION_V1     1
+
+/* Input bytes per v2 chunk, the last one may be shorter                    */
+#define SZR_CHUNK      (1u << 20)
+
+#pragma pack(push,1)
+typedef struct {
+    char     magic[4];      /* "SZR0" */
+    uint16_t version;       /* =1      */
+    uint16_t rec_cnt;        /* how many zero records follow                  */
+    uint32_t original_sz;   /* original (un-shrunk) file size                */
+} Header;
+
+typedef struct {
+    uint32_t off;           /* offset in original file                       */
+    uint32_t len;           /* length of the zero block                      */
+} ZeroRec;
+
+typedef struct {
+    char     magic[4];      /* "SZR0" */
+    uint16_t version;       /* =2      */
+    uint16_t flags;         /* 0       */
+    uint32_t chunk_sz;      /* input bytes per chunk                         */
+} HeaderV2;
+
+/* HeaderV2.flags: run entries carry a pattern, not just zeros              */
+#define SZR_F_PATTERN  0x0001
+#pragma pack(pop)
+
+/*==========================================================================*/
+/* Buffer interface: *out is malloc()ed, owned by the caller.               */
+/* Both return 0, or -1 on bad input / out of memory.                       */
+/*==========================================================================*/
+int szr_shrink(const void *in, size_t len, uint8_t **out, size_t *out_len);
+int szr_expand(const void *in, size_t len, uint8_t **out, size_t *out_len);
+
+/*==========================================================================*/
+/* Runs found in one SIMD pass (SSE2 / AVX2 when the CPU has them), in      */
+/* order and disjoint.  *runs is malloc()ed, NULL when there are none;      */
+/* both return 0, or -1 when out of memory.                                 */
+/*   szr_scan()       zero runs of at least CONTINUE_ZERO bytes             */
+/*   szr_scan_runs()  also runs of any other byte and of a repeated 2 / 4   */
+/*                    byte word, CONTINUE_RUN bytes at least; the shorter   */
+/*                    period wins where several match                       */
+/*==========================================================================*/
+typedef struct {
+    uint64_t off;
+    uint64_t len;
+    uint8_t  width;         /* 1, 2 or 4: bytes of the repeated pattern      */
+    uint8_t  value[4];      /* the pattern, as it appears from <off> on      */
+} SZR_RUN;
+
+int szr_scan(const void *in, size_t len, SZR_RUN **runs, uint64_t *cnt);
+int szr_scan_runs(const void *in, size_t len, SZR_RUN **runs, uint64_t *cnt);
+
+/* What "zerobyte_suppression -c" / "-x" run: one pass, a chunk at a time, */
+/* so pipes work too.  Between two regular files the expand leaves zero     */
+/* runs as holes and copies literal spans in the kernel.  0 or -1.          */
+int szr_shrink_file(FILE *in, FILE *out);
+int szr_expand_file(FILE *in, FILE *out);
+
+#endif
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+static int write_all(int fd, const void *p, size_t len, uint64_t off)
+{
+	const uint8_t *b = p;
+
+	while(len){
+		ssize_t n = pwrite(fd, b, len, off);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0){
+			printf("%s, write failed\n", __FUNCTION__);
+			return -1;
+			}
+		b += n;
+		off += (uint64_t)n;
+		len -= (size_t)n;
+		}
+	return 0;
+}
+
+/* Hand the gathered bytes out for writing at <at> and gather into the
+ * spare buffer from here on, caller holds the lock.  NULL when there is
+ * nothing to write or no buffer to gather into.                         */
+static uint8_t *swap_buf(ARCHIVE_WRITER *w, size_t *fill, uint64_t *at)
+{
+	uint8_t *full = w->buf;
+	uint8_t *next = w->spare ? w->spare : malloc(ARCHIVE_BUF);
+
+	*fill = w->fill;
+	*at = w->off;
+	if(!w->fill)
+		return NULL;
+	if(!next){
+		printf("%s, out of memory\n", __FUNCTION__);
+		w->failed = 1;
+		return NULL;
+		}
+	w->spare = NULL;
+	w->buf = next;
+	w->off += w->fill;
+	w->fill = 0;
+	return full;
+}
+
+/* <full> written out, keep it as the spare buffer                       */
+static void return_buf(ARCHIVE_WRITER *w, uint8_t *full, int failed)
+{
+	pthread_mutex_lock(&w->lock);
+	if(failed)
+		w->failed = 1;
+	if(!w->spare)
+		w->spare = full;
+	else
+		free(full);
+	pthread_mutex_unlock(&w->lock);
+}
+
+int archive_create(ARCHIVE_WRITER *w, const char *path)
+{
+	ARCHIVE_HEADER h;
+
+	memset(w, 0, sizeof(*w));
+	w->buf = malloc(ARCHIVE_BUF);
+	w->path = strdup(path);
+	if(!w->buf || !w->path){
+		printf("%s, out of memory\n", __FUNCTION__);
+		free(w->buf);
+		free(w->path);
+		return -1;
+		}
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(w->fd < 0){
+		printf("%s, cannot create %s\n", __FUNCTION__, path);
+		free(w->buf);
+		free(w->path);
+		return -1;
+		}
+	pthread_mutex_init(&w->lock, NULL);
+	memcpy(h.magic, ARCHIVE_MAGIC, 4);
+	h.version = ARCHIVE_VERSION;
+	memcpy(w->buf, &h, sizeof(h));
+	w->fill = sizeof(h);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * archive_append()
+ *  The lock covers the directory, the offsets and the copy into the
+ *  buffer; a full buffer and a large segment are written with pwrite()
+ *  at their reserved offsets after it is released, so appends from other
+ *  threads go on meanwhile.
+ *------------------------------------------------------------------------*/
+int archive_append(ARCHIVE_WRITER *w, const ARCHIVE_ENTRY *meta, const void *data, size_t len)
+{
+	ARCHIVE_ENTRY *e;
+	uint8_t *full = NULL;
+	size_t fill = 0;
+	uint64_t at = 0, direct = 0;
+	int ret = 0;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->failed){
+		pthread_mutex_unlock(&w->lock);
+		return -1;
+		}
+	if(w->count == w->cap){
+		uint64_t cap = w->cap ? w->cap * 2 : 256;
+		ARCHIVE_ENTRY *dir = realloc(w->dir, cap * sizeof(*dir));
+		if(!dir){
+			printf("%s, out of memory\n", __FUNCTION__);
+			w->failed = 1;
+			pthread_mutex_unlock(&w->lock);
+			return -1;
+			}
+		w->dir = dir;
+		w->cap = cap;
+		}
+	/* large segments go straight out, the rest is gathered              */
+	if(w->fill + len > ARCHIVE_BUF){
+		full = swap_buf(w, &fill, &at);
+		if(w->failed){
+			pthread_mutex_unlock(&w->lock);
+			return -1;
+			}
+		}
+	e = &w->dir[w->count++];
+	*e = *meta;
+	e->name[ARCHIVE_NAME-1] = 0;
+	e->offset = w->off + w->fill;
+	e->length = len;
+	if(len >= ARCHIVE_BUF){
+		direct = w->off;
+		w->off += len;
+	}else{
+		memcpy(w->buf + w->fill, data, len);
+		w->fill += len;
+		}
+	pthread_mutex_unlock(&w->lock);
+
+	if(full){
+		ret = write_all(w->fd, full, fill, at);
+		return_buf(w, full, ret);
+		}
+	if(!ret && len >= ARCHIVE_BUF){
+		ret = write_all(w->fd, data, len, direct);
+		if(ret){
+			pthread_mutex_lock(&w->lock);
+			w->failed = 1;
+			pthread_mutex_unlock(&w->lock);
+			}
+		}
+	return ret;
+}
+
+/* release <w>, its file removed unless <keep>                          */
+static int release(ARCHIVE_WRITER *w, int keep)
+{
+	int ret = 0;
+
+	if(close(w->fd) && keep){
+		printf("%s, close failed\n", __FUNCTION__);
+		ret = -1;
+		}
+	if(!keep || ret)
+		unlink(w->path);
+	pthread_mutex_destroy(&w->lock);
+	free(w->buf);
+	free(w->spare);
+	free(w->dir);
+	free(w->path);
+	memset(w, 0, sizeof(*w));
+	w->fd = -1;
+	return ret;
+}
+
+int archive_finish(ARCHIVE_WRITER *w)
+{
+	ARCHIVE_TRAILER t;
+	uint64_t off = w->off + w->fill;
+	int ret = w->failed ? -1 : 0;
+
+	/* the appends are over, no other thread holds a buffer any more      */
+	if(!ret)
+		ret = write_all(w->fd, w->buf, w->fill, w->off);
+	if(!ret){
+		t.dir_offset = off;
+		t.count = w->count;
+		memcpy(t.magic, ARCHIVE_MAGIC, 4);
+		t.version = ARCHIVE_VERSION;
+		ret = write_all(w->fd, w->dir, w->count * sizeof(*w->dir), off);
+		if(!ret)
+			ret = write_all(w->fd, &t, sizeof(t), off + w->count * sizeof(*w->dir));
+		}
+	if(ret)
+		printf("%s, %s removed\n", __FUNCTION__, w->path);
+	return release(w, !ret) || ret ? -1 : 0;
+}
+
+void archive_abort(ARCHIVE_WRITER *w)
+{
+	printf("%s, %s removed\n", __FUNCTION__, w->path);
+	release(w, 0);
+}
+
+int archive_open(ARCHIVE *a, const char *path)
+{
+	struct stat st;
+	ARCHIVE_HEADER h;
+	ARCHIVE_TRAILER t;
+	uint64_t i, data_end;
+
+	memset(a, 0, sizeof(*a));
+	a->fd = open(path, O_RDONLY);
+	if(a->fd < 0){
+		printf("%s, cannot open %s\n", __FUNCTION__, path);
+		return -1;
+		}
+	if(fstat(a->fd, &st) || (uint64_t)st.st_size < sizeof(h) + sizeof(t)){
+		printf("%s, %s is not an archive\n", __FUNCTION__, path);
+		goto fail;
+		}
+	a->size = (size_t)st.st_size;
+	a->map = mmap(NULL, a->size, PROT_READ, MAP_SHARED, a->fd, 0);
+	if(a->map == MAP_FAILED){
+		a->map = NULL;
+		printf("%s, cannot map %s\n", __FUNCTION__, path);
+		goto fail;
+		}
+	memcpy(&h, a->map, sizeof(h));
+	memcpy(&t, a->map + a->size - sizeof(t), sizeof(t));
+	if(memcmp(h.magic, ARCHIVE_MAGIC, 4) || memcmp(t.magic, ARCHIVE_MAGIC, 4) ||
+		h.version != ARCHIVE_VERSION || t.version != ARCHIVE_VERSION){
+		printf("%s, %s is not an archive\n", __FUNCTION__, path);
+		goto fail;
+		}
+	data_end = a->size - sizeof(t);
+	if(t.dir_offset < sizeof(h) || t.dir_offset > data_end ||
+		t.count != (data_end - t.dir_offset) / sizeof(ARCHIVE_ENTRY) ||
+		(data_end - t.dir_offset) % sizeof(ARCHIVE_ENTRY)){
+		printf("%s, %s: bad directory\n", __FUNCTION__, path);
+		goto fail;
+		}
+	a->dir = (const ARCHIVE_ENTRY *)(a->map + t.dir_offset);
+	a->count = t.count;
+	for(i=0;i<a->count;i++){
+		const ARCHIVE_ENTRY *e = &a->dir[i];
+		if(e->offset < sizeof(h) || e->offset > t.dir_offset ||
+			e->length > t.dir_offset - e->offset ||
+			memchr(e->name, 0, ARCHIVE_NAME) == NULL){
+			printf("%s, %s: bad entry %llu\n", __FUNCTION__, path, (unsigned long long)i);
+			goto fail;
+			}
+		}
+	madvise((void *)a->map, a->size, MADV_WILLNEED);
+	return 0;
+fail:
+	archive_close(a);
+	return -1;
+}
+
+const uint8_t *archive_segment(const ARCHIVE *a, uint64_t i, size_t *len)
+{
+	if(i >= a->count)
+		return NULL;
+	*len = (size_t)a->dir[i].length;
+	return a->map + a->dir[i].offset;
+}
+
+void archive_close(ARCHIVE *a)
+{
+	if(a->map)
+		munmap((void *)a->map, a->size);
+	if(a->fd >= 0)
+		close(a->fd);
+	memset(a, 0, sizeof(*a));
+	a->fd = -1;
+}
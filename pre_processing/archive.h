@@ -0,0 +1,107 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*------------------------------------------------------------------------
+ * Segment archive
+ *  One file in place of a file per segment and output:
+ *      ARCHIVE_HEADER
+ *      the segments, back to back in the order they were appended
+ *      ARCHIVE_ENTRY per segment (the directory)
+ *      ARCHIVE_TRAILER, locating the directory
+ *  The writer gathers segments in a large buffer and writes it out at
+ *  its offset while the next one fills; the reader maps the file once
+ *  and hands out pointers into the mapping, so any number of threads
+ *  decode segments side by side.  <channel>, <variant> and <output> are the caller's codes
+ *  (pipeline.c: PIPE_CHANNEL.id, PIPE_VARIANT, PIPE_OUTPUT), <name> the
+ *  file the segment stands for.
+ *------------------------------------------------------------------------*/
+#define ARCHIVE_MAGIC		"PARC"
+#define ARCHIVE_VERSION		1
+#define ARCHIVE_NAME		48
+/* what the writer gathers before a write()                              */
+#define ARCHIVE_BUF		(8u << 20)
+
+/* ARCHIVE_ENTRY.flags: min / max hold the range of the segment records,
+ * the planes of a byte / bit variant are a plane map (planemap.h)       */
+#define ARCHIVE_F_RANGE		0x01
+#define ARCHIVE_F_PMAP		0x02
+
+#pragma pack(push,1)
+typedef struct {
+	char     magic[4];
+	uint32_t version;
+} ARCHIVE_HEADER;
+
+typedef struct {
+	uint64_t offset;	/* from the start of the file                */
+	uint64_t length;
+	uint64_t first;		/* record range of the segment               */
+	uint64_t records;
+	int64_t  min;		/* smallest / largest record value           */
+	int64_t  max;
+	uint32_t segment;
+	uint8_t  channel;
+	uint8_t  variant;
+	uint8_t  output;
+	uint8_t  flags;
+	char     name[ARCHIVE_NAME];	/* NUL terminated                    */
+} ARCHIVE_ENTRY;
+
+typedef struct {
+	uint64_t dir_offset;
+	uint64_t count;		/* entries                                   */
+	char     magic[4];
+	uint32_t version;
+} ARCHIVE_TRAILER;
+#pragma pack(pop)
+
+typedef struct {
+	pthread_mutex_t lock;
+	int            fd;
+	char           *path;
+	uint8_t        *buf;	/* ARCHIVE_BUF bytes, <fill> pending         */
+	uint8_t        *spare;	/* next <buf>, NULL while being written      */
+	size_t         fill;
+	uint64_t       off;	/* file offset of buf[0]                     */
+	ARCHIVE_ENTRY  *dir;
+	uint64_t       count;
+	uint64_t       cap;
+	int            failed;
+} ARCHIVE_WRITER;
+
+typedef struct {
+	int                 fd;
+	const uint8_t       *map;
+	size_t              size;
+	const ARCHIVE_ENTRY *dir;
+	uint64_t            count;
+} ARCHIVE;
+
+/* Create <path>.  Returns 0, or -1.                                     */
+int archive_create(ARCHIVE_WRITER *w, const char *path);
+
+/* Append <len> bytes described by <meta> (offset and length are filled
+ * in); safe to call from several threads.  Returns 0, or -1.            */
+int archive_append(ARCHIVE_WRITER *w, const ARCHIVE_ENTRY *meta, const void *data, size_t len);
+
+/* Write the pending segments, the directory and the trailer, release
+ * <w>.  Returns 0, or -1 when this or an earlier write failed; the file
+ * is removed then, no archive is left without all its segments.         */
+int archive_finish(ARCHIVE_WRITER *w);
+
+/* Release <w> and remove the file, for a run that failed                */
+void archive_abort(ARCHIVE_WRITER *w);
+
+/* Map <path> and check its directory.  Returns 0, or -1.                */
+int archive_open(ARCHIVE *a, const char *path);
+
+/* Segment <i> inside the mapping, NULL when out of range                */
+const uint8_t *archive_segment(const ARCHIVE *a, uint64_t i, size_t *len);
+
+void archive_close(ARCHIVE *a);
+
+#endif
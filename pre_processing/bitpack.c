@@ -0,0 +1,347 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "bitpack.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* ref + b + nexc + xb + packed + positions + exception bits, at most    */
+#define BLOCK_MAX	(4 + 3 + 16*32 + BITPACK_BLOCK + BITPACK_BLOCK*4)
+
+/* 128 values, already minus ref, <-> 16*b bytes                         */
+typedef void (*PACK_KERNEL)(const uint32_t *in, uint8_t *out, int b);
+typedef void (*UNPACK_KERNEL)(const uint8_t *in, uint32_t *out, int b, uint32_t ref);
+
+/*------------------------------------------------------------------------
+ * Scalar kernels, one lane after the other
+ *------------------------------------------------------------------------*/
+static void pack_scalar(const uint32_t *in, uint8_t *out, int b)
+{
+	int l, i;
+
+	for(l=0;l<4;l++){
+		uint64_t acc = 0;
+		int fill = 0, k = 0;
+		for(i=0;i<BITPACK_BLOCK/4;i++){
+			acc |= (uint64_t)in[4*i + l] << fill;
+			fill += b;
+			if(fill >= 32){
+				uint32_t w = (uint32_t)acc;
+				memcpy(out + 4*(4*k + l), &w, 4);
+				k++;
+				acc >>= 32;
+				fill -= 32;
+				}
+			}
+		}
+}
+
+static void unpack_scalar(const uint8_t *in, uint32_t *out, int b, uint32_t ref)
+{
+	uint32_t mask = b == 32 ? 0xFFFFFFFFu : (1u << b) - 1;
+	int l, i;
+
+	for(l=0;l<4;l++){
+		uint64_t acc = 0;
+		int have = 0, k = 0;
+		for(i=0;i<BITPACK_BLOCK/4;i++){
+			if(have < b){
+				uint32_t w;
+				memcpy(&w, in + 4*(4*k + l), 4);
+				k++;
+				acc |= (uint64_t)w << have;
+				have += 32;
+				}
+			out[4*i + l] = ((uint32_t)acc & mask) + ref;
+			acc >>= b;
+			have -= b;
+			}
+		}
+}
+
+#if HAVE_X86_SIMD
+/*------------------------------------------------------------------------
+ * SSE2 kernels
+ *  The 4 lanes are packed side by side, the shift counts are the same
+ *  in every lane so _mm_sll_epi32 / _mm_srl_epi32 take them at runtime.
+ *  A count of 32 clears the lane, which is what b == 32 needs.
+ *------------------------------------------------------------------------*/
+TARGET_SSE2
+static void pack_sse2(const uint32_t *in, uint8_t *out, int b)
+{
+	__m128i acc = _mm_setzero_si128();
+	int fill = 0, i;
+
+	if(b == 0)
+		return;
+	for(i=0;i<BITPACK_BLOCK/4;i++){
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + 4*i));
+		acc = _mm_or_si128(acc, _mm_sll_epi32(v, _mm_cvtsi32_si128(fill)));
+		fill += b;
+		if(fill >= 32){
+			_mm_storeu_si128((__m128i *)out, acc);
+			out += 16;
+			fill -= 32;
+			acc = _mm_srl_epi32(v, _mm_cvtsi32_si128(b - fill));
+			}
+		}
+}
+
+TARGET_SSE2
+static void unpack_sse2(const uint8_t *in, uint32_t *out, int b, uint32_t ref)
+{
+	__m128i mask = _mm_set1_epi32(b == 32 ? -1 : (int)((1u << b) - 1));
+	__m128i r = _mm_set1_epi32((int)ref);
+	__m128i w = _mm_setzero_si128();
+	int used = 32, i;
+
+	for(i=0;i<BITPACK_BLOCK/4;i++){
+		__m128i v;
+		if(used + b <= 32){
+			v = _mm_srl_epi32(w, _mm_cvtsi32_si128(used));
+			used += b;
+		}else{
+			/* rest of this word, head of the next                  */
+			__m128i next = _mm_loadu_si128((const __m128i *)in);
+			in += 16;
+			v = _mm_or_si128(_mm_srl_epi32(w, _mm_cvtsi32_si128(used)),
+					_mm_sll_epi32(next, _mm_cvtsi32_si128(32 - used)));
+			w = next;
+			used = used + b - 32;
+			}
+		v = _mm_and_si128(v, mask);
+		_mm_storeu_si128((__m128i *)(out + 4*i), _mm_add_epi32(v, r));
+		}
+}
+#endif
+
+static PACK_KERNEL pick_pack(void)
+{
+#if HAVE_X86_SIMD
+	if(cpu_simd_level() >= SIMD_SSE2)
+		return pack_sse2;
+#endif
+	return pack_scalar;
+}
+
+static UNPACK_KERNEL pick_unpack(void)
+{
+#if HAVE_X86_SIMD
+	if(cpu_simd_level() >= SIMD_SSE2)
+		return unpack_sse2;
+#endif
+	return unpack_scalar;
+}
+
+const char *bitpack_kernel_name(void)
+{
+	return cpu_simd_level() >= SIMD_SSE2 ? "sse2" : "scalar";
+}
+
+static inline int width32(uint32_t v)
+{
+	return v ? 32 - __builtin_clz(v) : 0;
+}
+
+/* <n> bits of <v> at bit <*pos> of <out>, LSB first; <out> is zeroed   */
+static void put_bits(uint8_t *out, size_t *pos, uint32_t v, int n)
+{
+	uint64_t w = (uint64_t)v << (*pos%8);
+	uint8_t *p = out + *pos/8;
+	int bits = n + (int)(*pos%8);
+
+	for(;bits>0;bits-=8,w>>=8)
+		*p++ |= (uint8_t)w;
+	*pos += n;
+}
+
+static uint32_t get_bits(const uint8_t *in, size_t *pos, int n)
+{
+	const uint8_t *p = in + *pos/8;
+	int shift = *pos%8, bits = n + shift, i;
+	uint64_t w = 0;
+
+	for(i=0;bits>0;i+=8,bits-=8)
+		w |= (uint64_t)*p++ << i;
+	*pos += n;
+	return (uint32_t)((w >> shift) & ((1ull << n) - 1));
+}
+
+size_t bitpack_bound(size_t n, int unit_size)
+{
+	(void)unit_size;
+	return sizeof(BITPACK_HEADER) + (n + BITPACK_BLOCK - 1)/BITPACK_BLOCK * BLOCK_MAX;
+}
+
+/*------------------------------------------------------------------------
+ * encode_block()
+ *  <v> holds the 128 values; picks b from the histogram of widths, the
+ *  cost of b being 128*b bits plus 8 + (xb - b) per exception.
+ *------------------------------------------------------------------------*/
+static uint8_t *encode_block(uint32_t *v, int unit_size, PACK_KERNEL pack, uint8_t *out)
+{
+	uint32_t ref = v[0];
+	int hist[33] = {0}, i, b, best = 0, xb = 0, nexc = 0;
+	uint64_t best_cost = UINT64_MAX;
+	int above = 0;
+
+	for(i=1;i<BITPACK_BLOCK;i++)
+		if(v[i] < ref)
+			ref = v[i];
+	for(i=0;i<BITPACK_BLOCK;i++){
+		v[i] -= ref;
+		hist[width32(v[i])]++;
+		}
+	for(xb=32;xb>0 && !hist[xb];xb--)
+		;
+	/* b from wide to narrow, <above> values need more than b bits       */
+	for(b=xb;b>=0;b--){
+		uint64_t cost = 128ull*b + (uint64_t)above*(8 + xb - b);
+		if(above < BITPACK_BLOCK && cost < best_cost){
+			best_cost = cost;
+			best = b;
+			nexc = above;
+			}
+		above += hist[b];
+		}
+
+	memcpy(out, &ref, unit_size);	/* little-endian lanes          */
+	out += unit_size;
+	*out++ = best;
+	*out++ = nexc;
+	if(nexc)
+		*out++ = xb;
+	{
+		uint32_t low[BITPACK_BLOCK];
+		uint32_t mask = best == 32 ? 0xFFFFFFFFu : (1u << best) - 1;
+		for(i=0;i<BITPACK_BLOCK;i++)
+			low[i] = v[i] & mask;
+		memset(out, 0, 16*best);
+		pack(low, out, best);
+		out += 16*best;
+	}
+	if(nexc){
+		size_t pos = 0, bytes = ((size_t)nexc*(xb - best) + 7)/8;
+		uint8_t *bits;
+		for(i=0;i<BITPACK_BLOCK;i++)
+			if(width32(v[i]) > best)
+				*out++ = i;
+		bits = out;
+		memset(bits, 0, bytes);
+		for(i=0;i<BITPACK_BLOCK;i++)
+			if(width32(v[i]) > best)
+				put_bits(bits, &pos, v[i] >> best, xb - best);
+		out += bytes;
+		}
+	return out;
+}
+
+int bitpack_encode(const uint8_t *in, size_t n, int unit_size, uint8_t *out, size_t *out_len)
+{
+	PACK_KERNEL pack = pick_pack();
+	BITPACK_HEADER hdr;
+	uint32_t v[BITPACK_BLOCK];
+	uint8_t *p;
+	size_t k, i;
+
+	if(!in || !out || !out_len || (unit_size != 2 && unit_size != 4) || n > UINT32_MAX){
+		printf("%s, invalid arguments\n", __FUNCTION__);
+		return -1;
+		}
+	memcpy(hdr.magic, BITPACK_MAGIC, sizeof(hdr.magic));
+	hdr.unit_size = unit_size;
+	hdr.reserved = 0;
+	hdr.count = n;
+	memcpy(out, &hdr, sizeof(hdr));
+	p = out + sizeof(hdr);
+
+	for(k=0;k<n;k+=BITPACK_BLOCK){
+		size_t m = n - k < BITPACK_BLOCK ? n - k : BITPACK_BLOCK;
+		if(unit_size == 2){
+			const uint16_t *s = (const uint16_t *)in + k;
+			for(i=0;i<m;i++)
+				v[i] = s[i];
+		}else{
+			memcpy(v, (const uint32_t *)in + k, m*4);
+			}
+		for(i=m;i<BITPACK_BLOCK;i++)
+			v[i] = v[0];
+		p = encode_block(v, unit_size, pack, p);
+		}
+	*out_len = p - out;
+	return 0;
+}
+
+int bitpack_decode(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap, size_t *n)
+{
+	UNPACK_KERNEL unpack = pick_unpack();
+	const uint8_t *p, *end = in + in_len;
+	BITPACK_HEADER hdr;
+	uint32_t v[BITPACK_BLOCK];
+	size_t k, i;
+
+	if(!in || !out || !n || in_len < sizeof(hdr))
+		return -1;
+	memcpy(&hdr, in, sizeof(hdr));
+	if(memcmp(hdr.magic, BITPACK_MAGIC, sizeof(hdr.magic)) || hdr.reserved
+		|| (hdr.unit_size != 2 && hdr.unit_size != 4)
+		|| (size_t)hdr.count * hdr.unit_size > out_cap){
+		printf("%s, not a bit-packed stream or no room\n", __FUNCTION__);
+		return -1;
+		}
+	p = in + sizeof(hdr);
+	for(k=0;k<hdr.count;k+=BITPACK_BLOCK){
+		size_t m = hdr.count - k < BITPACK_BLOCK ? hdr.count - k : BITPACK_BLOCK;
+		uint32_t ref = 0;
+		int b, nexc, xb = 0;
+
+		if(end - p < hdr.unit_size + 2)
+			goto bad;
+		memcpy(&ref, p, hdr.unit_size);
+		p += hdr.unit_size;
+		b = *p++;
+		nexc = *p++;
+		if(nexc){
+			if(p == end)
+				goto bad;
+			xb = *p++;
+			}
+		if(b > 8*hdr.unit_size || (nexc && (xb <= b || xb > 8*hdr.unit_size))
+			|| nexc >= BITPACK_BLOCK || (size_t)(end - p) < 16u*b)
+			goto bad;
+		unpack(p, v, b, ref);
+		p += 16*b;
+		if(nexc){
+			const uint8_t *pos = p;
+			size_t bit = 0, bytes = ((size_t)nexc*(xb - b) + 7)/8;
+			if((size_t)(end - p) < nexc + bytes)
+				goto bad;
+			p += nexc;
+			for(i=0;i<(size_t)nexc;i++){
+				if(pos[i] >= BITPACK_BLOCK)
+					goto bad;
+				v[pos[i]] += get_bits(p, &bit, xb - b) << b;
+				}
+			p += bytes;
+			}
+		if(hdr.unit_size == 2){
+			uint16_t *d = (uint16_t *)out + k;
+			for(i=0;i<m;i++)
+				d[i] = v[i];
+		}else{
+			memcpy((uint32_t *)out + k, v, m*4);
+			}
+		}
+	if(p != end)
+		goto bad;
+	*n = hdr.count;
+	return 0;
+bad:
+	printf("%s, corrupt stream\n", __FUNCTION__);
+	return -1;
+}
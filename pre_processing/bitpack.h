@@ -0,0 +1,47 @@
+#ifndef BITPACK_H
+#define BITPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Frame-of-reference bit packing (SIMD-BP128 layout, PFor exceptions)
+ *  WORD / DWORD lanes are cut in blocks of BITPACK_BLOCK values, the
+ *  last one padded with its first value.  Every block stores
+ *      ref          unit_size bytes, the block minimum
+ *      b, nexc      bytes: packed width, number of exceptions
+ *      xb           byte, only when nexc > 0: width of v - ref
+ *      packed       16*b bytes: (v - ref) low b bits, value i in 32-bit
+ *                   lane i%4 of a 4-lane vector stream
+ *      exceptions   nexc positions, then their (v - ref) >> b packed
+ *                   on xb - b bits, LSB first
+ *  b is the width with the fewest bits overall, a few wide values go to
+ *  the exception list instead of widening the whole block.
+ *------------------------------------------------------------------------*/
+#define BITPACK_BLOCK	128
+#define BITPACK_MAGIC	"BP"
+
+#pragma pack(push,1)
+typedef struct {
+	char     magic[2];
+	uint8_t  unit_size;	/* 2 or 4                                    */
+	uint8_t  reserved;	/* 0                                         */
+	uint32_t count;		/* values                                    */
+} BITPACK_HEADER;
+#pragma pack(pop)
+
+/* Largest bitpack_encode() output for <n> values                        */
+size_t bitpack_bound(size_t n, int unit_size);
+
+/* <n> lanes of <unit_size> bytes -> <out> (bitpack_bound() bytes room).
+ * Returns 0, or -1 on invalid arguments.                                */
+int bitpack_encode(const uint8_t *in, size_t n, int unit_size, uint8_t *out, size_t *out_len);
+
+/* Back into <out> (<out_cap> bytes), *n is the number of values.
+ * Returns 0, or -1 on a malformed stream.                               */
+int bitpack_decode(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap, size_t *n);
+
+/* name of the kernel picked at runtime ("scalar", "sse2")               */
+const char *bitpack_kernel_name(void);
+
+#endif
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "bitshuffle.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Every kernel handles groups [g0, g1) of an 8-byte-group buffer whose
+ * planes are <round> bytes long.                                         */
+typedef void (*BITSHUFFLE_KERNEL)(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1);
+
+/*------------------------------------------------------------------------
+ * trans8x8() - transpose an 8x8 bit matrix held in a uint64
+ *  Row r is byte r counted from the most significant end, column c is
+ *  bit (7-c) of that byte (Hacker's Delight, transpose8rS64).
+ *------------------------------------------------------------------------*/
+static inline uint64_t trans8x8(uint64_t x)
+{
+	uint64_t t;
+
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	x = __builtin_bswap64(x);
+#endif
+	return x;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t x)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	x = __builtin_bswap64(x);
+#endif
+	memcpy(p, &x, sizeof(x));
+}
+
+/*------------------------------------------------------------------------
+ * Scalar 64-bit kernels: one 8x8 transpose per group
+ *------------------------------------------------------------------------*/
+static void encode_scalar(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	size_t g;
+	int p;
+
+	for(g=g0;g<g1;g++){
+		uint64_t x = trans8x8(load_be64(in + 8*g));
+		for(p=0;p<8;p++)
+			out[p*round + g] = (uint8_t)(x >> (56 - 8*p));
+		}
+}
+
+static void decode_scalar(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	size_t g;
+	int p;
+
+	for(g=g0;g<g1;g++){
+		uint64_t x = 0;
+		for(p=0;p<8;p++)
+			x |= (uint64_t)in[p*round + g] << (56 - 8*p);
+		store_be64(out + 8*g, trans8x8(x));
+		}
+}
+
+#if HAVE_X86_SIMD
+/*------------------------------------------------------------------------
+ * SSE2 kernels
+ *  movemask collects the MSB of 16 bytes at once; reversing each 8-byte
+ *  lane first puts byte 0 of a group into bit 7 of the mask byte.  Adding
+ *  the vector to itself shifts the next bit into the MSB.
+ *------------------------------------------------------------------------*/
+TARGET_SSE2
+static inline __m128i rev8_sse2(__m128i v)
+{
+	v = _mm_shufflelo_epi16(v, 0x1B);
+	v = _mm_shufflehi_epi16(v, 0x1B);
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+TARGET_SSE2
+static void encode_sse2(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	size_t g = g0;
+	int p;
+
+	for(;g+8<=g1;g+=8){
+		const uint8_t *src = in + 8*g;
+		__m128i v0 = rev8_sse2(_mm_loadu_si128((const __m128i *)(src)));
+		__m128i v1 = rev8_sse2(_mm_loadu_si128((const __m128i *)(src + 16)));
+		__m128i v2 = rev8_sse2(_mm_loadu_si128((const __m128i *)(src + 32)));
+		__m128i v3 = rev8_sse2(_mm_loadu_si128((const __m128i *)(src + 48)));
+		for(p=0;p<8;p++){
+			uint64_t m = (uint64_t)(uint16_t)_mm_movemask_epi8(v0)
+				| (uint64_t)(uint16_t)_mm_movemask_epi8(v1) << 16
+				| (uint64_t)(uint16_t)_mm_movemask_epi8(v2) << 32
+				| (uint64_t)(uint16_t)_mm_movemask_epi8(v3) << 48;
+			memcpy(out + p*round + g, &m, sizeof(m));
+			v0 = _mm_add_epi8(v0, v0);
+			v1 = _mm_add_epi8(v1, v1);
+			v2 = _mm_add_epi8(v2, v2);
+			v3 = _mm_add_epi8(v3, v3);
+			}
+		}
+	encode_scalar(in, out, round, g, g1);
+}
+
+/* Gather byte g of planes 7..0 into one 8-byte lane per group, for 8
+ * groups.  c[k] holds groups 2k (low lane) and 2k+1 (high lane).        */
+TARGET_SSE2
+static inline void gather8_sse2(const uint8_t *in, size_t round, size_t g,
+				__m128i c[4])
+{
+	__m128i r[8];
+	int p;
+
+	for(p=0;p<8;p++)
+		r[p] = _mm_loadl_epi64((const __m128i *)(in + p*round + g));
+
+	__m128i a0 = _mm_unpacklo_epi8(r[7], r[6]);
+	__m128i a1 = _mm_unpacklo_epi8(r[5], r[4]);
+	__m128i a2 = _mm_unpacklo_epi8(r[3], r[2]);
+	__m128i a3 = _mm_unpacklo_epi8(r[1], r[0]);
+	__m128i b0 = _mm_unpacklo_epi16(a0, a1);
+	__m128i b1 = _mm_unpackhi_epi16(a0, a1);
+	__m128i b2 = _mm_unpacklo_epi16(a2, a3);
+	__m128i b3 = _mm_unpackhi_epi16(a2, a3);
+	c[0] = _mm_unpacklo_epi32(b0, b2);
+	c[1] = _mm_unpackhi_epi32(b0, b2);
+	c[2] = _mm_unpacklo_epi32(b1, b3);
+	c[3] = _mm_unpackhi_epi32(b1, b3);
+}
+
+/* trans8x8() on both 64-bit lanes                                       */
+TARGET_SSE2
+static inline __m128i trans8x8_sse2(__m128i x)
+{
+	const __m128i m7  = _mm_set1_epi64x(0x00AA00AA00AA00AALL);
+	const __m128i m14 = _mm_set1_epi64x(0x0000CCCC0000CCCCLL);
+	const __m128i m28 = _mm_set1_epi64x(0x00000000F0F0F0F0LL);
+	__m128i t;
+
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 7)), m7);
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 7));
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 14)), m14);
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 14));
+	t = _mm_and_si128(_mm_xor_si128(x, _mm_srli_epi64(x, 28)), m28);
+	x = _mm_xor_si128(_mm_xor_si128(x, t), _mm_slli_epi64(t, 28));
+	return x;
+}
+
+/* A gathered lane read as a little-endian uint64 has plane 0 in its most
+ * significant byte, which is the row order trans8x8() expects; the
+ * transposed rows come out most significant first, so reverse on store. */
+TARGET_SSE2
+static void decode_sse2(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	size_t g = g0;
+	int k;
+
+	for(;g+8<=g1;g+=8){
+		__m128i c[4];
+
+		gather8_sse2(in, round, g, c);
+		for(k=0;k<4;k++)
+			_mm_storeu_si128((__m128i *)(out + 8*(g + 2*k)),
+					rev8_sse2(trans8x8_sse2(c[k])));
+		}
+	decode_scalar(in, out, round, g, g1);
+}
+
+/*------------------------------------------------------------------------
+ * AVX2 kernels, same scheme on 32-byte vectors
+ *------------------------------------------------------------------------*/
+TARGET_AVX2
+static void encode_avx2(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	const __m256i rev = _mm256_setr_epi8(
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	size_t g = g0;
+	int p;
+
+	for(;g+16<=g1;g+=16){
+		const uint8_t *src = in + 8*g;
+		__m256i v0 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src)), rev);
+		__m256i v1 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 32)), rev);
+		__m256i v2 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 64)), rev);
+		__m256i v3 = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(src + 96)), rev);
+		for(p=0;p<8;p++){
+			uint64_t m[2];
+			m[0] = (uint64_t)(uint32_t)_mm256_movemask_epi8(v0)
+				| (uint64_t)(uint32_t)_mm256_movemask_epi8(v1) << 32;
+			m[1] = (uint64_t)(uint32_t)_mm256_movemask_epi8(v2)
+				| (uint64_t)(uint32_t)_mm256_movemask_epi8(v3) << 32;
+			memcpy(out + p*round + g, m, sizeof(m));
+			v0 = _mm256_add_epi8(v0, v0);
+			v1 = _mm256_add_epi8(v1, v1);
+			v2 = _mm256_add_epi8(v2, v2);
+			v3 = _mm256_add_epi8(v3, v3);
+			}
+		}
+	encode_sse2(in, out, round, g, g1);
+}
+
+TARGET_AVX2
+static inline __m256i trans8x8_avx2(__m256i x)
+{
+	const __m256i m7  = _mm256_set1_epi64x(0x00AA00AA00AA00AALL);
+	const __m256i m14 = _mm256_set1_epi64x(0x0000CCCC0000CCCCLL);
+	const __m256i m28 = _mm256_set1_epi64x(0x00000000F0F0F0F0LL);
+	__m256i t;
+
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 7)), m7);
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 7));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 14)), m14);
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 14));
+	t = _mm256_and_si256(_mm256_xor_si256(x, _mm256_srli_epi64(x, 28)), m28);
+	x = _mm256_xor_si256(_mm256_xor_si256(x, t), _mm256_slli_epi64(t, 28));
+	return x;
+}
+
+TARGET_AVX2
+static void decode_avx2(const uint8_t *in, uint8_t *out,
+				size_t round, size_t g0, size_t g1)
+{
+	const __m256i rev = _mm256_setr_epi8(
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+			7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+	size_t g = g0;
+	int k, p;
+
+	/* 32 groups per step: 128-bit lane 0 carries groups 0..15 and lane 1
+	 * groups 16..31, unpack never crosses lanes.                          */
+	for(;g+32<=g1;g+=32){
+		__m256i row[8];
+
+		for(p=0;p<8;p++)
+			row[p] = _mm256_loadu_si256((const __m256i *)(in + p*round + g));
+		for(k=0;k<2;k++){
+			__m256i a0, a1, a2, a3, c[4];
+			int j;
+			if(k == 0){
+				a0 = _mm256_unpacklo_epi8(row[7], row[6]);
+				a1 = _mm256_unpacklo_epi8(row[5], row[4]);
+				a2 = _mm256_unpacklo_epi8(row[3], row[2]);
+				a3 = _mm256_unpacklo_epi8(row[1], row[0]);
+			}else{
+				a0 = _mm256_unpackhi_epi8(row[7], row[6]);
+				a1 = _mm256_unpackhi_epi8(row[5], row[4]);
+				a2 = _mm256_unpackhi_epi8(row[3], row[2]);
+				a3 = _mm256_unpackhi_epi8(row[1], row[0]);
+			}
+			__m256i b0 = _mm256_unpacklo_epi16(a0, a1);
+			__m256i b1 = _mm256_unpackhi_epi16(a0, a1);
+			__m256i b2 = _mm256_unpacklo_epi16(a2, a3);
+			__m256i b3 = _mm256_unpackhi_epi16(a2, a3);
+			c[0] = _mm256_unpacklo_epi32(b0, b2);
+			c[1] = _mm256_unpackhi_epi32(b0, b2);
+			c[2] = _mm256_unpacklo_epi32(b1, b3);
+			c[3] = _mm256_unpackhi_epi32(b1, b3);
+			for(j=0;j<4;j++){
+				/* c[j] holds groups base, base+1 | base+16, base+17    */
+				size_t base = g + 8*k + 2*j;
+				__m256i x = _mm256_shuffle_epi8(trans8x8_avx2(c[j]), rev);
+				_mm_storeu_si128((__m128i *)(out + 8*base),
+						_mm256_castsi256_si128(x));
+				_mm_storeu_si128((__m128i *)(out + 8*(base + 16)),
+						_mm256_extracti128_si256(x, 1));
+				}
+			}
+		}
+	decode_sse2(in, out, round, g, g1);
+}
+#endif
+
+static BITSHUFFLE_KERNEL pick_encoder(void)
+{
+#if HAVE_X86_SIMD
+	switch(cpu_simd_level()){
+		case SIMD_AVX2: return encode_avx2;
+		case SIMD_SSE2: return encode_sse2;
+		default: break;
+		}
+#endif
+	return encode_scalar;
+}
+
+static BITSHUFFLE_KERNEL pick_decoder(void)
+{
+#if HAVE_X86_SIMD
+	switch(cpu_simd_level()){
+		case SIMD_AVX2: return decode_avx2;
+		case SIMD_SSE2: return decode_sse2;
+		default: break;
+		}
+#endif
+	return decode_scalar;
+}
+
+const char *bitshuffle_kernel_name(void)
+{
+	return cpu_simd_name(cpu_simd_level());
+}
+
+/*------------------------------------------------------------------------
+ * bitshuffle_encode() - bytes -> bit planes
+ *------------------------------------------------------------------------*/
+int bitshuffle_encode(const uint8_t *bytes, uint8_t *bits, size_t len)
+{
+	if(!bytes || !bits || len == 0 || len%8 != 0){
+		printf("%s, invalid len %zu\n", __FUNCTION__, len);
+		return -1;
+		}
+	pick_encoder()(bytes, bits, len/8, 0, len/8);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * bitshuffle_decode() - bit planes -> bytes
+ *------------------------------------------------------------------------*/
+int bitshuffle_decode(const uint8_t *bits, uint8_t *bytes, size_t len)
+{
+	if(!bits || !bytes || len == 0 || len%8 != 0){
+		printf("%s, invalid len %zu\n", __FUNCTION__, len);
+		return -1;
+		}
+	pick_decoder()(bits, bytes, len/8, 0, len/8);
+	return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef BITSHUFFLE_H
+#define BITSHUFFLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Bit-plane transpose engine
+ *  Layout is the one produced by bytes2bits(): for a buffer of <len>
+ *  bytes (len % 8 == 0) and round = len/8,
+ *      bits[p*round + g] = bit (7-p) of bytes[8g .. 8g+7], bytes[8g] in MSB
+ *  i.e. every 8-byte group is an 8x8 bit matrix that gets transposed,
+ *  and row p of the result lands in plane p.
+ *------------------------------------------------------------------------*/
+
+/* bytes -> bit planes, returns 0 or -1 on invalid arguments             */
+int bitshuffle_encode(const uint8_t *bytes, uint8_t *bits, size_t len);
+
+/* bit planes -> bytes (exact inverse of bitshuffle_encode)              */
+int bitshuffle_decode(const uint8_t *bits, uint8_t *bytes, size_t len);
+
+/* name of the kernel picked at runtime ("scalar", "sse2", "avx2")       */
+const char *bitshuffle_kernel_name(void);
+
+#endif
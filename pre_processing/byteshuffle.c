@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "byteshuffle.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Elements per cache tile: the source tile plus one strip per plane stay
+ * well inside L1/L2 for every width we use (10 * 2048 = 20 KiB).         */
+#define SHUFFLE_TILE 2048
+
+/* Kernels work on elements [i0, i1) of an n-element buffer              */
+typedef void (*SHUFFLE_KERNEL)(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1);
+
+/*------------------------------------------------------------------------
+ * Generic scalar kernels, any element width
+ *------------------------------------------------------------------------*/
+static void encode_generic(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i, j;
+
+	for(j=0;j<es;j++){
+		uint8_t *d = dst + j*n;
+		const uint8_t *s = src + j;
+		for(i=i0;i<i1;i++)
+			d[i] = s[i*es];
+		}
+}
+
+static void decode_generic(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i, j;
+
+	for(j=0;j<es;j++){
+		const uint8_t *s = src + j*n;
+		uint8_t *d = dst + j;
+		for(i=i0;i<i1;i++)
+			d[i*es] = s[i];
+		}
+}
+
+#if HAVE_X86_SIMD
+/*------------------------------------------------------------------------
+ * SSE2 kernels
+ *------------------------------------------------------------------------*/
+TARGET_SSE2
+static void encode2_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	const __m128i lo = _mm_set1_epi16(0x00FF);
+	size_t i = i0;
+
+	for(;i+16<=i1;i+=16){
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(src + 2*i));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(src + 2*i + 16));
+		_mm_storeu_si128((__m128i *)(dst + i),
+			_mm_packus_epi16(_mm_and_si128(v0, lo), _mm_and_si128(v1, lo)));
+		_mm_storeu_si128((__m128i *)(dst + n + i),
+			_mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8)));
+		}
+	encode_generic(src, dst, es, n, i, i1);
+}
+
+TARGET_SSE2
+static void encode4_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	const __m128i lo = _mm_set1_epi32(0xFF);
+	size_t i = i0;
+	int j;
+
+	for(;i+16<=i1;i+=16){
+		__m128i v[4];
+		for(j=0;j<4;j++)
+			v[j] = _mm_loadu_si128((const __m128i *)(src + 4*i + 16*j));
+		for(j=0;j<4;j++){
+			__m128i x0 = _mm_and_si128(v[0], lo);
+			__m128i x1 = _mm_and_si128(v[1], lo);
+			__m128i x2 = _mm_and_si128(v[2], lo);
+			__m128i x3 = _mm_and_si128(v[3], lo);
+			_mm_storeu_si128((__m128i *)(dst + j*n + i),
+				_mm_packus_epi16(_mm_packs_epi32(x0, x1), _mm_packs_epi32(x2, x3)));
+			v[0] = _mm_srli_epi32(v[0], 8);
+			v[1] = _mm_srli_epi32(v[1], 8);
+			v[2] = _mm_srli_epi32(v[2], 8);
+			v[3] = _mm_srli_epi32(v[3], 8);
+			}
+		}
+	encode_generic(src, dst, es, n, i, i1);
+}
+
+/* 10-byte records: bytes 0..7 of 16 records go through a 16x8 byte
+ * transpose, bytes 8..9 are split like a WORD stream.                    */
+TARGET_SSE2
+static void encode10_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	const __m128i lo = _mm_set1_epi16(0x00FF);
+	size_t i = i0;
+	int k;
+
+	for(;i+16<=i1;i+=16){
+		const uint8_t *s = src + 10*i;
+		__m128i a[8], b[8], c[8];
+		uint16_t tail[16];
+
+		for(k=0;k<8;k++)
+			a[k] = _mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i *)(s + 10*(2*k))),
+				_mm_loadl_epi64((const __m128i *)(s + 10*(2*k+1))));
+		for(k=0;k<4;k++){
+			b[2*k]   = _mm_unpacklo_epi16(a[2*k], a[2*k+1]);
+			b[2*k+1] = _mm_unpackhi_epi16(a[2*k], a[2*k+1]);
+			}
+		/* c[4m + q] holds planes 2q, 2q+1 of records 8m..8m+7         */
+		for(k=0;k<2;k++){
+			c[4*k+0] = _mm_unpacklo_epi32(b[4*k],   b[4*k+2]);
+			c[4*k+1] = _mm_unpackhi_epi32(b[4*k],   b[4*k+2]);
+			c[4*k+2] = _mm_unpacklo_epi32(b[4*k+1], b[4*k+3]);
+			c[4*k+3] = _mm_unpackhi_epi32(b[4*k+1], b[4*k+3]);
+			}
+		for(k=0;k<4;k++){
+			_mm_storeu_si128((__m128i *)(dst + (2*k)*n + i),
+				_mm_unpacklo_epi64(c[k], c[4+k]));
+			_mm_storeu_si128((__m128i *)(dst + (2*k+1)*n + i),
+				_mm_unpackhi_epi64(c[k], c[4+k]));
+			}
+
+		for(k=0;k<16;k++)
+			memcpy(&tail[k], s + 10*k + 8, 2);
+		__m128i t0 = _mm_loadu_si128((const __m128i *)tail);
+		__m128i t1 = _mm_loadu_si128((const __m128i *)(tail + 8));
+		_mm_storeu_si128((__m128i *)(dst + 8*n + i),
+			_mm_packus_epi16(_mm_and_si128(t0, lo), _mm_and_si128(t1, lo)));
+		_mm_storeu_si128((__m128i *)(dst + 9*n + i),
+			_mm_packus_epi16(_mm_srli_epi16(t0, 8), _mm_srli_epi16(t1, 8)));
+		}
+	encode_generic(src, dst, es, n, i, i1);
+}
+
+TARGET_SSE2
+static void decode2_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i = i0;
+
+	for(;i+16<=i1;i+=16){
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(src + n + i));
+		_mm_storeu_si128((__m128i *)(dst + 2*i),      _mm_unpacklo_epi8(p0, p1));
+		_mm_storeu_si128((__m128i *)(dst + 2*i + 16), _mm_unpackhi_epi8(p0, p1));
+		}
+	decode_generic(src, dst, es, n, i, i1);
+}
+
+TARGET_SSE2
+static void decode4_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i = i0;
+
+	for(;i+16<=i1;i+=16){
+		__m128i p0 = _mm_loadu_si128((const __m128i *)(src + i));
+		__m128i p1 = _mm_loadu_si128((const __m128i *)(src + n + i));
+		__m128i p2 = _mm_loadu_si128((const __m128i *)(src + 2*n + i));
+		__m128i p3 = _mm_loadu_si128((const __m128i *)(src + 3*n + i));
+		__m128i a0 = _mm_unpacklo_epi8(p0, p1), a1 = _mm_unpackhi_epi8(p0, p1);
+		__m128i b0 = _mm_unpacklo_epi8(p2, p3), b1 = _mm_unpackhi_epi8(p2, p3);
+		uint8_t *d = dst + 4*i;
+		_mm_storeu_si128((__m128i *)(d),      _mm_unpacklo_epi16(a0, b0));
+		_mm_storeu_si128((__m128i *)(d + 16), _mm_unpackhi_epi16(a0, b0));
+		_mm_storeu_si128((__m128i *)(d + 32), _mm_unpacklo_epi16(a1, b1));
+		_mm_storeu_si128((__m128i *)(d + 48), _mm_unpackhi_epi16(a1, b1));
+		}
+	decode_generic(src, dst, es, n, i, i1);
+}
+
+TARGET_SSE2
+static void decode10_sse2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i = i0;
+	int k;
+
+	for(;i+16<=i1;i+=16){
+		__m128i p[8], a[8], b[8], c[8];
+		uint8_t *d = dst + 10*i;
+		uint16_t tail[16];
+
+		for(k=0;k<8;k++)
+			p[k] = _mm_loadu_si128((const __m128i *)(src + k*n + i));
+		for(k=0;k<4;k++){
+			a[2*k]   = _mm_unpacklo_epi8(p[2*k], p[2*k+1]);
+			a[2*k+1] = _mm_unpackhi_epi8(p[2*k], p[2*k+1]);
+			}
+		/* b[..] interleave planes 0..3 and 4..7 as 32-bit columns        */
+		for(k=0;k<2;k++){
+			b[4*k+0] = _mm_unpacklo_epi16(a[4*k],   a[4*k+2]);
+			b[4*k+1] = _mm_unpackhi_epi16(a[4*k],   a[4*k+2]);
+			b[4*k+2] = _mm_unpacklo_epi16(a[4*k+1], a[4*k+3]);
+			b[4*k+3] = _mm_unpackhi_epi16(a[4*k+1], a[4*k+3]);
+			}
+		for(k=0;k<4;k++){
+			c[2*k]   = _mm_unpacklo_epi32(b[k], b[4+k]);
+			c[2*k+1] = _mm_unpackhi_epi32(b[k], b[4+k]);
+			}
+		/* c[k] = bytes 0..7 of records 2k, 2k+1                          */
+		for(k=0;k<8;k++){
+			_mm_storel_epi64((__m128i *)(d + 10*(2*k)), c[k]);
+			_mm_storel_epi64((__m128i *)(d + 10*(2*k+1)), _mm_unpackhi_epi64(c[k], c[k]));
+			}
+
+		__m128i q0 = _mm_loadu_si128((const __m128i *)(src + 8*n + i));
+		__m128i q1 = _mm_loadu_si128((const __m128i *)(src + 9*n + i));
+		_mm_storeu_si128((__m128i *)tail,       _mm_unpacklo_epi8(q0, q1));
+		_mm_storeu_si128((__m128i *)(tail + 8), _mm_unpackhi_epi8(q0, q1));
+		for(k=0;k<16;k++)
+			memcpy(d + 10*k + 8, &tail[k], 2);
+		}
+	decode_generic(src, dst, es, n, i, i1);
+}
+
+/*------------------------------------------------------------------------
+ * AVX2 kernels for WORD / DWORD; packs work per 128-bit lane, so the
+ * result is put back in element order with a cross-lane permute.
+ *------------------------------------------------------------------------*/
+TARGET_AVX2
+static void encode2_avx2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	const __m256i lo = _mm256_set1_epi16(0x00FF);
+	size_t i = i0;
+
+	for(;i+32<=i1;i+=32){
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)(src + 2*i));
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(src + 2*i + 32));
+		__m256i b0 = _mm256_packus_epi16(_mm256_and_si256(v0, lo), _mm256_and_si256(v1, lo));
+		__m256i b1 = _mm256_packus_epi16(_mm256_srli_epi16(v0, 8), _mm256_srli_epi16(v1, 8));
+		_mm256_storeu_si256((__m256i *)(dst + i),     _mm256_permute4x64_epi64(b0, 0xD8));
+		_mm256_storeu_si256((__m256i *)(dst + n + i), _mm256_permute4x64_epi64(b1, 0xD8));
+		}
+	encode2_sse2(src, dst, es, n, i, i1);
+}
+
+/* DWORD: gather the four bytes of each plane per lane, then regroup the
+ * 64-bit plane strips of four vectors with unpack + lane permutes.       */
+TARGET_AVX2
+static void encode4_avx2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	const __m256i bytes = _mm256_setr_epi8(
+			0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
+			0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+	const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+	size_t i = i0;
+	int j;
+
+	for(;i+32<=i1;i+=32){
+		__m256i v[4];
+		for(j=0;j<4;j++){
+			v[j] = _mm256_loadu_si256((const __m256i *)(src + 4*i + 32*j));
+			v[j] = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v[j], bytes), order);
+			}
+		/* v[j] now holds planes 0..3 of records 8j..8j+7, 8 bytes each   */
+		__m256i t0 = _mm256_unpacklo_epi64(v[0], v[1]);
+		__m256i t1 = _mm256_unpackhi_epi64(v[0], v[1]);
+		__m256i t2 = _mm256_unpacklo_epi64(v[2], v[3]);
+		__m256i t3 = _mm256_unpackhi_epi64(v[2], v[3]);
+		_mm256_storeu_si256((__m256i *)(dst + i),       _mm256_permute2x128_si256(t0, t2, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + n + i),   _mm256_permute2x128_si256(t1, t3, 0x20));
+		_mm256_storeu_si256((__m256i *)(dst + 2*n + i), _mm256_permute2x128_si256(t0, t2, 0x31));
+		_mm256_storeu_si256((__m256i *)(dst + 3*n + i), _mm256_permute2x128_si256(t1, t3, 0x31));
+		}
+	encode4_sse2(src, dst, es, n, i, i1);
+}
+
+TARGET_AVX2
+static void decode2_avx2(const uint8_t *src, uint8_t *dst,
+				size_t es, size_t n, size_t i0, size_t i1)
+{
+	size_t i = i0;
+
+	for(;i+32<=i1;i+=32){
+		__m256i p0 = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(src + i)), 0xD8);
+		__m256i p1 = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i *)(src + n + i)), 0xD8);
+		_mm256_storeu_si256((__m256i *)(dst + 2*i),      _mm256_unpacklo_epi8(p0, p1));
+		_mm256_storeu_si256((__m256i *)(dst + 2*i + 32), _mm256_unpackhi_epi8(p0, p1));
+		}
+	decode2_sse2(src, dst, es, n, i, i1);
+}
+#endif
+
+/*------------------------------------------------------------------------
+ * Kernel selection by width and CPU
+ *------------------------------------------------------------------------*/
+static SHUFFLE_KERNEL pick_encoder(size_t es)
+{
+#if HAVE_X86_SIMD
+	SIMD_LEVEL l = cpu_simd_level();
+	if(l >= SIMD_SSE2){
+		switch(es){
+			case 2:  return l == SIMD_AVX2 ? encode2_avx2 : encode2_sse2;
+			case 4:  return l == SIMD_AVX2 ? encode4_avx2 : encode4_sse2;
+			case 10: return encode10_sse2;
+			default: break;
+			}
+		}
+#endif
+	return encode_generic;
+}
+
+static SHUFFLE_KERNEL pick_decoder(size_t es)
+{
+#if HAVE_X86_SIMD
+	SIMD_LEVEL l = cpu_simd_level();
+	if(l >= SIMD_SSE2){
+		switch(es){
+			case 2:  return l == SIMD_AVX2 ? decode2_avx2 : decode2_sse2;
+			case 4:  return decode4_sse2;
+			case 10: return decode10_sse2;
+			default: break;
+			}
+		}
+#endif
+	return decode_generic;
+}
+
+/*------------------------------------------------------------------------
+ * byteshuffle_encode() - records -> byte planes, one tile at a time
+ *------------------------------------------------------------------------*/
+int byteshuffle_encode(const uint8_t *src, uint8_t *dst, size_t elem_size, size_t n)
+{
+	SHUFFLE_KERNEL kernel;
+	size_t i;
+
+	if(!src || !dst || elem_size == 0){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	if(elem_size == 1){
+		memcpy(dst, src, n);
+		return 0;
+		}
+	kernel = pick_encoder(elem_size);
+	for(i=0;i<n;i+=SHUFFLE_TILE)
+		kernel(src, dst, elem_size, n, i, i+SHUFFLE_TILE < n ? i+SHUFFLE_TILE : n);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * byteshuffle_decode() - byte planes -> records, one tile at a time
+ *------------------------------------------------------------------------*/
+int byteshuffle_decode(const uint8_t *src, uint8_t *dst, size_t elem_size, size_t n)
+{
+	SHUFFLE_KERNEL kernel;
+	size_t i;
+
+	if(!src || !dst || elem_size == 0){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	if(elem_size == 1){
+		memcpy(dst, src, n);
+		return 0;
+		}
+	kernel = pick_decoder(elem_size);
+	for(i=0;i<n;i+=SHUFFLE_TILE)
+		kernel(src, dst, elem_size, n, i, i+SHUFFLE_TILE < n ? i+SHUFFLE_TILE : n);
+	return 0;
+}
@@ -0,0 +1,22 @@
+#ifndef BYTESHUFFLE_H
+#define BYTESHUFFLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Byte-plane shuffle engine (Blosc-style shuffle)
+ *  For <n> elements of <elem_size> bytes:
+ *      dst[j*n + i] = src[i*elem_size + j]
+ *  which is the B0(P1..Pn) B1(P1..Pn) ... order of
+ *  convert_according_to_byte2().  Element widths 2 (WORD), 4 (DWORD) and
+ *  10 (packed BIN_PUI) have dedicated kernels, others use the generic one.
+ *------------------------------------------------------------------------*/
+
+/* records -> byte planes, returns 0 or -1 on invalid arguments          */
+int byteshuffle_encode(const uint8_t *src, uint8_t *dst, size_t elem_size, size_t n);
+
+/* byte planes -> records (exact inverse of byteshuffle_encode)          */
+int byteshuffle_decode(const uint8_t *src, uint8_t *dst, size_t elem_size, size_t n);
+
+#endif
@@ -0,0 +1,702 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#include "chain.h"
+#include "delta.h"
+#include "byteshuffle.h"
+#include "bitshuffle.h"
+#include "planemap.h"
+#include "bitpack.h"
+#include "mydeflate.h"
+#include "szr.h"
+#include "pent.h"
+
+/* A stage output; <cap> bytes at <p> are owned by the engine             */
+typedef struct {
+	uint8_t *p;
+	size_t   len;
+	size_t   cap;
+} CHAIN_BUF;
+
+/* One direction of a stage: <len> bytes at <in> -> <out>                 */
+typedef int (*STAGE_FN)(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out);
+
+typedef struct {
+	const char *name;
+	STAGE_FN    encode;
+	STAGE_FN    decode;
+} STAGE_DESC;
+
+/*------------------------------------------------------------------------
+ * Buffers: a transform writes into <out> after reserve(), a compressor
+ * returning its own malloc()ed buffer gives it to adopt()
+ *------------------------------------------------------------------------*/
+static int reserve(CHAIN_BUF *b, size_t len)
+{
+	if(b->cap < len || !b->p){
+		free(b->p);
+		b->p = malloc(len ? len : 1);
+		b->cap = b->p ? len : 0;
+		if(!b->p){
+			printf("%s, malloc %zu failed\n", __FUNCTION__, len);
+			return -1;
+			}
+		}
+	b->len = len;
+	return 0;
+}
+
+static void adopt(CHAIN_BUF *b, uint8_t *p, size_t len)
+{
+	free(b->p);
+	b->p = p;
+	b->len = b->cap = len;
+}
+
+static int check_lanes(const char *stage, uint32_t unit, size_t len)
+{
+	if((unit != 2 && unit != 4) || len % unit){
+		printf("%s, %s needs 2 / 4-byte lanes, %zu bytes of %u\n", __FUNCTION__,
+			stage, len, unit);
+		return -1;
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * delta: arg[0] unit, arg[1] DELTA_MAP
+ *  The first lane is kept, the rest is the difference to the lane before
+ *  taken modulo the lane range, so every input is reversible: the
+ *  prefix sum wraps the same way.  Lanes without a jump beyond half the
+ *  range go through the delta.c kernels, whose saturation is then never
+ *  hit; otherwise the wrapped difference is mapped here, sign/magnitude
+ *  writing the half-range jump as "negative zero", which the kernels
+ *  never produce and the decoder below reads back as that jump.
+ *------------------------------------------------------------------------*/
+static void wrap_encode16(const uint16_t *x, uint16_t *o, size_t n, uint32_t map)
+{
+	size_t k;
+
+	for(k=1;k<n;k++){
+		int16_t d = (int16_t)(uint16_t)(x[k] - x[k-1]);
+		if(map == DELTA_ZIGZAG)
+			o[k] = (uint16_t)((uint16_t)d << 1) ^ (uint16_t)(d >> 15);
+		else
+			o[k] = d < 0 ? (uint16_t)(0x8000u | (uint16_t)-d) : (uint16_t)d;
+		}
+}
+
+static void wrap_encode32(const uint32_t *x, uint32_t *o, size_t n, uint32_t map)
+{
+	size_t k;
+
+	for(k=1;k<n;k++){
+		int32_t d = (int32_t)(x[k] - x[k-1]);
+		if(map == DELTA_ZIGZAG)
+			o[k] = ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+		else
+			o[k] = d < 0 ? 0x80000000u | (0u - (uint32_t)d) : (uint32_t)d;
+		}
+}
+
+/* sign/magnitude input holding a half-range jump                        */
+static void wrap_decode16(const uint16_t *in, uint16_t *o, size_t n)
+{
+	size_t k;
+
+	for(k=1;k<n;k++){
+		uint16_t v = in[k];
+		uint16_t d = (v & 0x8000u) ? (uint16_t)(0u - (v & 0x7FFFu)) : v;
+		if(v == 0x8000u)
+			d = 0x8000u;
+		o[k] = (uint16_t)(o[k-1] + d);
+		}
+}
+
+static void wrap_decode32(const uint32_t *in, uint32_t *o, size_t n)
+{
+	size_t k;
+
+	for(k=1;k<n;k++){
+		uint32_t v = in[k];
+		uint32_t d = (v & 0x80000000u) ? 0u - (v & 0x7FFFFFFFu) : v;
+		if(v == 0x80000000u)
+			d = 0x80000000u;
+		o[k] = o[k-1] + d;
+		}
+}
+
+static int delta_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	size_t n = len / (st->arg[0] ? st->arg[0] : 1), k;
+
+	if(check_lanes("delta", st->arg[0], len) || reserve(out, len))
+		return -1;
+	if(!n)
+		return 0;
+	if(st->arg[0] == 2){
+		const uint16_t *x = (const uint16_t *)in;
+		uint16_t *o = (uint16_t *)out->p;
+		for(k=1;k<n;k++)
+			if((int32_t)x[k] - x[k-1] > 32767 || (int32_t)x[k] - x[k-1] < -32767)
+				break;
+		o[0] = x[0];
+		if(k == n)
+			delta_encode16(x + 1, o + 1, n - 1, x[0], st->arg[1]);
+		else
+			wrap_encode16(x, o, n, st->arg[1]);
+	}else{
+		const uint32_t *x = (const uint32_t *)in;
+		uint32_t *o = (uint32_t *)out->p;
+		for(k=1;k<n;k++)
+			if((int64_t)x[k] - x[k-1] > INT32_MAX || (int64_t)x[k] - x[k-1] < -INT32_MAX)
+				break;
+		o[0] = x[0];
+		if(k == n)
+			delta_encode32(x + 1, o + 1, n - 1, x[0], st->arg[1]);
+		else
+			wrap_encode32(x, o, n, st->arg[1]);
+		}
+	return 0;
+}
+
+static int delta_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	size_t n = len / (st->arg[0] ? st->arg[0] : 1), k;
+
+	if(check_lanes("delta", st->arg[0], len) || st->arg[1] > DELTA_ZIGZAG || reserve(out, len))
+		return -1;
+	if(!n)
+		return 0;
+	if(st->arg[0] == 2){
+		const uint16_t *x = (const uint16_t *)in;
+		uint16_t *o = (uint16_t *)out->p;
+		o[0] = x[0];
+		for(k=1;st->arg[1] == DELTA_SIGNMAG && k<n && x[k] != 0x8000u;k++)
+			;
+		if(st->arg[1] == DELTA_SIGNMAG && k < n)
+			wrap_decode16(x, o, n);
+		else
+			delta_decode16(x + 1, o + 1, n - 1, o[0], st->arg[1]);
+	}else{
+		const uint32_t *x = (const uint32_t *)in;
+		uint32_t *o = (uint32_t *)out->p;
+		o[0] = x[0];
+		for(k=1;st->arg[1] == DELTA_SIGNMAG && k<n && x[k] != 0x80000000u;k++)
+			;
+		if(st->arg[1] == DELTA_SIGNMAG && k < n)
+			wrap_decode32(x, o, n);
+		else
+			delta_decode32(x + 1, o + 1, n - 1, o[0], st->arg[1]);
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * zigzag: arg[0] unit
+ *------------------------------------------------------------------------*/
+static int zigzag_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	size_t k;
+
+	if(check_lanes("zigzag", st->arg[0], len) || reserve(out, len))
+		return -1;
+	if(st->arg[0] == 2){
+		const uint16_t *x = (const uint16_t *)in;
+		uint16_t *o = (uint16_t *)out->p;
+		for(k=0;k<len/2;k++)
+			o[k] = (uint16_t)(x[k] << 1) ^ (uint16_t)((int16_t)x[k] >> 15);
+	}else{
+		const uint32_t *x = (const uint32_t *)in;
+		uint32_t *o = (uint32_t *)out->p;
+		for(k=0;k<len/4;k++)
+			o[k] = (x[k] << 1) ^ (uint32_t)((int32_t)x[k] >> 31);
+		}
+	return 0;
+}
+
+static int zigzag_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	size_t k;
+
+	if(check_lanes("zigzag", st->arg[0], len) || reserve(out, len))
+		return -1;
+	if(st->arg[0] == 2){
+		const uint16_t *z = (const uint16_t *)in;
+		uint16_t *o = (uint16_t *)out->p;
+		for(k=0;k<len/2;k++)
+			o[k] = (z[k] >> 1) ^ (uint16_t)-(z[k] & 1);
+	}else{
+		const uint32_t *z = (const uint32_t *)in;
+		uint32_t *o = (uint32_t *)out->p;
+		for(k=0;k<len/4;k++)
+			o[k] = (z[k] >> 1) ^ -(z[k] & 1);
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * byte: arg[0] element size / bit
+ *------------------------------------------------------------------------*/
+static int byte_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	if(!st->arg[0] || len % st->arg[0] || reserve(out, len))
+		return -1;
+	return byteshuffle_encode(in, out->p, st->arg[0], len / st->arg[0]);
+}
+
+static int byte_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	if(!st->arg[0] || len % st->arg[0] || reserve(out, len))
+		return -1;
+	return byteshuffle_decode(in, out->p, st->arg[0], len / st->arg[0]);
+}
+
+static int bit_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	(void)st;
+	if(reserve(out, len))
+		return -1;
+	return len ? bitshuffle_encode(in, out->p, len) : 0;
+}
+
+static int bit_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	(void)st;
+	if(reserve(out, len))
+		return -1;
+	return len ? bitshuffle_decode(in, out->p, len) : 0;
+}
+
+/*------------------------------------------------------------------------
+ * pmap: arg[0] planes / bitpack: arg[0] unit
+ *  Both say in their own header how much they decode to.
+ *------------------------------------------------------------------------*/
+static int pmap_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	uint32_t np = st->arg[0];
+
+	if(!np || np > PMAP_MAX_PLANES || len % np){
+		printf("%s, %zu bytes are not %u planes\n", __FUNCTION__, len, np);
+		return -1;
+		}
+	if(reserve(out, len + PMAP_OVERHEAD(np)))
+		return -1;
+	return planemap_encode(in, np, len / np, out->p, &out->len, NULL);
+}
+
+static int pmap_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	size_t size;
+
+	(void)st;
+	if(planemap_size(in, len, &size) || reserve(out, size))
+		return -1;
+	return planemap_decode(in, len, out->p, out->cap, &out->len);
+}
+
+static int bitpack_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	if(check_lanes("bitpack", st->arg[0], len)
+		|| reserve(out, bitpack_bound(len / st->arg[0], st->arg[0])))
+		return -1;
+	return bitpack_encode(in, len / st->arg[0], st->arg[0], out->p, &out->len);
+}
+
+static int bitpack_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	BITPACK_HEADER hdr;
+	size_t n;
+
+	(void)st;
+	if(len < sizeof(hdr))
+		return -1;
+	memcpy(&hdr, in, sizeof(hdr));
+	if(reserve(out, (size_t)hdr.count * hdr.unit_size)
+		|| bitpack_decode(in, len, out->p, out->cap, &n))
+		return -1;
+	out->len = n * hdr.unit_size;
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * szr / deflate: arg[0] windowBits, arg[1] memLevel / entropy: arg[0]
+ * plane length, arg[1] planes it was derived from
+ *  The libraries return a buffer of their own, which becomes <out>.
+ *------------------------------------------------------------------------*/
+static int szr_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	uint8_t *p;
+	size_t n;
+
+	(void)st;
+	if(szr_shrink(in, len, &p, &n) != 0)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static int szr_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	uint8_t *p;
+	size_t n;
+
+	(void)st;
+	if(szr_expand(in, len, &p, &n) != 0)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static int deflate_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	unsigned char *p;
+	size_t n;
+
+	if(mydeflate_compress(in, len, &p, &n, st->arg[0], st->arg[1]) != Z_OK)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static int deflate_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	unsigned char *p;
+	size_t n;
+
+	if(st->arg[0] < 8 || st->arg[0] > 15 || mydeflate_decompress(in, len, &p, &n, st->arg[0]) != Z_OK)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static int entropy_enc(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	uint8_t *p;
+	size_t n;
+
+	if(pent_encode(in, len, st->arg[0], &p, &n) != 0)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static int entropy_dec(const CHAIN_ENTRY *st, const uint8_t *in, size_t len, CHAIN_BUF *out)
+{
+	uint8_t *p;
+	size_t n;
+
+	(void)st;
+	if(pent_decode(in, len, &p, &n) != 0)
+		return -1;
+	adopt(out, p, n);
+	return 0;
+}
+
+static const STAGE_DESC stage_desc[CHAIN_STAGE_MAX] = {
+	[CHAIN_DELTA]	= {"delta", delta_enc, delta_dec},
+	[CHAIN_ZIGZAG]	= {"zigzag", zigzag_enc, zigzag_dec},
+	[CHAIN_BYTE]	= {"byte", byte_enc, byte_dec},
+	[CHAIN_BIT]	= {"bit", bit_enc, bit_dec},
+	[CHAIN_PMAP]	= {"pmap", pmap_enc, pmap_dec},
+	[CHAIN_BITPACK]	= {"bitpack", bitpack_enc, bitpack_dec},
+	[CHAIN_SZR]	= {"szr", szr_enc, szr_dec},
+	[CHAIN_DEFLATE]	= {"deflate", deflate_enc, deflate_dec},
+	[CHAIN_ENTROPY]	= {"entropy", entropy_enc, entropy_dec},
+};
+
+const char *chain_stage_name(CHAIN_STAGE_ID id)
+{
+	return (unsigned)id < CHAIN_STAGE_MAX && stage_desc[id].name ? stage_desc[id].name : "unknown";
+}
+
+/*------------------------------------------------------------------------
+ * chain_parse() - comma separated "name[:arg[:arg]]"
+ *  Spec arguments land in the entry as documented per stage above; the
+ *  ones taken from the channel or the stages before stay 0 until
+ *  chain_encode().
+ *------------------------------------------------------------------------*/
+int chain_parse(const char *spec, CODEC_CHAIN *chain)
+{
+	char *copy, *save = NULL, *tok;
+	int ret = -1;
+
+	if(!spec || !chain)
+		return -1;
+	memset(chain, 0, sizeof(*chain));
+	copy = strdup(spec);
+	if(!copy)
+		return -1;
+	for(tok=strtok_r(copy, ",", &save);tok;tok=strtok_r(NULL, ",", &save)){
+		char *arg[CHAIN_MAX_ARGS + 1] = {NULL}, *colon;
+		CHAIN_ENTRY *st;
+		int id, nargs = 0;
+
+		while(nargs <= CHAIN_MAX_ARGS && (colon = strchr(tok, ':')) != NULL){
+			*colon = 0;
+			arg[nargs++] = colon + 1;
+			}
+		for(id=1;id<CHAIN_STAGE_MAX && strcmp(tok, stage_desc[id].name);id++)
+			;
+		if(id == CHAIN_STAGE_MAX || chain->nstages == CHAIN_MAX_STAGES){
+			printf("%s, unknown stage %s or more than %d stages\n", __FUNCTION__, tok,
+				CHAIN_MAX_STAGES);
+			goto done;
+			}
+		st = &chain->stage[chain->nstages++];
+		st->id = id;
+		switch(id){
+			case CHAIN_DELTA:
+				st->arg[1] = DELTA_ZIGZAG;
+				if(nargs > 1 || (arg[0] && strcmp(arg[0], "zigzag") && strcmp(arg[0], "signmag")))
+					goto bad;
+				if(arg[0] && !strcmp(arg[0], "signmag"))
+					st->arg[1] = DELTA_SIGNMAG;
+				break;
+			case CHAIN_BYTE:
+			case CHAIN_PMAP:
+			case CHAIN_ENTROPY:
+				if(nargs > 1)
+					goto bad;
+				if(arg[0])
+					st->arg[0] = strtoul(arg[0], NULL, 0);
+				break;
+			case CHAIN_DEFLATE:
+				st->arg[0] = arg[0] ? strtoul(arg[0], NULL, 0) : 15;
+				st->arg[1] = nargs > 1 ? strtoul(arg[1], NULL, 0) : 8;
+				if(nargs > 2 || st->arg[0] < 8 || st->arg[0] > 15 || st->arg[1] < 1 || st->arg[1] > 9)
+					goto bad;
+				break;
+			default:
+				if(nargs)
+					goto bad;
+				break;
+			}
+		continue;
+bad:
+		printf("%s, bad arguments for %s\n", __FUNCTION__, tok);
+		goto done;
+		}
+	ret = chain->nstages ? 0 : -1;
+done:
+	free(copy);
+	return ret;
+}
+
+/* Fill the arguments left to the channel: the unit, and the planes the
+ * byte / bit stages leave for pmap and entropy                          */
+static void resolve(CODEC_CHAIN *c, int unit_size)
+{
+	uint32_t planes = 0;
+	int k;
+
+	for(k=0;k<c->nstages;k++){
+		CHAIN_ENTRY *st = &c->stage[k];
+		switch(st->id){
+			case CHAIN_DELTA:
+			case CHAIN_ZIGZAG:
+			case CHAIN_BITPACK:
+				st->arg[0] = unit_size;
+				break;
+			case CHAIN_BYTE:
+				if(!st->arg[0])
+					st->arg[0] = unit_size;
+				planes = st->arg[0];
+				continue;
+			case CHAIN_BIT:
+				planes = planes ? planes * 8 : 8;
+				continue;
+			case CHAIN_PMAP:
+				if(!st->arg[0])
+					st->arg[0] = planes ? planes : (uint32_t)unit_size;
+				break;
+			case CHAIN_ENTROPY:
+				st->arg[1] = st->arg[0] ? 0 : planes;
+				break;
+			default:
+				break;
+			}
+		planes = 0;
+		}
+}
+
+int chain_fits(const CODEC_CHAIN *chain, int unit_size, size_t len)
+{
+	CODEC_CHAIN c = *chain;
+	int k;
+
+	resolve(&c, unit_size);
+	for(k=0;k<c.nstages;k++){
+		const CHAIN_ENTRY *st = &c.stage[k];
+		switch(st->id){
+			case CHAIN_DELTA:
+			case CHAIN_ZIGZAG:
+				if((st->arg[0] != 2 && st->arg[0] != 4) || len % st->arg[0])
+					return 0;
+				break;
+			case CHAIN_BYTE:
+				if(!st->arg[0] || len % st->arg[0])
+					return 0;
+				break;
+			case CHAIN_BIT:
+				if(len % 8)
+					return 0;
+				break;
+			case CHAIN_BITPACK:
+				return (st->arg[0] == 2 || st->arg[0] == 4) && len % st->arg[0] == 0;
+			case CHAIN_PMAP:
+				/* resolve() gave it the planes of byte / bit before it */
+				return st->arg[0] && st->arg[0] <= PMAP_MAX_PLANES && len % st->arg[0] == 0;
+			default:
+				return 1;
+			}
+		}
+	return 1;
+}
+
+int chain_encode(const CODEC_CHAIN *chain, int unit_size, const uint8_t *in, size_t len,
+		size_t head_len, uint8_t **out, size_t *out_len)
+{
+	CODEC_CHAIN c;
+	CHAIN_HEADER hdr;
+	CHAIN_BUF buf[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+	const uint8_t *cur;
+	size_t cur_len, el;
+	uint8_t *p;
+	int k, w = 0, ret = -1;
+
+	if(!chain || !chain->nstages || chain->nstages > CHAIN_MAX_STAGES || (!in && len)
+		|| head_len > len || head_len > UINT32_MAX || !out || !out_len)
+		return -1;
+	c = *chain;
+	resolve(&c, unit_size);
+	cur = in + head_len;
+	cur_len = len - head_len;
+	for(k=0;k<c.nstages;k++){
+		CHAIN_ENTRY *st = &c.stage[k];
+		if(st->id == CHAIN_ENTROPY && st->arg[1])
+			st->arg[0] = cur_len / st->arg[1];
+		if(stage_desc[st->id].encode(st, cur, cur_len, &buf[w]) != 0){
+			printf("%s, stage %d (%s) failed\n", __FUNCTION__, k, chain_stage_name(st->id));
+			goto done;
+			}
+		cur = buf[w].p;
+		cur_len = buf[w].len;
+		w ^= 1;
+		}
+
+	memcpy(hdr.magic, CHAIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = CHAIN_VERSION;
+	hdr.nstages = c.nstages;
+	hdr.head_len = head_len;
+	hdr.size = len;
+	el = c.nstages * sizeof(CHAIN_ENTRY);
+	p = malloc(sizeof(hdr) + el + head_len + cur_len);
+	if(!p){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		goto done;
+		}
+	memcpy(p, &hdr, sizeof(hdr));
+	memcpy(p + sizeof(hdr), c.stage, el);
+	memcpy(p + sizeof(hdr) + el, in, head_len);
+	memcpy(p + sizeof(hdr) + el + head_len, cur, cur_len);
+	*out = p;
+	*out_len = sizeof(hdr) + el + head_len + cur_len;
+	ret = 0;
+done:
+	free(buf[0].p);
+	free(buf[1].p);
+	return ret;
+}
+
+int chain_decode(const uint8_t *in, size_t len, uint8_t **out, size_t *out_len)
+{
+	CHAIN_HEADER hdr;
+	CHAIN_ENTRY st[CHAIN_MAX_STAGES];
+	CHAIN_BUF buf[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+	const uint8_t *cur;
+	size_t cur_len, el;
+	uint8_t *p;
+	int k, w = 0, ret = -1;
+
+	if(!in || !out || !out_len || len < sizeof(hdr))
+		return -1;
+	memcpy(&hdr, in, sizeof(hdr));
+	el = hdr.nstages * sizeof(CHAIN_ENTRY);
+	if(memcmp(hdr.magic, CHAIN_MAGIC, sizeof(hdr.magic)) || hdr.version != CHAIN_VERSION
+		|| !hdr.nstages || hdr.nstages > CHAIN_MAX_STAGES
+		|| len - sizeof(hdr) < el || len - sizeof(hdr) - el < hdr.head_len
+		|| hdr.size < hdr.head_len){
+		printf("%s, not a codec chain\n", __FUNCTION__);
+		return -1;
+		}
+	memcpy(st, in + sizeof(hdr), el);
+	cur = in + sizeof(hdr) + el + hdr.head_len;
+	cur_len = len - sizeof(hdr) - el - hdr.head_len;
+	for(k=hdr.nstages-1;k>=0;k--){
+		if(!st[k].id || st[k].id >= CHAIN_STAGE_MAX
+			|| stage_desc[st[k].id].decode(&st[k], cur, cur_len, &buf[w]) != 0){
+			printf("%s, stage %d (%s) failed\n", __FUNCTION__, k, chain_stage_name(st[k].id));
+			goto done;
+			}
+		cur = buf[w].p;
+		cur_len = buf[w].len;
+		w ^= 1;
+		}
+	if(cur_len != hdr.size - hdr.head_len){
+		printf("%s, decoded %zu bytes, header says %llu\n", __FUNCTION__,
+			cur_len + hdr.head_len, (unsigned long long)hdr.size);
+		goto done;
+		}
+	p = malloc(hdr.size ? hdr.size : 1);
+	if(!p)
+		goto done;
+	memcpy(p, in + sizeof(hdr) + el, hdr.head_len);
+	memcpy(p + hdr.head_len, cur, cur_len);
+	*out = p;
+	*out_len = hdr.size;
+	ret = 0;
+done:
+	free(buf[0].p);
+	free(buf[1].p);
+	return ret;
+}
+
+int chain_decode_file(const char *in, const char *out)
+{
+	FILE *fp;
+	uint8_t *src = NULL, *dst = NULL;
+	size_t len = 0, dst_len = 0;
+	long size;
+	int ret = -1;
+
+	fp = fopen(in, "rb");
+	if(!fp){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, in);
+		return -1;
+		}
+	if(fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0){
+		len = size;
+		src = malloc(len ? len : 1);
+		if(src && fread(src, 1, len, fp) == len)
+			ret = 0;
+		}
+	fclose(fp);
+	if(ret == 0)
+		ret = chain_decode(src, len, &dst, &dst_len);
+	free(src);
+	if(ret == 0){
+		fp = fopen(out, "wb");
+		if(!fp || (dst_len && fwrite(dst, 1, dst_len, fp) != dst_len)){
+			printf("%s, write %s failed\n", __FUNCTION__, out);
+			ret = -1;
+			}
+		if(fp && fclose(fp) != 0)
+			ret = -1;
+		}
+	free(dst);
+	return ret;
+}
@@ -0,0 +1,103 @@
+#ifndef CHAIN_H
+#define CHAIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Codec chain engine
+ *  A chain is a list of stages run in one process, each stage reading
+ *  the previous one's buffer; the transforms write into the engine's
+ *  other buffer and the compressors hand over the buffer they return,
+ *  so no stage output is copied.  The result describes itself:
+ *      CHAIN_HEADER
+ *      <nstages> CHAIN_ENTRY, in encode order, arguments resolved
+ *      <head_len> bytes kept as is (e.g. a PRED_HEADER)
+ *      the body, the output of the last stage
+ *  and chain_decode() inverts it without knowing the chain up front.
+ *
+ *  Stages, with what a chain spec may give after "name:" and what is
+ *  taken otherwise:
+ *      delta     signmag | zigzag (zigzag)     first value kept as is,
+ *                                              modulo the lane range
+ *      zigzag                                  lanes taken as signed
+ *      byte      element size (the unit)       byte planes
+ *      bit                                     bit planes, len % 8 == 0
+ *      pmap      planes (the byte / bit planes plane elision map
+ *                of the stages before)
+ *      bitpack                                 frame of reference
+ *      szr                                     zero-run suppression
+ *      deflate   windowBits:memLevel (15:8)    libmydeflate
+ *      entropy   plane length (as pmap, else   libpent
+ *                64 KiB blocks)
+ *  delta, zigzag and bitpack work on lanes of the channel's unit size.
+ *------------------------------------------------------------------------*/
+typedef enum {
+	CHAIN_DELTA = 1,
+	CHAIN_ZIGZAG,
+	CHAIN_BYTE,
+	CHAIN_BIT,
+	CHAIN_PMAP,
+	CHAIN_BITPACK,
+	CHAIN_SZR,
+	CHAIN_DEFLATE,
+	CHAIN_ENTROPY,
+	CHAIN_STAGE_MAX
+} CHAIN_STAGE_ID;
+
+#define CHAIN_MAGIC		"CC"
+#define CHAIN_VERSION		1
+#define CHAIN_MAX_STAGES	8
+#define CHAIN_MAX_ARGS		2
+
+#pragma pack(push,1)
+typedef struct {
+	char     magic[2];
+	uint8_t  version;
+	uint8_t  nstages;
+	uint32_t head_len;	/* bytes in front of the body, kept as is     */
+	uint64_t size;		/* decoded bytes, head included              */
+} CHAIN_HEADER;
+
+typedef struct {
+	uint8_t  id;		/* CHAIN_STAGE_ID                            */
+	uint8_t  reserved[3];	/* 0                                         */
+	uint32_t arg[CHAIN_MAX_ARGS];
+} CHAIN_ENTRY;
+#pragma pack(pop)
+
+typedef struct {
+	int         nstages;
+	CHAIN_ENTRY stage[CHAIN_MAX_STAGES];
+} CODEC_CHAIN;
+
+/* "delta:zigzag,byte,bit,szr,deflate:15:8" -> <chain>.  Returns 0, or
+ * -1 on an unknown stage, a bad argument or too many stages.            */
+int chain_parse(const char *spec, CODEC_CHAIN *chain);
+
+/* "delta", "byte", ... ; "unknown" out of range                         */
+const char *chain_stage_name(CHAIN_STAGE_ID id);
+
+/* 1 when the stages up to the first one changing the length can take
+ * <len> bytes of a <unit_size> channel (whole 2 / 4-byte lanes for
+ * delta, zigzag and bitpack, whole elements for byte, len % 8 for bit,
+ * whole planes for pmap)                                                */
+int chain_fits(const CODEC_CHAIN *chain, int unit_size, size_t len);
+
+/*------------------------------------------------------------------------
+ * chain_encode()
+ *  Run <chain> on <len> bytes of <in>, of which the first <head_len> are
+ *  copied as is; <unit_size> fills the unit arguments left at 0.
+ *  *out is malloc()ed, owned by the caller.  Returns 0, or -1.
+ *------------------------------------------------------------------------*/
+int chain_encode(const CODEC_CHAIN *chain, int unit_size, const uint8_t *in, size_t len,
+		size_t head_len, uint8_t **out, size_t *out_len);
+
+/* Any chain_encode() output back; *out is malloc()ed.  Returns 0, or -1
+ * on a malformed stream or a stage failing.                             */
+int chain_decode(const uint8_t *in, size_t len, uint8_t **out, size_t *out_len);
+
+/* chain_decode() of file <in> into file <out>.  Returns 0, or -1.       */
+int chain_decode_file(const char *in, const char *out);
+
+#endif
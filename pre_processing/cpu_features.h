@@ -0,0 +1,61 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------------------------------
+ * Runtime SIMD detection shared by the transform kernels.
+ *  Kernels are compiled with per-function target attributes, so the
+ *  binary still runs on CPUs without SSE2/AVX2 (or on non-x86 targets,
+ *  where only the scalar kernels are built).
+ *------------------------------------------------------------------------*/
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_SIMD 1
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define HAVE_X86_SIMD 0
+#endif
+
+typedef enum {
+	SIMD_SCALAR = 0,
+	SIMD_SSE2,
+	SIMD_AVX2
+} SIMD_LEVEL;
+
+/* PRE_SIMD=scalar|sse2|avx2 caps the level, handy for benchmarking.
+ * Segment workers ask concurrently: threads racing on the first call all
+ * work out the same level, the atomics keep the cache itself race free. */
+static inline SIMD_LEVEL cpu_simd_level(void)
+{
+	static int level = -1;
+	int cached = __atomic_load_n(&level, __ATOMIC_RELAXED);
+	if(cached < 0){
+		int l = SIMD_SCALAR;
+#if HAVE_X86_SIMD
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("sse2"))
+			l = SIMD_SSE2;
+		if(__builtin_cpu_supports("avx2"))
+			l = SIMD_AVX2;
+#endif
+		const char *cap = getenv("PRE_SIMD");
+		if(cap){
+			if(!strcmp(cap, "scalar"))
+				l = SIMD_SCALAR;
+			else if(!strcmp(cap, "sse2") && l > SIMD_SSE2)
+				l = SIMD_SSE2;
+			}
+		__atomic_store_n(&level, l, __ATOMIC_RELAXED);
+		cached = l;
+		}
+	return (SIMD_LEVEL)cached;
+}
+
+static inline const char *cpu_simd_name(SIMD_LEVEL l)
+{
+	return l == SIMD_AVX2 ? "avx2" : l == SIMD_SSE2 ? "sse2" : "scalar";
+}
+
+#endif
@@ -0,0 +1,571 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "csv_ingest.h"
+
+/* CSV bytes per slice; workers take slices in file order, so parsing
+ * stops a slice or so per worker after the first <max_lines> records   */
+#define INGEST_SLICE_BYTES	(1u << 20)
+
+/* A line-aligned slice of the mapping and the records parsed from it,
+ * in file order.                                                         */
+typedef struct
+{
+	const char *begin;
+	const char *end;
+
+	BIN_PUI    *recs;
+	uint64_t    count;
+	uint64_t    capacity;
+	uint64_t    invalid;
+
+	/* sample records (index < PRINT_SAMPLE_LINES) for the demo output   */
+	int         samples;
+	int         sample_index[PRINT_SAMPLE_LINES];
+	BIN_PUI     sample[PRINT_SAMPLE_LINES];
+
+	/* second phase: scatter into the final buffers from <first>          */
+	uint64_t    first;
+	uint64_t    take;
+	int         ret;
+} INGEST_SLICE;
+
+/* State shared by the workers of one phase                               */
+typedef struct
+{
+	INGEST_SLICE *slice;
+	int         nslices;
+	int         next;		/* next slice to hand out (atomic)       */
+	uint64_t    parsed;		/* records of finished slices (atomic)   */
+	uint64_t    max_lines;
+	PUI_COLUMNS *cols;
+} INGEST_JOB;
+
+int online_cpus(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+}
+
+static inline int is_blank(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+/*------------------------------------------------------------------------
+ * parse_int() - "%d": optional blanks and sign, at least one digit
+ *------------------------------------------------------------------------*/
+static const char *parse_int(const char *s, const char *end, int *value)
+{
+	int neg = 0;
+	long v = 0;
+
+	while(s < end && is_blank(*s))
+		s++;
+	if(s < end && (*s == '-' || *s == '+'))
+		neg = (*s++ == '-');
+	if(s >= end || *s < '0' || *s > '9')
+		return NULL;
+	while(s < end && *s >= '0' && *s <= '9')
+		v = v*10 + (*s++ - '0');
+	*value = (int)(neg ? -v : v);
+	return s;
+}
+
+/*------------------------------------------------------------------------
+ * parse_fixed() - "%lf" scaled by 10^<decimals> and truncated toward
+ *  zero, computed from the digits so no double is involved.  Exponents,
+ *  inf/nan and hex floats fall back to strtod() + double2long() rules.
+ *------------------------------------------------------------------------*/
+static const char *parse_fixed(const char *s, const char *end, int decimals, long *value)
+{
+	static const long scale[] = {1, 10, 100, 1000, 10000};
+	const char *start;
+	int neg = 0, digits = 0, frac = 0;
+	long ip = 0, fp = 0;
+
+	while(s < end && is_blank(*s))
+		s++;
+	start = s;
+	if(s < end && (*s == '-' || *s == '+'))
+		neg = (*s++ == '-');
+	while(s < end && *s >= '0' && *s <= '9'){
+		ip = ip*10 + (*s++ - '0');
+		digits++;
+		}
+	if(s < end && *s == '.'){
+		s++;
+		while(s < end && *s >= '0' && *s <= '9'){
+			if(frac < decimals){
+				fp = fp*10 + (*s - '0');
+				frac++;
+				}
+			s++;
+			digits++;
+			}
+		}
+	if(digits == 0 || (s < end && (*s == 'e' || *s == 'E' || *s == 'x' || *s == 'X'))){
+		char buf[128];
+		char *stop;
+		size_t len = (size_t)(end - start) < sizeof(buf)-1 ? (size_t)(end - start) : sizeof(buf)-1;
+		memcpy(buf, start, len);
+		buf[len] = 0;
+		double d = strtod(buf, &stop);
+		if(stop == buf)
+			return NULL;
+		*value = (long)(d * scale[decimals]);
+		return start + (stop - buf);
+		}
+	for(;frac<decimals;frac++)
+		fp *= 10;
+	*value = ip*scale[decimals] + fp;
+	if(neg)
+		*value = -*value;
+	return s;
+}
+
+/*------------------------------------------------------------------------
+ * parse_line() - same acceptance as sscanf("%d,%lf,%lf,%lf") == 4
+ *------------------------------------------------------------------------*/
+static int parse_line(const char *s, const char *end, int *index, BIN_PUI *pui)
+{
+	long p, u, i;
+
+	if(!(s = parse_int(s, end, index)) || s >= end || *s++ != ',')
+		return -1;
+	if(!(s = parse_fixed(s, end, 1, &p)) || s >= end || *s++ != ',')
+		return -1;
+	if(!(s = parse_fixed(s, end, 1, &u)) || s >= end || *s++ != ',')
+		return -1;
+	if(!parse_fixed(s, end, 3, &i))
+		return -1;
+	pui->p = (DWORD)p;
+	pui->u = (WORD)u;
+	pui->i = (DWORD)i;
+	return 0;
+}
+
+static int parse_slice(INGEST_SLICE *w, uint64_t max_lines)
+{
+	const char *s = w->begin;
+
+	w->capacity = (w->end - w->begin) / 32 + 16;
+	w->recs = malloc(w->capacity * sizeof(BIN_PUI));
+	if(!w->recs)
+		return -1;
+	while(s < w->end && w->count < max_lines){
+		const char *eol = memchr(s, '\n', w->end - s);
+		if(!eol)
+			eol = w->end;
+		int index;
+		BIN_PUI pui;
+		if(parse_line(s, eol, &index, &pui) == 0){
+			if(w->count == w->capacity){
+				BIN_PUI *grown = realloc(w->recs, 2 * w->capacity * sizeof(BIN_PUI));
+				if(!grown)
+					return -1;
+				w->recs = grown;
+				w->capacity *= 2;
+				}
+			w->recs[w->count++] = pui;
+			if(index >= 0 && index < PRINT_SAMPLE_LINES && w->samples < PRINT_SAMPLE_LINES){
+				w->sample_index[w->samples] = index;
+				w->sample[w->samples++] = pui;
+				}
+		}else if(eol > s){
+			w->invalid++;
+			if(w->invalid <= PRINT_SAMPLE_LINES)
+				printf("Invalid line format: %.*s\n", (int)(eol - s), s);
+			}
+		s = eol + 1;
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * ingest_parse_worker()
+ *  Slices are taken in file order.  Once the finished ones hold
+ *  <max_lines> records every slice not yet taken lies behind them, so
+ *  the workers stop: one budget for all of them.
+ *------------------------------------------------------------------------*/
+static void *ingest_parse_worker(void *arg)
+{
+	INGEST_JOB *job = arg;
+	int s;
+
+	while(__atomic_load_n(&job->parsed, __ATOMIC_RELAXED) < job->max_lines){
+		s = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if(s >= job->nslices)
+			break;
+		job->slice[s].ret = parse_slice(&job->slice[s], job->max_lines);
+		__atomic_add_fetch(&job->parsed, job->slice[s].count, __ATOMIC_RELAXED);
+		}
+	return NULL;
+}
+
+static void *ingest_scatter_worker(void *arg)
+{
+	INGEST_JOB *job = arg;
+	PUI_COLUMNS *c = job->cols;
+	uint64_t k;
+	int s;
+
+	while((s = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nslices){
+		INGEST_SLICE *w = &job->slice[s];
+		if(!w->take)
+			continue;
+		memcpy(&c->puis[w->first], w->recs, w->take * sizeof(BIN_PUI));
+		for(k=0;k<w->take;k++){
+			c->p[w->first + k] = w->recs[k].p;
+			c->u[w->first + k] = w->recs[k].u;
+			c->i[w->first + k] = w->recs[k].i;
+			}
+		}
+	return NULL;
+}
+
+/* <fn> on <threads> threads over <job>, inline when none can be started */
+static void run_pool(INGEST_JOB *job, int threads, void *(*fn)(void *))
+{
+	pthread_t *tid = calloc(threads, sizeof(*tid));
+	int t, started = 0;
+
+	job->next = 0;
+	for(t=0;tid && t<threads;t++)
+		if(pthread_create(&tid[started], NULL, fn, job) == 0)
+			started++;
+	if(started == 0)
+		fn(job);
+	for(t=0;t<started;t++)
+		pthread_join(tid[t], NULL);
+	free(tid);
+}
+
+double now_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*------------------------------------------------------------------------
+ * ingest_region()
+ *  Cut [begin, end) into slices that start right after '\n', parse them
+ *  on <threads> workers and place the first <max_lines> records: the
+ *  slices' <first> / <take>, job->parsed their total afterwards.
+ *------------------------------------------------------------------------*/
+static int ingest_region(INGEST_JOB *job, const char *begin, const char *end,
+			uint64_t max_lines, int threads, uint64_t *invalid)
+{
+	const char *pos = begin;
+	uint64_t total = 0;
+	int s;
+
+	memset(job, 0, sizeof(*job));
+	job->max_lines = max_lines;
+	job->slice = calloc((end - begin) / INGEST_SLICE_BYTES + 1, sizeof(*job->slice));
+	if(!job->slice){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		return -1;
+		}
+	while(pos < end){
+		const char *cut = (size_t)(end - pos) > INGEST_SLICE_BYTES ? pos + INGEST_SLICE_BYTES : end;
+		if(cut < end){
+			const char *nl = memchr(cut, '\n', end - cut);
+			cut = nl ? nl + 1 : end;
+			}
+		job->slice[job->nslices].begin = pos;
+		job->slice[job->nslices++].end = cut;
+		pos = cut;
+		}
+	if(threads > job->nslices)
+		threads = job->nslices ? job->nslices : 1;
+	run_pool(job, threads, ingest_parse_worker);
+
+	for(s=0;s<job->nslices && total<max_lines;s++){
+		INGEST_SLICE *w = &job->slice[s];
+		if(w->ret){
+			printf("%s, slice %d failed\n", __FUNCTION__, s);
+			return -1;
+			}
+		w->first = total;
+		w->take = w->count;
+		if(total + w->take > max_lines)
+			w->take = max_lines - total;
+		total += w->take;
+		*invalid += w->invalid;
+		}
+	job->parsed = total;
+	return 0;
+}
+
+/* sample records of the slices in use, then release them                */
+static void ingest_release(INGEST_JOB *job, int samples)
+{
+	int s, k;
+
+	for(s=0;job->slice && s<job->nslices;s++){
+		INGEST_SLICE *w = &job->slice[s];
+		for(k=0;samples && w->take && k<w->samples;k++)
+			printf("index %d, p %u, u %u, i %u\n", w->sample_index[k],
+				w->sample[k].p, w->sample[k].u, w->sample[k].i);
+		free(w->recs);
+		}
+	free(job->slice);
+	job->slice = NULL;
+}
+
+static int alloc_columns(PUI_COLUMNS *cols, uint64_t lines)
+{
+	cols->lines = lines;
+	cols->puis = malloc(lines * sizeof(BIN_PUI) + 1);
+	cols->p = malloc(lines * sizeof(DWORD) + 1);
+	cols->u = malloc(lines * sizeof(WORD) + 1);
+	cols->i = malloc(lines * sizeof(DWORD) + 1);
+	if(!cols->puis || !cols->p || !cols->u || !cols->i){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		csv_ingest_free(cols);
+		return -1;
+		}
+	return 0;
+}
+
+/* open and map <csvfile>; an empty file maps to NULL with <size> 0      */
+static int map_csv(const char *csvfile, char **map, size_t *size)
+{
+	struct stat st;
+	int fd;
+
+	*map = NULL;
+	*size = 0;
+	fd = open(csvfile, O_RDONLY);
+	if(fd < 0){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, csvfile);
+		return -1;
+		}
+	if(fstat(fd, &st) != 0){
+		printf("%s, unreadable %s\n", __FUNCTION__, csvfile);
+		close(fd);
+		return -1;
+		}
+	if(st.st_size == 0){
+		/* no records, like an empty capture read line by line          */
+		close(fd);
+		return 0;
+		}
+	*map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(*map == MAP_FAILED){
+		*map = NULL;
+		printf("%s, mmap %s failed\n", __FUNCTION__, csvfile);
+		return -1;
+		}
+	*size = st.st_size;
+	madvise(*map, *size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * csv_ingest()
+ *------------------------------------------------------------------------*/
+int csv_ingest(const char *csvfile, uint64_t max_lines, int threads, PUI_COLUMNS *cols)
+{
+	int ret = -1;
+	size_t size;
+	char *map;
+	INGEST_JOB job;
+	uint64_t invalid = 0;
+	double t0 = now_seconds();
+
+	if(!csvfile || !cols){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	memset(cols, 0, sizeof(*cols));
+	memset(&job, 0, sizeof(job));
+	if(threads <= 0)
+		threads = online_cpus();
+
+	if(map_csv(csvfile, &map, &size) != 0)
+		return -1;
+	if(!map){
+		printf("%s, %s: 0 lines\n", __FUNCTION__, csvfile);
+		return alloc_columns(cols, 0);
+		}
+	if(ingest_region(&job, map, map + size, max_lines, threads, &invalid) != 0
+		|| alloc_columns(cols, job.parsed) != 0)
+		goto err;
+	job.cols = cols;
+	run_pool(&job, threads < job.nslices ? threads : job.nslices, ingest_scatter_worker);
+
+	double elapsed = now_seconds() - t0;
+	ingest_release(&job, 1);
+	printf("%s, %s: %llu lines (%llu invalid), %d threads, %.3f s, %.0f lines/s\n",
+		__FUNCTION__, csvfile, (unsigned long long)cols->lines, (unsigned long long)invalid,
+		threads, elapsed, elapsed > 0 ? cols->lines / elapsed : 0.0);
+	ret = 0;
+err:
+	ingest_release(&job, 0);
+	munmap(map, size);
+	return ret;
+}
+
+/* records of the placed slices to the struct file and, through a block
+ * of columns, to the three channel files                                */
+#define STREAM_BLOCK	4096
+
+static int stream_slices(const INGEST_JOB *job, FILE *fpw[4])
+{
+	static DWORD p[STREAM_BLOCK], i[STREAM_BLOCK];
+	static WORD u[STREAM_BLOCK];
+	uint64_t k, n, b;
+	int s;
+
+	for(s=0;s<job->nslices;s++){
+		const INGEST_SLICE *w = &job->slice[s];
+		if(w->take && fwrite(w->recs, sizeof(BIN_PUI), w->take, fpw[0]) != w->take)
+			return -1;
+		for(k=0;k<w->take;k+=n){
+			n = w->take - k < STREAM_BLOCK ? w->take - k : STREAM_BLOCK;
+			for(b=0;b<n;b++){
+				p[b] = w->recs[k + b].p;
+				u[b] = w->recs[k + b].u;
+				i[b] = w->recs[k + b].i;
+				}
+			if(fwrite(p, sizeof(DWORD), n, fpw[1]) != n
+				|| fwrite(u, sizeof(WORD), n, fpw[2]) != n
+				|| fwrite(i, sizeof(DWORD), n, fpw[3]) != n)
+				return -1;
+			}
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * csv_ingest_stream()
+ *------------------------------------------------------------------------*/
+int csv_ingest_stream(const char *csvfile, uint64_t max_lines, int threads, uint64_t mem_limit,
+			const char *binfile, const char *pfile, const char *ufile, const char *ifile)
+{
+	const char *file[4] = {binfile, pfile, ufile, ifile};
+	FILE *fpw[4] = {NULL, NULL, NULL, NULL};
+	size_t size, window;
+	char *map = NULL, *pos;
+	INGEST_JOB job;
+	uint64_t lines = 0, invalid = 0;
+	int c, windows = 0, ret = -1;
+	double t0 = now_seconds();
+
+	if(!csvfile || !binfile || !pfile || !ufile || !ifile){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	memset(&job, 0, sizeof(job));
+	if(threads <= 0)
+		threads = online_cpus();
+	/* the window and its records, about a third of its size            */
+	window = mem_limit / 2 > INGEST_SLICE_BYTES ? mem_limit / 2 : INGEST_SLICE_BYTES;
+
+	if(map_csv(csvfile, &map, &size) != 0)
+		return -1;
+	for(c=0;c<4;c++){
+		fpw[c] = fopen(file[c], "wb");
+		if(!fpw[c]){
+			printf("%s failed, open %s!!!\n", __FUNCTION__, file[c]);
+			goto err;
+			}
+		}
+	for(pos=map;pos && pos<map+size && lines<max_lines;windows++){
+		char *end = (size_t)(map + size - pos) > window ? pos + window : map + size;
+		if(end < map + size){
+			char *nl = memchr(end, '\n', map + size - end);
+			end = nl ? nl + 1 : map + size;
+			}
+		if(ingest_region(&job, pos, end, max_lines - lines, threads, &invalid) != 0)
+			goto err;
+		if(stream_slices(&job, fpw) != 0){
+			printf("%s, write failed\n", __FUNCTION__);
+			goto err;
+			}
+		lines += job.parsed;
+		ingest_release(&job, windows == 0);
+		/* the window is done with, give its pages back                  */
+		madvise(pos, end - pos, MADV_DONTNEED);
+		pos = end;
+		}
+	for(c=0;c<4;c++){
+		int failed = fclose(fpw[c]) != 0;
+		fpw[c] = NULL;
+		if(failed){
+			printf("%s, write %s failed\n", __FUNCTION__, file[c]);
+			goto err;
+			}
+		}
+
+	double elapsed = now_seconds() - t0;
+	printf("%s, %s: %llu lines (%llu invalid), %d windows of %zu bytes, %d threads, %.3f s, %.0f lines/s\n",
+		__FUNCTION__, csvfile, (unsigned long long)lines, (unsigned long long)invalid,
+		windows, window, threads, elapsed, elapsed > 0 ? lines / elapsed : 0.0);
+	ret = 0;
+err:
+	ingest_release(&job, 0);
+	for(c=0;c<4;c++)
+		if(fpw[c])
+			fclose(fpw[c]);
+	if(map)
+		munmap(map, size);
+	return ret;
+}
+
+static int write_all(const char *file, const void *buf, size_t size, uint64_t count)
+{
+	FILE *fpw = fopen(file, "wb");
+	if(!fpw){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, file);
+		return -1;
+		}
+	if(count && fwrite(buf, size, count, fpw) != count){
+		printf("%s, write %s failed\n", __FUNCTION__, file);
+		fclose(fpw);
+		return -1;
+		}
+	fclose(fpw);
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * csv_ingest_write()
+ *------------------------------------------------------------------------*/
+int csv_ingest_write(const PUI_COLUMNS *cols, const char *binfile,
+			const char *pfile, const char *ufile, const char *ifile)
+{
+	if(!cols){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	if(write_all(binfile, cols->puis, sizeof(BIN_PUI), cols->lines)
+		|| write_all(pfile, cols->p, sizeof(DWORD), cols->lines)
+		|| write_all(ufile, cols->u, sizeof(WORD), cols->lines)
+		|| write_all(ifile, cols->i, sizeof(DWORD), cols->lines))
+		return -1;
+	return 0;
+}
+
+void csv_ingest_free(PUI_COLUMNS *cols)
+{
+	if(!cols)
+		return;
+	free(cols->puis);
+	free(cols->p);
+	free(cols->u);
+	free(cols->i);
+	memset(cols, 0, sizeof(*cols));
+}
@@ -0,0 +1,53 @@
+#ifndef CSV_INGEST_H
+#define CSV_INGEST_H
+
+#include <stdint.h>
+
+#include "pre_processing.h"
+
+/*------------------------------------------------------------------------
+ * Parsed P/U/I capture held in memory
+ *      puis        : packed BIN_PUI records (BIN_INPUT_FILE layout)
+ *      p / u / i   : the same values as per-channel columns
+ *------------------------------------------------------------------------*/
+typedef struct
+{
+	uint64_t lines;
+	BIN_PUI *puis;
+	DWORD   *p;
+	WORD    *u;
+	DWORD   *i;
+} PUI_COLUMNS;
+
+/*------------------------------------------------------------------------
+ * csv_ingest()
+ *  mmap <csvfile>, split it at line boundaries over <threads> workers
+ *  (<=0: online CPUs) and parse at most <max_lines> valid records
+ *  straight into the x10 / x10 / x1000 fixed-point values.
+ *  Returns 0 on success, <cols> must be released with csv_ingest_free().
+ *------------------------------------------------------------------------*/
+int csv_ingest(const char *csvfile, uint64_t max_lines, int threads, PUI_COLUMNS *cols);
+
+/*------------------------------------------------------------------------
+ * csv_ingest_stream()
+ *  csv_ingest() one window of about <mem_limit>/2 CSV bytes at a time,
+ *  each window written to the struct file and the three channel files
+ *  before the next is parsed, so the capture is never held in memory.
+ *  Returns 0 on success.
+ *------------------------------------------------------------------------*/
+int csv_ingest_stream(const char *csvfile, uint64_t max_lines, int threads, uint64_t mem_limit,
+			const char *binfile, const char *pfile, const char *ufile, const char *ifile);
+
+/* write the struct file and the three channel files, one fwrite each    */
+int csv_ingest_write(const PUI_COLUMNS *cols, const char *binfile,
+			const char *pfile, const char *ufile, const char *ifile);
+
+void csv_ingest_free(PUI_COLUMNS *cols);
+
+/* number of online CPUs, at least 1                                     */
+int online_cpus(void);
+
+/* CLOCK_MONOTONIC in seconds, for the throughput reports                */
+double now_seconds(void);
+
+#endif
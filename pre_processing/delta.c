@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "cpu_features.h"
+#include "delta.h"
+
+#if HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* Kernels for <n> lanes, <prev> is the lane before in[0] / out[0]        */
+typedef void (*DELTA16_KERNEL)(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map);
+typedef void (*DELTA32_KERNEL)(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map);
+
+static inline uint16_t zigzag16(int32_t v)
+{
+	/*  [-32768,32767] → [0,65535] */
+	return (uint16_t)(((uint32_t)v << 1) ^ (uint32_t)(v >> 15));
+}
+
+static inline uint32_t zigzag32(int64_t v)
+{
+	/*  [-2^31,2^31-1] → [0,0xFFFFFFFF] */
+	return (uint32_t)(((uint64_t)v << 1) ^ (uint64_t)(v >> 31));
+}
+
+static inline uint16_t map16(uint16_t curr, uint16_t prev, DELTA_MAP map)
+{
+	int32_t diff = (int32_t)curr - (int32_t)prev;
+
+	if(map == DELTA_ZIGZAG){
+		if(diff >  32767) diff =  32767;
+		if(diff < -32768) diff = -32768;
+		return zigzag16(diff);
+		}
+	uint32_t mag = diff >= 0 ? (uint32_t)diff : (uint32_t)(-diff);
+	if(mag > 0x7FFF) mag = 0x7FFF;
+	return diff < 0 ? (uint16_t)(mag | 0x8000u) : (uint16_t)mag;
+}
+
+static inline uint32_t map32(uint32_t curr, uint32_t prev, DELTA_MAP map)
+{
+	int64_t diff = (int64_t)curr - (int64_t)prev;
+
+	if(map == DELTA_ZIGZAG){
+		if(diff >  2147483647LL) diff =  2147483647LL;
+		if(diff < -2147483648LL) diff = -2147483648LL;
+		return zigzag32(diff);
+		}
+	uint64_t mag = diff >= 0 ? (uint64_t)diff : (uint64_t)(-diff);
+	if(mag > 0x7FFFFFFF) mag = 0x7FFFFFFF;
+	return diff < 0 ? (uint32_t)(mag | 0x80000000u) : (uint32_t)mag;
+}
+
+/* signed difference back from its mapped form                           */
+static inline int32_t unmap16(uint16_t v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	return (v & 0x8000u) ? -(int32_t)(v & 0x7FFF) : (int32_t)v;
+}
+
+static inline int64_t unmap32(uint32_t v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+	return (v & 0x80000000u) ? -(int64_t)(v & 0x7FFFFFFF) : (int64_t)v;
+}
+
+/*------------------------------------------------------------------------
+ * Scalar kernels
+ *------------------------------------------------------------------------*/
+static void encode16_scalar(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	size_t k;
+
+	for(k=0;k<n;k++){
+		out[k] = map16(in[k], prev, map);
+		prev = in[k];
+		}
+}
+
+static void encode32_scalar(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	size_t k;
+
+	for(k=0;k<n;k++){
+		out[k] = map32(in[k], prev, map);
+		prev = in[k];
+		}
+}
+
+static void decode16_scalar(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	size_t k;
+
+	for(k=0;k<n;k++)
+		out[k] = prev = (uint16_t)(prev + unmap16(in[k], map));
+}
+
+static void decode32_scalar(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	size_t k;
+
+	for(k=0;k<n;k++)
+		out[k] = prev = (uint32_t)(prev + unmap32(in[k], map));
+}
+
+#if HAVE_X86_SIMD
+/*------------------------------------------------------------------------
+ * SSE2 kernels
+ *  Encode subtracts the vector loaded one lane earlier.  The saturated
+ *  difference is built from the two one-sided differences: <pos> is
+ *  curr-prev where curr > prev, <neg> is prev-curr where curr < prev,
+ *  each clamped to what the mapping can hold.
+ *  Decode maps back to signed differences and runs a log-step prefix
+ *  sum inside the vector plus the carry from the previous vector.
+ *------------------------------------------------------------------------*/
+TARGET_SSE2
+static inline __m128i map16_sse2(__m128i curr, __m128i prev, DELTA_MAP map)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i pos = _mm_subs_epu16(curr, prev);
+	__m128i neg = _mm_subs_epu16(prev, curr);
+	__m128i hasneg = _mm_andnot_si128(_mm_cmpeq_epi16(neg, zero), _mm_set1_epi16(-1));
+
+	/* min(x, c) == x - subs(x, c)                                      */
+	pos = _mm_sub_epi16(pos, _mm_subs_epu16(pos, _mm_set1_epi16(0x7FFF)));
+	if(map == DELTA_ZIGZAG){
+		neg = _mm_sub_epi16(neg, _mm_subs_epu16(neg, _mm_set1_epi16((short)0x8000)));
+		__m128i zn = _mm_and_si128(_mm_sub_epi16(_mm_slli_epi16(neg, 1), _mm_set1_epi16(1)), hasneg);
+		return _mm_or_si128(_mm_slli_epi16(pos, 1), zn);
+		}
+	neg = _mm_sub_epi16(neg, _mm_subs_epu16(neg, _mm_set1_epi16(0x7FFF)));
+	return _mm_or_si128(_mm_or_si128(pos, neg),
+			_mm_and_si128(hasneg, _mm_set1_epi16((short)0x8000)));
+}
+
+TARGET_SSE2
+static inline __m128i map32_sse2(__m128i curr, __m128i prev, DELTA_MAP map)
+{
+	const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i gt = _mm_cmpgt_epi32(_mm_xor_si128(curr, bias), _mm_xor_si128(prev, bias));
+	__m128i lt = _mm_cmpgt_epi32(_mm_xor_si128(prev, bias), _mm_xor_si128(curr, bias));
+	__m128i pos = _mm_and_si128(_mm_sub_epi32(curr, prev), gt);
+	__m128i neg = _mm_and_si128(_mm_sub_epi32(prev, curr), lt);
+	__m128i over;
+
+	/* pos > 0x7FFFFFFF has its top bit set                              */
+	over = _mm_srai_epi32(pos, 31);
+	pos = _mm_or_si128(_mm_andnot_si128(over, pos), _mm_and_si128(over, _mm_set1_epi32(0x7FFFFFFF)));
+	if(map == DELTA_ZIGZAG){
+		over = _mm_cmpgt_epi32(_mm_xor_si128(neg, bias), zero);
+		neg = _mm_or_si128(_mm_andnot_si128(over, neg), _mm_and_si128(over, bias));
+		__m128i zn = _mm_and_si128(_mm_sub_epi32(_mm_slli_epi32(neg, 1), _mm_set1_epi32(1)), lt);
+		return _mm_or_si128(_mm_slli_epi32(pos, 1), zn);
+		}
+	over = _mm_srai_epi32(neg, 31);
+	neg = _mm_or_si128(_mm_andnot_si128(over, neg), _mm_and_si128(over, _mm_set1_epi32(0x7FFFFFFF)));
+	return _mm_or_si128(_mm_or_si128(pos, neg), _mm_and_si128(lt, bias));
+}
+
+TARGET_SSE2
+static inline __m128i unmap16_sse2(__m128i v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return _mm_xor_si128(_mm_srli_epi16(v, 1),
+			_mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi16(1))));
+	__m128i s = _mm_srai_epi16(v, 15);
+	__m128i m = _mm_and_si128(v, _mm_set1_epi16(0x7FFF));
+	return _mm_sub_epi16(_mm_xor_si128(m, s), s);
+}
+
+TARGET_SSE2
+static inline __m128i unmap32_sse2(__m128i v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return _mm_xor_si128(_mm_srli_epi32(v, 1),
+			_mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi32(1))));
+	__m128i s = _mm_srai_epi32(v, 31);
+	__m128i m = _mm_and_si128(v, _mm_set1_epi32(0x7FFFFFFF));
+	return _mm_sub_epi32(_mm_xor_si128(m, s), s);
+}
+
+TARGET_SSE2
+static void encode16_sse2(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	size_t k = 0;
+
+	if(n == 0)
+		return;
+	out[0] = map16(in[0], prev, map);
+	for(k=1;k+8<=n;k+=8){
+		__m128i c = _mm_loadu_si128((const __m128i *)(in + k));
+		__m128i p = _mm_loadu_si128((const __m128i *)(in + k - 1));
+		_mm_storeu_si128((__m128i *)(out + k), map16_sse2(c, p, map));
+		}
+	encode16_scalar(in + k, out + k, n - k, in[k-1], map);
+}
+
+TARGET_SSE2
+static void encode32_sse2(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	size_t k = 0;
+
+	if(n == 0)
+		return;
+	out[0] = map32(in[0], prev, map);
+	for(k=1;k+4<=n;k+=4){
+		__m128i c = _mm_loadu_si128((const __m128i *)(in + k));
+		__m128i p = _mm_loadu_si128((const __m128i *)(in + k - 1));
+		_mm_storeu_si128((__m128i *)(out + k), map32_sse2(c, p, map));
+		}
+	encode32_scalar(in + k, out + k, n - k, in[k-1], map);
+}
+
+TARGET_SSE2
+static void decode16_sse2(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	__m128i carry = _mm_set1_epi16((short)prev);
+	size_t k;
+
+	for(k=0;k+8<=n;k+=8){
+		__m128i x = unmap16_sse2(_mm_loadu_si128((const __m128i *)(in + k)), map);
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi16(x, carry);
+		_mm_storeu_si128((__m128i *)(out + k), x);
+		carry = _mm_shufflehi_epi16(x, 0xFF);
+		carry = _mm_unpackhi_epi64(carry, carry);
+		prev = out[k+7];
+		}
+	decode16_scalar(in + k, out + k, n - k, prev, map);
+}
+
+TARGET_SSE2
+static void decode32_sse2(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	__m128i carry = _mm_set1_epi32((int)prev);
+	size_t k;
+
+	for(k=0;k+4<=n;k+=4){
+		__m128i x = unmap32_sse2(_mm_loadu_si128((const __m128i *)(in + k)), map);
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+		x = _mm_add_epi32(x, carry);
+		_mm_storeu_si128((__m128i *)(out + k), x);
+		carry = _mm_shuffle_epi32(x, 0xFF);
+		prev = out[k+3];
+		}
+	decode32_scalar(in + k, out + k, n - k, prev, map);
+}
+
+/*------------------------------------------------------------------------
+ * AVX2 kernels, same scheme; the in-lane prefix sum is finished by
+ *  adding the last element of the low 128-bit lane to the high one.
+ *------------------------------------------------------------------------*/
+TARGET_AVX2
+static inline __m256i map16_avx2(__m256i curr, __m256i prev, DELTA_MAP map)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i pos = _mm256_subs_epu16(curr, prev);
+	__m256i neg = _mm256_subs_epu16(prev, curr);
+	__m256i hasneg = _mm256_andnot_si256(_mm256_cmpeq_epi16(neg, zero), _mm256_set1_epi16(-1));
+
+	pos = _mm256_min_epu16(pos, _mm256_set1_epi16(0x7FFF));
+	if(map == DELTA_ZIGZAG){
+		neg = _mm256_min_epu16(neg, _mm256_set1_epi16((short)0x8000));
+		__m256i zn = _mm256_and_si256(_mm256_sub_epi16(_mm256_slli_epi16(neg, 1), _mm256_set1_epi16(1)), hasneg);
+		return _mm256_or_si256(_mm256_slli_epi16(pos, 1), zn);
+		}
+	neg = _mm256_min_epu16(neg, _mm256_set1_epi16(0x7FFF));
+	return _mm256_or_si256(_mm256_or_si256(pos, neg),
+			_mm256_and_si256(hasneg, _mm256_set1_epi16((short)0x8000)));
+}
+
+TARGET_AVX2
+static inline __m256i map32_avx2(__m256i curr, __m256i prev, DELTA_MAP map)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i gt = _mm256_cmpeq_epi32(_mm256_max_epu32(curr, prev), curr);
+	__m256i lt = _mm256_andnot_si256(gt, _mm256_set1_epi32(-1));
+	__m256i pos = _mm256_sub_epi32(_mm256_max_epu32(curr, prev), prev);
+	__m256i neg = _mm256_and_si256(_mm256_sub_epi32(prev, curr), lt);
+
+	pos = _mm256_min_epu32(pos, _mm256_set1_epi32(0x7FFFFFFF));
+	if(map == DELTA_ZIGZAG){
+		neg = _mm256_min_epu32(neg, _mm256_set1_epi32((int)0x80000000u));
+		__m256i zn = _mm256_andnot_si256(_mm256_cmpeq_epi32(neg, zero),
+				_mm256_sub_epi32(_mm256_slli_epi32(neg, 1), _mm256_set1_epi32(1)));
+		return _mm256_or_si256(_mm256_slli_epi32(pos, 1), zn);
+		}
+	neg = _mm256_min_epu32(neg, _mm256_set1_epi32(0x7FFFFFFF));
+	return _mm256_or_si256(_mm256_or_si256(pos, neg),
+			_mm256_and_si256(lt, _mm256_set1_epi32((int)0x80000000u)));
+}
+
+TARGET_AVX2
+static inline __m256i unmap16_avx2(__m256i v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return _mm256_xor_si256(_mm256_srli_epi16(v, 1),
+			_mm256_sub_epi16(_mm256_setzero_si256(), _mm256_and_si256(v, _mm256_set1_epi16(1))));
+	__m256i s = _mm256_srai_epi16(v, 15);
+	__m256i m = _mm256_and_si256(v, _mm256_set1_epi16(0x7FFF));
+	return _mm256_sub_epi16(_mm256_xor_si256(m, s), s);
+}
+
+TARGET_AVX2
+static inline __m256i unmap32_avx2(__m256i v, DELTA_MAP map)
+{
+	if(map == DELTA_ZIGZAG)
+		return _mm256_xor_si256(_mm256_srli_epi32(v, 1),
+			_mm256_sub_epi32(_mm256_setzero_si256(), _mm256_and_si256(v, _mm256_set1_epi32(1))));
+	__m256i s = _mm256_srai_epi32(v, 31);
+	__m256i m = _mm256_and_si256(v, _mm256_set1_epi32(0x7FFFFFFF));
+	return _mm256_sub_epi32(_mm256_xor_si256(m, s), s);
+}
+
+TARGET_AVX2
+static void encode16_avx2(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	size_t k = 0;
+
+	if(n == 0)
+		return;
+	out[0] = map16(in[0], prev, map);
+	for(k=1;k+16<=n;k+=16){
+		__m256i c = _mm256_loadu_si256((const __m256i *)(in + k));
+		__m256i p = _mm256_loadu_si256((const __m256i *)(in + k - 1));
+		_mm256_storeu_si256((__m256i *)(out + k), map16_avx2(c, p, map));
+		}
+	encode16_scalar(in + k, out + k, n - k, in[k-1], map);
+}
+
+TARGET_AVX2
+static void encode32_avx2(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	size_t k = 0;
+
+	if(n == 0)
+		return;
+	out[0] = map32(in[0], prev, map);
+	for(k=1;k+8<=n;k+=8){
+		__m256i c = _mm256_loadu_si256((const __m256i *)(in + k));
+		__m256i p = _mm256_loadu_si256((const __m256i *)(in + k - 1));
+		_mm256_storeu_si256((__m256i *)(out + k), map32_avx2(c, p, map));
+		}
+	encode32_scalar(in + k, out + k, n - k, in[k-1], map);
+}
+
+TARGET_AVX2
+static void decode16_avx2(const uint16_t *in, uint16_t *out, size_t n,
+				uint16_t prev, DELTA_MAP map)
+{
+	__m256i carry = _mm256_set1_epi16((short)prev);
+	size_t k;
+
+	for(k=0;k+16<=n;k+=16){
+		__m256i x = unmap16_avx2(_mm256_loadu_si256((const __m256i *)(in + k)), map);
+		x = _mm256_add_epi16(x, _mm256_slli_si256(x, 2));
+		x = _mm256_add_epi16(x, _mm256_slli_si256(x, 4));
+		x = _mm256_add_epi16(x, _mm256_slli_si256(x, 8));
+		__m256i lo = _mm256_permute2x128_si256(x, x, 0x08);
+		lo = _mm256_shufflehi_epi16(lo, 0xFF);
+		x = _mm256_add_epi16(x, _mm256_unpackhi_epi64(lo, lo));
+		x = _mm256_add_epi16(x, carry);
+		_mm256_storeu_si256((__m256i *)(out + k), x);
+		prev = out[k+15];
+		carry = _mm256_set1_epi16((short)prev);
+		}
+	decode16_scalar(in + k, out + k, n - k, prev, map);
+}
+
+TARGET_AVX2
+static void decode32_avx2(const uint32_t *in, uint32_t *out, size_t n,
+				uint32_t prev, DELTA_MAP map)
+{
+	const __m256i last = _mm256_set1_epi32(7);
+	__m256i carry = _mm256_set1_epi32((int)prev);
+	size_t k;
+
+	for(k=0;k+8<=n;k+=8){
+		__m256i x = unmap32_avx2(_mm256_loadu_si256((const __m256i *)(in + k)), map);
+		x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+		x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+		__m256i lo = _mm256_permute2x128_si256(x, x, 0x08);
+		x = _mm256_add_epi32(x, _mm256_shuffle_epi32(lo, 0xFF));
+		x = _mm256_add_epi32(x, carry);
+		_mm256_storeu_si256((__m256i *)(out + k), x);
+		carry = _mm256_permutevar8x32_epi32(x, last);
+		prev = out[k+7];
+		}
+	decode32_scalar(in + k, out + k, n - k, prev, map);
+}
+#endif
+
+static DELTA16_KERNEL pick16(int decode)
+{
+#if HAVE_X86_SIMD
+	switch(cpu_simd_level()){
+		case SIMD_AVX2: return decode ? decode16_avx2 : encode16_avx2;
+		case SIMD_SSE2: return decode ? decode16_sse2 : encode16_sse2;
+		default: break;
+		}
+#endif
+	return decode ? decode16_scalar : encode16_scalar;
+}
+
+static DELTA32_KERNEL pick32(int decode)
+{
+#if HAVE_X86_SIMD
+	switch(cpu_simd_level()){
+		case SIMD_AVX2: return decode ? decode32_avx2 : encode32_avx2;
+		case SIMD_SSE2: return decode ? decode32_sse2 : encode32_sse2;
+		default: break;
+		}
+#endif
+	return decode ? decode32_scalar : encode32_scalar;
+}
+
+/*------------------------------------------------------------------------
+ * delta_encode16() / delta_encode32()
+ *------------------------------------------------------------------------*/
+void delta_encode16(const uint16_t *in, uint16_t *out, size_t n, uint16_t prev, DELTA_MAP map)
+{
+	pick16(0)(in, out, n, prev, map);
+}
+
+void delta_encode32(const uint32_t *in, uint32_t *out, size_t n, uint32_t prev, DELTA_MAP map)
+{
+	pick32(0)(in, out, n, prev, map);
+}
+
+/*------------------------------------------------------------------------
+ * delta_decode16() / delta_decode32() - prefix sum of the differences
+ *------------------------------------------------------------------------*/
+void delta_decode16(const uint16_t *in, uint16_t *out, size_t n, uint16_t prev, DELTA_MAP map)
+{
+	pick16(1)(in, out, n, prev, map);
+}
+
+void delta_decode32(const uint32_t *in, uint32_t *out, size_t n, uint32_t prev, DELTA_MAP map)
+{
+	pick32(1)(in, out, n, prev, map);
+}
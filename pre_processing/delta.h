@@ -0,0 +1,31 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * First-order difference kernels
+ *      out[k] = map(in[k] - in[k-1]),  in[-1] = <prev>
+ *  map is either sign/magnitude (sign in MSB, magnitude saturated, as in
+ *  puis_diff()) or ZigZag of the difference saturated to the lane range
+ *  (as in puis_diff_zigzag()).  <in> and <out> must not overlap.
+ *------------------------------------------------------------------------*/
+typedef enum {
+	DELTA_SIGNMAG = 0,
+	DELTA_ZIGZAG
+} DELTA_MAP;
+
+void delta_encode16(const uint16_t *in, uint16_t *out, size_t n, uint16_t prev, DELTA_MAP map);
+void delta_encode32(const uint32_t *in, uint32_t *out, size_t n, uint32_t prev, DELTA_MAP map);
+
+/*------------------------------------------------------------------------
+ * Matching decoders, a prefix sum of the unmapped differences
+ *      out[k] = out[k-1] + unmap(in[k]),  out[-1] = <prev>
+ *  Exact inverse of the encoders as long as no difference was saturated
+ *  (|in[k] - in[k-1]| fits the signed lane).
+ *------------------------------------------------------------------------*/
+void delta_decode16(const uint16_t *in, uint16_t *out, size_t n, uint16_t prev, DELTA_MAP map);
+void delta_decode32(const uint32_t *in, uint32_t *out, size_t n, uint32_t prev, DELTA_MAP map);
+
+#endif
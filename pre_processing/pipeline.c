@@ -0,0 +1,923 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "pipeline.h"
+#include "csv_ingest.h"
+#include "bitshuffle.h"
+#include "byteshuffle.h"
+#include "planemap.h"
+#include "bitpack.h"
+#include "mydeflate.h"
+#include "szr.h"
+#include "pent.h"
+#include "archive.h"
+
+static const char *variant_name[VAR_MAX] = {
+	"raw", "byte", "bit", "diff", "diff_byte", "diff_bit",
+	"pred", "pred_byte", "pred_bit"
+};
+
+static const char *output_name[OUT_MAX] = {
+	"plain", "deflate", "szr", "bitpack", "entropy", "chain"
+};
+
+const char *pipeline_variant_name(PIPE_VARIANT v)
+{
+	return (unsigned)v < VAR_MAX ? variant_name[v] : "unknown";
+}
+
+/*------------------------------------------------------------------------
+ * parse_names() - comma separated <names>, or "all", into a bit mask
+ *------------------------------------------------------------------------*/
+static unsigned parse_names(const char *list, const char * const *names, int count)
+{
+	unsigned mask = 0;
+	const char *s = list;
+
+	if(!list)
+		return 0;
+	while(*s){
+		const char *e = strchr(s, ',');
+		size_t len = e ? (size_t)(e - s) : strlen(s);
+		int v, found = 0;
+
+		if(len == 3 && !strncmp(s, "all", 3)){
+			mask |= (1u << count) - 1;
+			found = 1;
+			}
+		for(v=0;v<count && !found;v++){
+			if(strlen(names[v]) == len && !strncmp(s, names[v], len)){
+				mask |= 1u << v;
+				found = 1;
+				}
+			}
+		if(!found){
+			printf("%s, unknown name %.*s\n", __FUNCTION__, (int)len, s);
+			return 0;
+			}
+		s += len;
+		if(*s == ',')
+			s++;
+		}
+	return mask;
+}
+
+unsigned pipeline_parse_variants(const char *list)
+{
+	return parse_names(list, variant_name, VAR_MAX);
+}
+
+unsigned pipeline_parse_outputs(const char *list)
+{
+	return parse_names(list, output_name, OUT_MAX);
+}
+
+const char *pipeline_output_name(PIPE_OUTPUT o)
+{
+	return (unsigned)o < OUT_MAX ? output_name[o] : "unknown";
+}
+
+static int write_file(const char *file, const BYTE *buf, size_t len)
+{
+	FILE *fpw = fopen(file, "wb");
+	if(!fpw){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, file);
+		return -1;
+		}
+	if(len && fwrite(buf, 1, len, fpw) != len){
+		printf("%s, write %s failed\n", __FUNCTION__, file);
+		fclose(fpw);
+		return -1;
+		}
+	fclose(fpw);
+	return 0;
+}
+
+/* Segment being written, and what the archive directory records of it   */
+typedef struct {
+	int      s;
+	uint64_t first;			/* record range                              */
+	uint64_t records;
+	int      has_range;		/* min / max of the records, WORD / DWORD    */
+	int64_t  min;
+	int64_t  max;
+	int      pmap;			/* planes as a plane map (-e)                */
+} PIPE_SEGMENT;
+
+/*------------------------------------------------------------------------
+ * put_output()
+ *  <filename> with the <len> bytes of output <o> of variant <v>, or the
+ *  same bytes appended to <enc>->archive under that name.
+ *------------------------------------------------------------------------*/
+static int put_output(const PIPE_CHANNEL *ch, const PIPE_ENCODER *enc, PIPE_VARIANT v,
+			PIPE_OUTPUT o, const PIPE_SEGMENT *sg, const char *filename,
+			const BYTE *buf, size_t len)
+{
+	ARCHIVE_ENTRY e;
+
+	if(!enc || !enc->archive)
+		return write_file(filename, buf, len);
+	memset(&e, 0, sizeof(e));
+	e.first = sg->first;
+	e.records = sg->records;
+	e.min = sg->min;
+	e.max = sg->max;
+	e.flags = (sg->has_range ? ARCHIVE_F_RANGE : 0) | (sg->pmap ? ARCHIVE_F_PMAP : 0);
+	e.segment = sg->s;
+	e.channel = ch->id;
+	e.variant = v;
+	e.output = o;
+	if(strlen(filename) >= ARCHIVE_NAME){
+		printf("%s, name %s too long for the archive\n", __FUNCTION__, filename);
+		return -1;
+		}
+	strcpy(e.name, filename);
+	return archive_append(enc->archive, &e, buf, len);
+}
+
+/*------------------------------------------------------------------------
+ * write_variant()
+ *  Hand one transformed segment to every encoder in <enc> and write what
+ *  they return, "<result>.NN" + ".z" (deflate) / ".s" (SZR0) / ".p"
+ *  (bitpack, lane variants of WORD / DWORD channels only) / ".e" (per
+ *  plane entropy coding, one table per <plane_len> bytes, 0: not planes)
+ *  / ".c" (<enc>->chain, skipped like ".p" where chain_fits() says its
+ *  stages cannot take the data).  The pred PRED_HEADER is copied in
+ *  front of ".p" and ".e" as is, and is the chain's head.
+ *------------------------------------------------------------------------*/
+static int write_variant(const PIPE_CHANNEL *ch, const PIPE_ENCODER *enc,
+			PIPE_VARIANT v, const PIPE_SEGMENT *sg, const BYTE *buf, size_t len,
+			size_t plane_len)
+{
+	size_t hl = (VAR_MASK(v) & VAR_PRED_ANY) ? sizeof(PRED_HEADER) : 0;
+	char filename[512];
+	unsigned char *packed;
+	size_t packed_len;
+	int ret = 0;
+
+	snprintf(filename, sizeof(filename), "%s.%02d", ch->result[v], sg->s);
+	if(!enc || (enc->outputs & OUT_MASK(OUT_PLAIN)))
+		ret |= put_output(ch, enc, v, OUT_PLAIN, sg, filename, buf, len);
+	if(!enc)
+		return ret;
+
+	if(enc->outputs & OUT_MASK(OUT_DEFLATE)){
+		if(mydeflate_compress(buf, len, &packed, &packed_len, enc->wbits, enc->mlevel) != Z_OK){
+			printf("%s, deflate %s failed\n", __FUNCTION__, filename);
+			return -1;
+			}
+		strcat(filename, ".z");
+		ret |= put_output(ch, enc, v, OUT_DEFLATE, sg, filename, packed, packed_len);
+		free(packed);
+		filename[strlen(filename)-2] = 0;
+		}
+	if(enc->outputs & OUT_MASK(OUT_SZR)){
+		if(szr_shrink(buf, len, &packed, &packed_len) != 0){
+			printf("%s, shrink %s failed\n", __FUNCTION__, filename);
+			return -1;
+			}
+		strcat(filename, ".s");
+		ret |= put_output(ch, enc, v, OUT_SZR, sg, filename, packed, packed_len);
+		free(packed);
+		filename[strlen(filename)-2] = 0;
+		}
+	if((enc->outputs & OUT_MASK(OUT_BITPACK)) && (ch->unit_size == 2 || ch->unit_size == 4)
+		&& (v == VAR_RAW || v == VAR_DIFF || v == VAR_PRED)){
+		size_t n = (len - hl) / ch->unit_size;
+		packed = malloc(hl + bitpack_bound(n, ch->unit_size));
+		if(!packed){
+			printf("%s, no memory for %s\n", __FUNCTION__, filename);
+			return -1;
+			}
+		memcpy(packed, buf, hl);
+		if(bitpack_encode(buf + hl, n, ch->unit_size, packed + hl, &packed_len) != 0){
+			printf("%s, bitpack %s failed\n", __FUNCTION__, filename);
+			free(packed);
+			return -1;
+			}
+		strcat(filename, ".p");
+		ret |= put_output(ch, enc, v, OUT_BITPACK, sg, filename, packed, hl + packed_len);
+		free(packed);
+		filename[strlen(filename)-2] = 0;
+		}
+	if(enc->outputs & OUT_MASK(OUT_ENTROPY)){
+		unsigned char *body;
+		if(pent_encode(buf + hl, len - hl, plane_len, &body, &packed_len) != 0){
+			printf("%s, entropy %s failed\n", __FUNCTION__, filename);
+			return -1;
+			}
+		packed = malloc(hl + packed_len);
+		if(!packed){
+			printf("%s, no memory for %s\n", __FUNCTION__, filename);
+			free(body);
+			return -1;
+			}
+		memcpy(packed, buf, hl);
+		memcpy(packed + hl, body, packed_len);
+		free(body);
+		strcat(filename, ".e");
+		ret |= put_output(ch, enc, v, OUT_ENTROPY, sg, filename, packed, hl + packed_len);
+		free(packed);
+		filename[strlen(filename)-2] = 0;
+		}
+	if((enc->outputs & OUT_MASK(OUT_CHAIN)) && enc->chain
+		&& chain_fits(enc->chain, ch->unit_size, len - hl)){
+		if(chain_encode(enc->chain, ch->unit_size, buf, len, hl, &packed, &packed_len) != 0){
+			printf("%s, chain %s failed\n", __FUNCTION__, filename);
+			return -1;
+			}
+		strcat(filename, ".c");
+		ret |= put_output(ch, enc, v, OUT_CHAIN, sg, filename, packed, packed_len);
+		free(packed);
+		}
+	return ret;
+}
+
+/*------------------------------------------------------------------------
+ * segment_diff()
+ *  Difference of <n> records into <out>.  <prev> is the record before
+ *  the first one (the last record of the previous segment or window);
+ *  NULL marks record 0 of the whole input, which is kept as is, so the
+ *  tiles concatenate to exactly what puis_diff() / puis_diff_zigzag()
+ *  leave in the buffer.
+ *------------------------------------------------------------------------*/
+static int segment_diff(const PIPE_CHANNEL *ch, const BYTE *seg, const BYTE *prev,
+			BYTE *out, size_t n)
+{
+	size_t skip = prev ? 0 : 1;
+
+	if(n == 0)
+		return 0;
+	if(ch->unit_size == 2){
+		const uint16_t *in = (const uint16_t *)seg;
+		uint16_t *o = (uint16_t *)out;
+		uint16_t p;
+		if(prev)
+			memcpy(&p, prev, sizeof(p));
+		else
+			o[0] = p = in[0];
+		delta_encode16(in + skip, o + skip, n - skip, p, ch->diff_map);
+	}else if(ch->unit_size == 4){
+		const uint32_t *in = (const uint32_t *)seg;
+		uint32_t *o = (uint32_t *)out;
+		uint32_t p;
+		if(prev)
+			memcpy(&p, prev, sizeof(p));
+		else
+			o[0] = p = in[0];
+		delta_encode32(in + skip, o + skip, n - skip, p, ch->diff_map);
+	}else{
+		printf("%s, no difference for unit size %d\n", __FUNCTION__, ch->unit_size);
+		return -1;
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * segment_predict()
+ *  Pick the predictor of <ch>->predictors with the smallest residuals on
+ *  the <n> records of <seg>, and write its PRED_HEADER followed by the
+ *  residuals into <out>.  Only the segment itself is used, so every pred
+ *  file decodes on its own.
+ *------------------------------------------------------------------------*/
+static int segment_predict(const PIPE_CHANNEL *ch, const BYTE *seg, BYTE *out, size_t n)
+{
+	PRED_HEADER hdr;
+	uint32_t lag = ch->lag;
+	uint64_t cost;
+	PRED_ID id;
+
+	if(!lag && (ch->predictors & (PRED_MASK(PRED_LAG) | PRED_MASK(PRED_LAG_DELTA))))
+		lag = predictor_estimate_lag(seg, n, ch->unit_size, PRED_MAX_LAG);
+	id = predictor_select(seg, n, ch->unit_size, ch->predictors, lag, &cost);
+	if(id != PRED_LAG && id != PRED_LAG_DELTA)
+		lag = 0;
+
+	memcpy(hdr.magic, PRED_MAGIC, sizeof(hdr.magic));
+	hdr.id = id;
+	hdr.unit_size = ch->unit_size;
+	hdr.lag = lag;
+	memcpy(out, &hdr, sizeof(hdr));
+	return predictor_encode(id, lag, seg, out + sizeof(hdr), n, ch->unit_size);
+}
+
+/* State shared by the segment workers                                   */
+typedef struct {
+	const PIPE_CHANNEL *ch;
+	const PIPE_ENCODER *enc;
+	const BYTE *puis;		/* batch: the whole input                    */
+	int        in_fd;		/* streaming: the input file                 */
+	size_t     window;		/* streaming: records per window             */
+	unsigned   variants;
+	int        segments;
+	uint64_t   seg_lines;
+	size_t     seg_len;
+	int        next;		/* next segment to hand out (atomic)         */
+	int        failed;
+	uint64_t   planes;		/* planes mapped / elided with -e (atomic)   */
+	uint64_t   elided;
+} PIPE_JOB;
+
+/* Per-worker scratch tiles, <cap> bytes each; bytes, bits and pred have
+ * PRED_HEADER room in front for the pred variants, pmap that and the
+ * plane map on top                                                      */
+typedef struct {
+	size_t cap;
+	BYTE  *in;
+	BYTE  *bytes;
+	BYTE  *bits;
+	BYTE  *diff;
+	BYTE  *pred;
+	BYTE  *pmap;
+	uint64_t planes;	/* this worker's share of PIPE_JOB.planes / elided */
+	uint64_t elided;
+} PIPE_SCRATCH;
+
+/*------------------------------------------------------------------------
+ * write_planes()
+ *  write_variant() for the byte / bit variants, <len> bytes of planes
+ *  behind <hl> header bytes.  When the encoder elides planes they are
+ *  classified and packed by planemap_encode() first; a bit variant has
+ *  8 planes per byte plane.
+ *------------------------------------------------------------------------*/
+static int write_planes(const PIPE_JOB *job, PIPE_SCRATCH *sc, PIPE_VARIANT v,
+			const PIPE_SEGMENT *sg, const BYTE *buf, size_t hl, size_t len)
+{
+	const PIPE_CHANNEL *ch = job->ch;
+	int nplanes = ch->unit_size, elided;
+	size_t packed_len;
+	PIPE_SEGMENT map = *sg;
+
+	if(VAR_MASK(v) & VAR_BIT_ANY)
+		nplanes *= 8;
+	if(!job->enc || !job->enc->elide)
+		return write_variant(ch, job->enc, v, sg, buf, hl + len, len/nplanes);
+	memcpy(sc->pmap, buf, hl);
+	if(planemap_encode(buf + hl, nplanes, len/nplanes, sc->pmap + hl, &packed_len, &elided) != 0)
+		return -1;
+	sc->planes += nplanes;
+	sc->elided += elided;
+	map.pmap = 1;
+	/* the kept planes no longer sit on a plane grid, one table a block   */
+	return write_variant(ch, job->enc, v, &map, sc->pmap, hl + packed_len, 0);
+}
+
+/* Record range of segment <s>, and the value range for the archive       */
+static void segment_info(const PIPE_JOB *job, int s, const BYTE *seg, PIPE_SEGMENT *sg)
+{
+	size_t i, n = job->seg_lines;
+
+	memset(sg, 0, sizeof(*sg));
+	sg->s = s;
+	sg->first = (uint64_t)s * job->seg_lines;
+	sg->records = n;
+	if(!job->enc || !job->enc->archive || n == 0)
+		return;
+	if(job->ch->unit_size == 2){
+		uint16_t lo = 0xffff, hi = 0, x;
+		for(i=0;i<n;i++){
+			memcpy(&x, seg + i*2, 2);
+			lo = x < lo ? x : lo;
+			hi = x > hi ? x : hi;
+			}
+		sg->min = lo;
+		sg->max = hi;
+		sg->has_range = 1;
+	}else if(job->ch->unit_size == 4){
+		uint32_t lo = 0xffffffffu, hi = 0, x;
+		for(i=0;i<n;i++){
+			memcpy(&x, seg + i*4, 4);
+			lo = x < lo ? x : lo;
+			hi = x > hi ? x : hi;
+			}
+		sg->min = lo;
+		sg->max = hi;
+		sg->has_range = 1;
+		}
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_segment()
+ *  One pass over segment <s> held in <seg> (<prev>: see segment_diff()):
+ *  raw is written straight from the input, the byte planes (and their
+ *  bit planes) are built into the worker's scratch tiles, the difference
+ *  goes into its own tile and feeds the diff_byte / diff_bit variants
+ *  the same way, and so do the predictor residuals.
+ *------------------------------------------------------------------------*/
+static int pipeline_segment(const PIPE_JOB *job, int s, const BYTE *seg, const BYTE *prev,
+			PIPE_SCRATCH *sc)
+{
+	const PIPE_CHANNEL *ch = job->ch;
+	const PIPE_ENCODER *enc = job->enc;
+	unsigned variants = job->variants;
+	size_t seg_len = job->seg_len;
+	BYTE *bytes = sc->bytes, *bits = sc->bits, *diff = sc->diff;
+	PIPE_SEGMENT sgi, *sg = &sgi;
+	int r = 0;
+
+	segment_info(job, s, seg, sg);
+	if(variants & VAR_MASK(VAR_RAW))
+		r |= write_variant(ch, enc, VAR_RAW, sg, seg, seg_len, 0);
+	if(variants & (VAR_MASK(VAR_BYTE) | VAR_MASK(VAR_BIT))){
+		byteshuffle_encode(seg, bytes, ch->unit_size, job->seg_lines);
+		if(variants & VAR_MASK(VAR_BYTE))
+			r |= write_planes(job, sc, VAR_BYTE, sg, bytes, 0, seg_len);
+		if(variants & VAR_MASK(VAR_BIT)){
+			bitshuffle_encode(bytes, bits, seg_len);
+			r |= write_planes(job, sc, VAR_BIT, sg, bits, 0, seg_len);
+			}
+		}
+	if(variants & VAR_DIFF_ANY){
+		if(segment_diff(ch, seg, prev, diff, job->seg_lines) != 0)
+			return -1;
+		if(variants & VAR_MASK(VAR_DIFF))
+			r |= write_variant(ch, enc, VAR_DIFF, sg, diff, seg_len, 0);
+		if(variants & (VAR_MASK(VAR_DIFF_BYTE) | VAR_MASK(VAR_DIFF_BIT))){
+			byteshuffle_encode(diff, bytes, ch->unit_size, job->seg_lines);
+			if(variants & VAR_MASK(VAR_DIFF_BYTE))
+				r |= write_planes(job, sc, VAR_DIFF_BYTE, sg, bytes, 0, seg_len);
+			if(variants & VAR_MASK(VAR_DIFF_BIT)){
+				bitshuffle_encode(bytes, bits, seg_len);
+				r |= write_planes(job, sc, VAR_DIFF_BIT, sg, bits, 0, seg_len);
+				}
+			}
+		}
+	if(variants & VAR_PRED_ANY){
+		size_t hl = sizeof(PRED_HEADER);
+		if(segment_predict(ch, seg, sc->pred, job->seg_lines) != 0)
+			return -1;
+		if(variants & VAR_MASK(VAR_PRED))
+			r |= write_variant(ch, enc, VAR_PRED, sg, sc->pred, hl + seg_len, 0);
+		if(variants & (VAR_MASK(VAR_PRED_BYTE) | VAR_MASK(VAR_PRED_BIT))){
+			memcpy(bytes, sc->pred, hl);
+			byteshuffle_encode(sc->pred + hl, bytes + hl, ch->unit_size, job->seg_lines);
+			if(variants & VAR_MASK(VAR_PRED_BYTE))
+				r |= write_planes(job, sc, VAR_PRED_BYTE, sg, bytes, hl, seg_len);
+			if(variants & VAR_MASK(VAR_PRED_BIT)){
+				memcpy(bits, sc->pred, hl);
+				bitshuffle_encode(bytes + hl, bits + hl, seg_len);
+				r |= write_planes(job, sc, VAR_PRED_BIT, sg, bits, hl, seg_len);
+				}
+			}
+		}
+	return r;
+}
+
+static int pwrite_all(int fd, const BYTE *buf, size_t len, uint64_t off)
+{
+	while(len){
+		ssize_t n = pwrite(fd, buf, len, off);
+		if(n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+		off += n;
+		}
+	return 0;
+}
+
+static int pread_all(int fd, BYTE *buf, size_t len, uint64_t off)
+{
+	while(len){
+		ssize_t n = pread(fd, buf, len, off);
+		if(n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+		off += n;
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * window_write()
+ *  Place the <cnt> records [w0, w0+cnt) of a transform into the segment
+ *  file <fd> at the offsets they have in the whole-segment layout.  For
+ *  planes, window chunk j (bytes[j*cnt ..]) belongs at j*n + w0; for bit
+ *  planes every 8-byte group is independent, so bit plane p of chunk j
+ *  belongs at p*round + (j*n + w0)/8, round = n*es/8.
+ *------------------------------------------------------------------------*/
+static int window_write(int fd, PIPE_VARIANT v, const BYTE *in, BYTE *bytes, BYTE *bits,
+			size_t es, uint64_t n, uint64_t w0, size_t cnt)
+{
+	uint64_t round = n*es/8;
+	size_t j, p;
+
+	switch(v){
+		case VAR_RAW:
+		case VAR_DIFF:
+			return pwrite_all(fd, in, cnt*es, w0*es);
+		case VAR_BYTE:
+		case VAR_DIFF_BYTE:
+			for(j=0;j<es;j++)
+				if(pwrite_all(fd, bytes + j*cnt, cnt, j*n + w0))
+					return -1;
+			return 0;
+		case VAR_BIT:
+		case VAR_DIFF_BIT:
+			for(j=0;j<es;j++){
+				bitshuffle_encode(bytes + j*cnt, bits, cnt);
+				for(p=0;p<8;p++)
+					if(pwrite_all(fd, bits + p*(cnt/8), cnt/8, p*round + (j*n + w0)/8))
+						return -1;
+				}
+			return 0;
+		default:
+			return -1;
+		}
+}
+
+/*------------------------------------------------------------------------
+ * stream_segment()
+ *  Segment <s> read from the input file one window at a time.  A segment
+ *  that fits in one window goes through pipeline_segment() like in batch
+ *  mode; longer ones are assembled in the plain files window by window.
+ *------------------------------------------------------------------------*/
+static int stream_segment(const PIPE_JOB *job, int s, PIPE_SCRATCH *sc)
+{
+	const PIPE_CHANNEL *ch = job->ch;
+	size_t es = ch->unit_size;
+	uint64_t first = (uint64_t)s * job->seg_lines;
+	uint64_t n = job->seg_lines, w0;
+	BYTE prev[sizeof(DWORD)];
+	int fd[VAR_MAX], v, has_prev = 0, ret = -1;
+
+	if(s > 0 && (job->variants & VAR_DIFF_ANY)){
+		if(pread_all(job->in_fd, prev, es, (first - 1)*es))
+			return -1;
+		has_prev = 1;
+		}
+	if(n <= job->window){
+		if(pread_all(job->in_fd, sc->in, job->seg_len, first*es))
+			return -1;
+		return pipeline_segment(job, s, sc->in, has_prev ? prev : NULL, sc);
+		}
+
+	for(v=0;v<VAR_MAX;v++)
+		fd[v] = -1;
+	for(v=0;v<VAR_MAX;v++){
+		char filename[512];
+		if(!(job->variants & VAR_MASK(v)))
+			continue;
+		snprintf(filename, sizeof(filename), "%s.%02d", ch->result[v], s);
+		fd[v] = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if(fd[v] < 0){
+			printf("%s failed, open %s!!!\n", __FUNCTION__, filename);
+			goto err;
+			}
+		}
+	for(w0=0;w0<n;w0+=job->window){
+		size_t cnt = (n - w0 < job->window) ? n - w0 : job->window;
+		if(pread_all(job->in_fd, sc->in, cnt*es, (first + w0)*es))
+			goto err;
+		if(fd[VAR_RAW] >= 0 && window_write(fd[VAR_RAW], VAR_RAW, sc->in, NULL, NULL, es, n, w0, cnt))
+			goto err;
+		if(fd[VAR_BYTE] >= 0 || fd[VAR_BIT] >= 0){
+			byteshuffle_encode(sc->in, sc->bytes, es, cnt);
+			for(v=VAR_BYTE;v<=VAR_BIT;v++)
+				if(fd[v] >= 0 && window_write(fd[v], v, NULL, sc->bytes, sc->bits, es, n, w0, cnt))
+					goto err;
+			}
+		if(job->variants & VAR_DIFF_ANY){
+			if(segment_diff(ch, sc->in, has_prev ? prev : NULL, sc->diff, cnt))
+				goto err;
+			memcpy(prev, sc->in + (cnt-1)*es, es);
+			has_prev = 1;
+			if(fd[VAR_DIFF] >= 0 && window_write(fd[VAR_DIFF], VAR_DIFF, sc->diff, NULL, NULL, es, n, w0, cnt))
+				goto err;
+			if(fd[VAR_DIFF_BYTE] >= 0 || fd[VAR_DIFF_BIT] >= 0){
+				byteshuffle_encode(sc->diff, sc->bytes, es, cnt);
+				for(v=VAR_DIFF_BYTE;v<=VAR_DIFF_BIT;v++)
+					if(fd[v] >= 0 && window_write(fd[v], v, NULL, sc->bytes, sc->bits, es, n, w0, cnt))
+						goto err;
+				}
+			}
+		}
+	ret = 0;
+err:
+	for(v=0;v<VAR_MAX;v++)
+		if(fd[v] >= 0)
+			close(fd[v]);
+	return ret;
+}
+
+/* Pool worker: own scratch tiles, pulls segments until none are left    */
+static void *pipeline_worker(void *arg)
+{
+	PIPE_JOB *job = arg;
+	PIPE_SCRATCH sc;
+	int s;
+
+	memset(&sc, 0, sizeof(sc));
+	sc.cap = job->in_fd >= 0 ? job->window * job->ch->unit_size : job->seg_len;
+	sc.bytes = malloc(sc.cap + sizeof(PRED_HEADER));
+	sc.bits = malloc(sc.cap + sizeof(PRED_HEADER));
+	sc.diff = (job->variants & VAR_DIFF_ANY) ? malloc(sc.cap) : NULL;
+	sc.pred = (job->variants & VAR_PRED_ANY) ? malloc(sc.cap + sizeof(PRED_HEADER)) : NULL;
+	sc.in = job->in_fd >= 0 ? malloc(sc.cap) : NULL;
+	sc.pmap = (job->enc && job->enc->elide)
+		? malloc(sc.cap + sizeof(PRED_HEADER) + PMAP_OVERHEAD(PMAP_MAX_PLANES)) : NULL;
+	if(!sc.bytes || !sc.bits || ((job->variants & VAR_DIFF_ANY) && !sc.diff)
+		|| ((job->variants & VAR_PRED_ANY) && !sc.pred) || (job->in_fd >= 0 && !sc.in)
+		|| (job->enc && job->enc->elide && !sc.pmap)){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		goto err;
+		}
+	while(!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)){
+		int r;
+		s = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+		if(s >= job->segments)
+			break;
+		if(job->in_fd >= 0)
+			r = stream_segment(job, s, &sc);
+		else
+			r = pipeline_segment(job, s, job->puis + s*job->seg_len,
+					s ? job->puis + s*job->seg_len - job->ch->unit_size : NULL, &sc);
+		if(r != 0)
+			__atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+		}
+	__atomic_add_fetch(&job->planes, sc.planes, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&job->elided, sc.elided, __ATOMIC_RELAXED);
+err:
+	free(sc.in);
+	free(sc.bytes);
+	free(sc.bits);
+	free(sc.diff);
+	free(sc.pred);
+	free(sc.pmap);
+	return NULL;
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_prepare()
+ *  Checks shared by both modes, and the variant mask narrowed to what
+ *  the channel and the segment size allow.
+ *------------------------------------------------------------------------*/
+static int pipeline_prepare(PIPE_JOB *job, const PIPE_CHANNEL *ch, uint64_t lines, int segments,
+			unsigned variants, const PIPE_ENCODER *enc)
+{
+	int v;
+
+	if(!ch || lines == 0 || segments <= 0){
+		printf("%s, invalid parameters\n", __FUNCTION__);
+		return -1;
+		}
+	if(lines%segments != 0){
+		printf("%s failed, lines %llu, segments %d\n", __FUNCTION__,
+			(unsigned long long)lines, segments);
+		return -1;
+		}
+	for(v=0;v<VAR_MAX;v++)
+		if(!ch->result[v])
+			variants &= ~VAR_MASK(v);
+	if(ch->unit_size != 2 && ch->unit_size != 4)
+		variants &= ~(VAR_DIFF_ANY | VAR_PRED_ANY);
+	if(!(ch->predictors & PRED_ALL))
+		variants &= ~VAR_PRED_ANY;
+
+	memset(job, 0, sizeof(*job));
+	job->ch = ch;
+	job->enc = enc;
+	job->in_fd = -1;
+	job->segments = segments;
+	job->seg_lines = lines/segments;
+	job->seg_len = job->seg_lines * ch->unit_size;
+	if((variants & VAR_BIT_ANY) && job->seg_lines%8 != 0){
+		printf("%s, lines should be mod by 8\n", __FUNCTION__);
+		variants &= ~VAR_BIT_ANY;
+		}
+	job->variants = variants;
+	return 0;
+}
+
+/* Run <job> on <workers> pool threads                                   */
+static int pipeline_pool(PIPE_JOB *job, int workers)
+{
+	int t, started;
+	pthread_t *tid;
+
+	if(workers <= 0)
+		workers = online_cpus();
+	if(workers > job->segments)
+		workers = job->segments;
+	if(workers == 1)
+		pipeline_worker(job);
+	else{
+		tid = calloc(workers, sizeof(*tid));
+		if(!tid){
+			printf("%s, malloc failed\n", __FUNCTION__);
+			return -1;
+			}
+		for(t=0, started=0;t<workers;t++)
+			if(pthread_create(&tid[started], NULL, pipeline_worker, job) == 0)
+				started++;
+		if(started == 0)
+			pipeline_worker(job);
+		for(t=0;t<started;t++)
+			pthread_join(tid[t], NULL);
+		free(tid);
+		}
+	/* one line per channel for what -e left out                         */
+	if(!job->failed && job->planes)
+		printf("%s, %s: %llu of %llu byte / bit planes elided\n", __FUNCTION__,
+			job->ch->result[VAR_BYTE] ? job->ch->result[VAR_BYTE] : "channel",
+			(unsigned long long)job->elided, (unsigned long long)job->planes);
+	return job->failed ? -1 : 0;
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_run()
+ *  Segments are independent, <workers> threads (<=0: online CPUs, never
+ *  more than <segments>) take them in turn.  Every segment writes its
+ *  own files, so the outputs do not depend on the worker count.
+ *------------------------------------------------------------------------*/
+int pipeline_run(const PIPE_CHANNEL *ch, const BYTE *puis, int lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int workers)
+{
+	PIPE_JOB job;
+
+	if(!puis || lines <= 0 || pipeline_prepare(&job, ch, lines, segments, variants, enc) != 0)
+		return -1;
+	job.puis = puis;
+	return pipeline_pool(&job, workers);
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_stream()
+ *  Four window-sized tiles per worker (input, byte planes, bit planes,
+ *  difference), one more each with the predictor residuals and with the
+ *  plane maps, must fit in <mem_limit> bytes; windows are a multiple of
+ *  8 records so bit planes can be placed window by window.
+ *------------------------------------------------------------------------*/
+int pipeline_stream(const PIPE_CHANNEL *ch, const char *binfile, uint64_t lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int workers, uint64_t mem_limit)
+{
+	PIPE_JOB job;
+	struct stat st;
+	int ret, tiles;
+
+	if(!binfile || pipeline_prepare(&job, ch, lines, segments, variants, enc) != 0)
+		return -1;
+	if(workers <= 0)
+		workers = online_cpus();
+	if(workers > segments)
+		workers = segments;
+
+	tiles = 4 + ((job.variants & VAR_PRED_ANY) ? 1 : 0) + ((enc && enc->elide) ? 1 : 0);
+	job.window = mem_limit / workers / (tiles * ch->unit_size) / 8 * 8;
+	if(job.window < job.seg_lines && (job.variants & VAR_PRED_ANY)){
+		/* predictor selection needs the whole segment                  */
+		printf("%s, pred variants skipped, segments larger than a window\n", __FUNCTION__);
+		job.variants &= ~VAR_PRED_ANY;
+		tiles--;
+		job.window = mem_limit / workers / (tiles * ch->unit_size) / 8 * 8;
+		}
+	if(job.window < 8){
+		printf("%s, memory limit %llu too small for %d workers\n", __FUNCTION__,
+			(unsigned long long)mem_limit, workers);
+		return -1;
+		}
+	if(job.window >= job.seg_lines)
+		job.window = job.seg_lines;
+	else if(job.seg_lines%8 != 0){
+		printf("%s, segment of %llu records is not a multiple of 8\n", __FUNCTION__,
+			(unsigned long long)job.seg_lines);
+		return -1;
+		}
+	else if(enc && ((enc->outputs & ~OUT_MASK(OUT_PLAIN)) || enc->elide || enc->archive)){
+		printf("%s, segments larger than a window are written plain only, to files\n", __FUNCTION__);
+		return -1;
+		}
+
+	job.in_fd = open(binfile, O_RDONLY);
+	if(job.in_fd < 0){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, binfile);
+		return -1;
+		}
+	if(fstat(job.in_fd, &st) != 0 || (uint64_t)st.st_size < lines * ch->unit_size){
+		printf("%s, %s holds fewer than %llu records\n", __FUNCTION__, binfile,
+			(unsigned long long)lines);
+		close(job.in_fd);
+		return -1;
+		}
+	printf("%s, %llu records, %d workers, window %llu records\n", __FUNCTION__,
+		(unsigned long long)lines, workers, (unsigned long long)job.window);
+	ret = pipeline_pool(&job, workers);
+	close(job.in_fd);
+	return ret;
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_scaling()
+ *  Run the same job with 1, 2, 4 ... <max_workers> workers and print the
+ *  wall time and speed-up of each, the last run leaves the outputs.  A
+ *  segment is one worker's task, more workers than <segments> would idle.
+ *------------------------------------------------------------------------*/
+int pipeline_scaling(const PIPE_CHANNEL *ch, const BYTE *puis, int lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int max_workers)
+{
+	double base = 0;
+	int w;
+
+	if(max_workers <= 0)
+		max_workers = online_cpus();
+	if(max_workers > segments)
+		max_workers = segments;
+	printf("%s, workers, seconds, speedup\n", __FUNCTION__);
+	for(w=1;;w*=2){
+		if(w > max_workers)
+			w = max_workers;
+		double t0 = now_seconds();
+		if(pipeline_run(ch, puis, lines, segments, variants, enc, w) != 0)
+			return -1;
+		double elapsed = now_seconds() - t0;
+		if(w == 1)
+			base = elapsed;
+		printf("%s, %d, %.4f, %.2f\n", __FUNCTION__, w, elapsed,
+			elapsed > 0 ? base / elapsed : 0.0);
+		if(w == max_workers)
+			break;
+		}
+	return 0;
+}
+
+/*------------------------------------------------------------------------
+ * pipeline_decode_output()
+ *  Inverse of the encoders of write_variant(); deflate streams carry
+ *  their window size, so the largest window reads them all.
+ *------------------------------------------------------------------------*/
+int pipeline_decode_output(PIPE_VARIANT v, PIPE_OUTPUT o, const BYTE *in, size_t len,
+		BYTE **out, size_t *out_len)
+{
+	size_t hl = (VAR_MASK(v) & VAR_PRED_ANY) ? sizeof(PRED_HEADER) : 0;
+	BITPACK_HEADER bh;
+	unsigned char *body;
+	size_t n;
+
+	*out = NULL;
+	*out_len = 0;
+	switch(o){
+		case OUT_PLAIN:
+			*out = malloc(len ? len : 1);
+			if(!*out)
+				break;
+			memcpy(*out, in, len);
+			*out_len = len;
+			return 0;
+		case OUT_DEFLATE:
+			if(mydeflate_decompress(in, len, out, out_len, 15) == Z_OK)
+				return 0;
+			break;
+		case OUT_SZR:
+			if(szr_expand(in, len, out, out_len) == 0)
+				return 0;
+			break;
+		case OUT_BITPACK:
+			if(len < hl + sizeof(bh))
+				break;
+			memcpy(&bh, in + hl, sizeof(bh));
+			if(bh.unit_size != 2 && bh.unit_size != 4)
+				break;
+			*out = malloc(hl + (size_t)bh.count * bh.unit_size + 1);
+			if(!*out)
+				break;
+			memcpy(*out, in, hl);
+			if(bitpack_decode(in + hl, len - hl, *out + hl, (size_t)bh.count * bh.unit_size, &n) != 0)
+				break;
+			*out_len = hl + n * bh.unit_size;
+			return 0;
+		case OUT_ENTROPY:
+			if(len < hl || pent_decode(in + hl, len - hl, &body, &n) != 0)
+				break;
+			*out = malloc(hl + n + 1);
+			if(!*out){
+				free(body);
+				break;
+				}
+			memcpy(*out, in, hl);
+			memcpy(*out + hl, body, n);
+			free(body);
+			*out_len = hl + n;
+			return 0;
+		case OUT_CHAIN:
+			if(chain_decode(in, len, out, out_len) == 0)
+				return 0;
+			break;
+		default:
+			break;
+		}
+	printf("%s, %s %s: %llu bytes do not decode\n", __FUNCTION__,
+		pipeline_variant_name(v), pipeline_output_name(o), (unsigned long long)len);
+	free(*out);
+	*out = NULL;
+	*out_len = 0;
+	return -1;
+}
@@ -0,0 +1,122 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "pre_processing.h"
+#include "delta.h"
+#include "predictor.h"
+#include "chain.h"
+#include "archive.h"
+
+/*------------------------------------------------------------------------
+ * Fused segment pipeline
+ *  Every segment is visited once; all requested variants are produced
+ *  from the resident segment and a per-segment delta tile, the caller's
+ *  buffer is never modified.
+ *------------------------------------------------------------------------*/
+typedef enum {
+	VAR_RAW = 0,	/* records as they are                                */
+	VAR_BYTE,	/* byte planes                                        */
+	VAR_BIT,	/* bit planes of the byte planes                      */
+	VAR_DIFF,	/* first-order difference                             */
+	VAR_DIFF_BYTE,	/* byte planes of the difference                      */
+	VAR_DIFF_BIT,	/* bit planes of the difference                       */
+	VAR_PRED,	/* residuals of the predictor chosen per segment      */
+	VAR_PRED_BYTE,	/* byte planes of the residuals                       */
+	VAR_PRED_BIT,	/* bit planes of the residuals                        */
+	VAR_MAX
+} PIPE_VARIANT;
+
+#define VAR_MASK(v)	(1u << (v))
+#define VAR_ALL		(VAR_MASK(VAR_MAX) - 1)
+#define VAR_DIFF_ANY	(VAR_MASK(VAR_DIFF) | VAR_MASK(VAR_DIFF_BYTE) | VAR_MASK(VAR_DIFF_BIT))
+#define VAR_PRED_ANY	(VAR_MASK(VAR_PRED) | VAR_MASK(VAR_PRED_BYTE) | VAR_MASK(VAR_PRED_BIT))
+#define VAR_BIT_ANY	(VAR_MASK(VAR_BIT) | VAR_MASK(VAR_DIFF_BIT) | VAR_MASK(VAR_PRED_BIT))
+/* raw .. diff_bit, what is written when no variants are asked for       */
+#define VAR_CLASSIC	(VAR_MASK(VAR_PRED) - 1)
+
+/* What is written per variant and segment                               */
+typedef enum {
+	OUT_PLAIN = 0,	/* "<result>.NN", the transform as is                  */
+	OUT_DEFLATE,	/* "<result>.NN.z", libmydeflate                       */
+	OUT_SZR,	/* "<result>.NN.s", libszr zero-run suppression        */
+	OUT_BITPACK,	/* "<result>.NN.p", frame-of-reference bit packing     */
+	OUT_ENTROPY,	/* "<result>.NN.e", libpent per-plane Huffman          */
+	OUT_CHAIN,	/* "<result>.NN.c", PIPE_ENCODER.chain, see chain.h    */
+	OUT_MAX
+} PIPE_OUTPUT;
+
+#define OUT_MASK(o)	(1u << (o))
+
+typedef struct {
+	unsigned   outputs;		/* OUT_MASK() set                            */
+	int        wbits;		/* deflate windowBits 8..15                  */
+	int        mlevel;		/* deflate memLevel 1..9                     */
+	int        elide;		/* byte / bit variants as a plane map        */
+	const CODEC_CHAIN *chain;	/* OUT_CHAIN stages                          */
+	ARCHIVE_WRITER *archive;	/* outputs appended here, NULL: files        */
+} PIPE_ENCODER;
+
+typedef struct {
+	int        unit_size;		/* 2 (WORD), 4 (DWORD) or 10 (BIN_PUI)       */
+	DELTA_MAP  diff_map;		/* mapping of the first-order difference     */
+	const char *result[VAR_MAX];	/* file prefix per variant, NULL: n/a       */
+	unsigned   predictors;		/* PRED_MASK() set the pred variants try     */
+	uint32_t   lag;			/* lag predictors, 0: estimated per segment  */
+	int        id;			/* ARCHIVE_ENTRY.channel                     */
+} PIPE_CHANNEL;
+
+/* "raw,byte,diff_bit" -> variant mask, 0 on unknown names               */
+unsigned pipeline_parse_variants(const char *list);
+const char *pipeline_variant_name(PIPE_VARIANT v);
+
+/* "plain,deflate,szr,bitpack,entropy,chain" -> output mask, 0 on unknown
+ * names                                                                 */
+unsigned pipeline_parse_outputs(const char *list);
+const char *pipeline_output_name(PIPE_OUTPUT o);
+
+/*------------------------------------------------------------------------
+ * pipeline_decode_output()
+ *  The <len> bytes output <o> wrote for variant <v> back to the variant
+ *  file as "<result>.NN" holds it (plane map included when elided).
+ *  *out is malloc()ed, owned by the caller.  Returns 0, or -1.
+ *------------------------------------------------------------------------*/
+int pipeline_decode_output(PIPE_VARIANT v, PIPE_OUTPUT o, const BYTE *in, size_t len,
+		BYTE **out, size_t *out_len);
+
+/*------------------------------------------------------------------------
+ * pipeline_run()
+ *  Split <lines> records into <segments> equal parts and write every
+ *  variant in <variants> (restricted to those the channel has a result
+ *  file for).  Each segment is handed to the encoders in <enc> in
+ *  memory, only their results reach the disk; NULL writes plain files.
+ *  Segments are processed by a pool of <workers> threads (<=0: online
+ *  CPUs); the files written are the same for any worker count.  With
+ *  <enc>->archive they are appended to the archive instead, in the order
+ *  the workers finish them; the directory names every one, so only the
+ *  order differs from run to run.
+ *  The pred variants start with a PRED_HEADER naming the predictor that
+ *  left the smallest residuals on that segment.  With <enc>->elide the
+ *  byte and bit variants are planemap_encode()d before the encoders see
+ *  them (behind the PRED_HEADER for pred_byte / pred_bit): all-zero and
+ *  constant planes are only recorded in the map.
+ *------------------------------------------------------------------------*/
+int pipeline_run(const PIPE_CHANNEL *ch, const BYTE *puis, int lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int workers);
+
+/*------------------------------------------------------------------------
+ * pipeline_stream()
+ *  Same outputs as pipeline_run() on the records of <binfile>, which is
+ *  read window by window so that the tiles of all workers stay within
+ *  <mem_limit> bytes.  Segments longer than a window are only written
+ *  plain, without plane maps and without the pred variants.
+ *------------------------------------------------------------------------*/
+int pipeline_stream(const PIPE_CHANNEL *ch, const char *binfile, uint64_t lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int workers, uint64_t mem_limit);
+
+/* pipeline_run() with 1, 2, 4 ... <max_workers> workers, prints timings  */
+int pipeline_scaling(const PIPE_CHANNEL *ch, const BYTE *puis, int lines, int segments,
+		unsigned variants, const PIPE_ENCODER *enc, int max_workers);
+
+#endif
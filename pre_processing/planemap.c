@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "planemap.h"
+
+/* Last byte first, most data planes differ there already; memcmp() of
+ * the plane against itself one byte on is the vector compare            */
+static PMAP_CLASS classify(const uint8_t *p, size_t len)
+{
+	if(len == 0)
+		return PMAP_ZERO;
+	if(p[len-1] != p[0] || memcmp(p, p + 1, len - 1))
+		return PMAP_DATA;
+	return p[0] ? PMAP_CONST : PMAP_ZERO;
+}
+
+int planemap_encode(const uint8_t *in, int nplanes, size_t plane_len,
+			uint8_t *out, size_t *out_len, int *elided)
+{
+	PMAP_HEADER hdr;
+	uint8_t *map, *val, *data;
+	int p, nconst = 0, nskip = 0;
+
+	if(!in || !out || !out_len || nplanes <= 0 || nplanes > PMAP_MAX_PLANES
+		|| plane_len > UINT32_MAX){
+		printf("%s, invalid %d planes of %zu bytes\n", __FUNCTION__, nplanes, plane_len);
+		return -1;
+		}
+	memcpy(hdr.magic, PMAP_MAGIC, sizeof(hdr.magic));
+	hdr.nplanes = nplanes;
+	hdr.reserved = 0;
+	hdr.plane_len = plane_len;
+	memcpy(out, &hdr, sizeof(hdr));
+	map = out + sizeof(hdr);
+	memset(map, 0, (nplanes + 3)/4);
+
+	/* classes first, the constant values go in before the data          */
+	for(p=0;p<nplanes;p++){
+		PMAP_CLASS c = classify(in + p*plane_len, plane_len);
+		map[p/4] |= c << (2*(p%4));
+		if(c == PMAP_CONST)
+			nconst++;
+		if(c != PMAP_DATA)
+			nskip++;
+		}
+	val = map + (nplanes + 3)/4;
+	data = val + nconst;
+	for(p=0;p<nplanes;p++){
+		const uint8_t *plane = in + p*plane_len;
+		switch((map[p/4] >> (2*(p%4))) & 3){
+			case PMAP_CONST:
+				*val++ = plane[0];
+				break;
+			case PMAP_DATA:
+				memcpy(data, plane, plane_len);
+				data += plane_len;
+				break;
+			default:
+				break;
+			}
+		}
+	*out_len = data - out;
+	if(elided)
+		*elided = nskip;
+	return 0;
+}
+
+/* Header and class map of <in> checked against <in_len>                */
+static int map_check(const uint8_t *in, size_t in_len, PMAP_HEADER *hdr, int *nconst,
+			size_t *total)
+{
+	const uint8_t *map;
+	size_t need;
+	int p, ndata = 0;
+
+	*nconst = 0;
+	if(!in || in_len < sizeof(*hdr))
+		return -1;
+	memcpy(hdr, in, sizeof(*hdr));
+	if(memcmp(hdr->magic, PMAP_MAGIC, sizeof(hdr->magic)) || hdr->reserved
+		|| in_len < PMAP_OVERHEAD(hdr->nplanes)){
+		printf("%s, not a plane map\n", __FUNCTION__);
+		return -1;
+		}
+	map = in + sizeof(*hdr);
+	for(p=0;p<hdr->nplanes;p++){
+		switch((map[p/4] >> (2*(p%4))) & 3){
+			case PMAP_ZERO:
+				break;
+			case PMAP_CONST:
+				(*nconst)++;
+				break;
+			case PMAP_DATA:
+				ndata++;
+				break;
+			default:
+				printf("%s, bad class of plane %d\n", __FUNCTION__, p);
+				return -1;
+			}
+		}
+	need = PMAP_OVERHEAD(hdr->nplanes) + *nconst + (size_t)ndata * hdr->plane_len;
+	if(need != in_len){
+		printf("%s, %zu bytes for a map of %zu\n", __FUNCTION__, in_len, need);
+		return -1;
+		}
+	*total = (size_t)hdr->nplanes * hdr->plane_len;
+	return 0;
+}
+
+int planemap_size(const uint8_t *in, size_t in_len, size_t *size)
+{
+	PMAP_HEADER hdr;
+	int nconst;
+
+	return map_check(in, in_len, &hdr, &nconst, size);
+}
+
+int planemap_decode(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap,
+			size_t *out_len)
+{
+	PMAP_HEADER hdr;
+	const uint8_t *map, *val, *data;
+	size_t total;
+	int p, nconst;
+
+	if(!out || !out_len || map_check(in, in_len, &hdr, &nconst, &total) != 0)
+		return -1;
+	if(total > out_cap){
+		printf("%s, %zu bytes of planes, %zu bytes of room\n", __FUNCTION__, total, out_cap);
+		return -1;
+		}
+	map = in + sizeof(hdr);
+	val = map + (hdr.nplanes + 3)/4;
+	data = val + nconst;
+	for(p=0;p<hdr.nplanes;p++){
+		uint8_t *plane = out + (size_t)p*hdr.plane_len;
+		switch((map[p/4] >> (2*(p%4))) & 3){
+			case PMAP_ZERO:
+				memset(plane, 0, hdr.plane_len);
+				break;
+			case PMAP_CONST:
+				memset(plane, *val++, hdr.plane_len);
+				break;
+			default:
+				memcpy(plane, data, hdr.plane_len);
+				data += hdr.plane_len;
+				break;
+			}
+		}
+	*out_len = total;
+	return 0;
+}
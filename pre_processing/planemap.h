@@ -0,0 +1,53 @@
+#ifndef PLANEMAP_H
+#define PLANEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Plane elision map
+ *  A buffer of <nplanes> planes of <plane_len> bytes (the byte planes of
+ *  a segment, or the bit planes of each of its byte planes) is stored as
+ *      PMAP_HEADER
+ *      2-bit PMAP_CLASS per plane, plane 0 in the low bits of byte 0
+ *      one value byte per PMAP_CONST plane, in plane order
+ *      the PMAP_DATA planes, in plane order
+ *  so a plane that is all zero or one repeated byte costs no payload.
+ *------------------------------------------------------------------------*/
+typedef enum {
+	PMAP_ZERO = 0,	/* every byte 0                                       */
+	PMAP_CONST,	/* every byte the same, non-zero                      */
+	PMAP_DATA	/* stored as is                                       */
+} PMAP_CLASS;
+
+#define PMAP_MAGIC	"PM"
+#define PMAP_MAX_PLANES	255
+
+#pragma pack(push,1)
+typedef struct {
+	char     magic[2];
+	uint8_t  nplanes;
+	uint8_t  reserved;	/* 0                                         */
+	uint32_t plane_len;	/* bytes per plane                           */
+} PMAP_HEADER;
+#pragma pack(pop)
+
+/* Most planemap_encode() adds to the <nplanes> * <plane_len> input       */
+#define PMAP_OVERHEAD(nplanes)	(sizeof(PMAP_HEADER) + ((nplanes) + 3)/4)
+
+/* <nplanes> planes at <in> -> <out>, which has room for the planes plus
+ * PMAP_OVERHEAD(); *elided (may be NULL) is the number of planes left
+ * out.  Returns 0, or -1 on invalid arguments.                          */
+int planemap_encode(const uint8_t *in, int nplanes, size_t plane_len,
+			uint8_t *out, size_t *out_len, int *elided);
+
+/* Check the map of <in_len> bytes, *size the planes it rebuilds to.
+ * Returns 0, or -1 on a malformed map.                                  */
+int planemap_size(const uint8_t *in, size_t in_len, size_t *size);
+
+/* Rebuild all planes into <out> (<out_cap> bytes), *out_len is
+ * nplanes * plane_len.  Returns 0, or -1 on a malformed map.             */
+int planemap_decode(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap,
+			size_t *out_len);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef PRE_PROCESSING_H
+#define PRE_PROCESSING_H
+
+/*  Types shared by the pre_processing modules                            */
+
+#define PRINT_SAMPLE_LINES 10 /* how many lines to show for demo      */
+
+typedef unsigned char BYTE;
+typedef unsigned short WORD;
+typedef unsigned int DWORD;
+
+
+typedef struct struct_raw_pui
+{
+    int index;
+    double p;
+	double u;
+	double i;
+}RAW_PUI;
+
+typedef struct struct_bin_pui
+{
+  	DWORD p;     /* power   scaled by 10   -> 4 bytes                     */
+	WORD u; /* voltage scaled by 10   -> 2 bytes                     */
+	DWORD i;/* current scaled by 1000 -> 4 bytes                     */
+}__attribute__ ((packed)) BIN_PUI;
+
+#endif
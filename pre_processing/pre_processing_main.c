@@ -2,7 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "pre_processing.h"
+#include "csv_ingest.h"
+#include "bitshuffle.h"
+#include "byteshuffle.h"
+#include "pipeline.h"
+#include "planemap.h"
+#include "xorfloat.h"
 
 /*  CSV format (text mode)  - A-phase power (pa), voltage (ua), current (ia)
 *  Format:
@@ -56,40 +66,85 @@
 #define DIFF_BYTE_RESULT_FILE_I "out/diff_byte_i.res"
 #define DIFF_BIT_RESULT_FILE_I "out/diff_bit_i.res"
 
+/*   Predictor residual result (plain & byte/bit)                            */
+#define PRED_RESULT_FILE_P "out/pred_p.res"
+#define PRED_RESULT_FILE_U "out/pred_u.res"
+#define PRED_RESULT_FILE_I "out/pred_i.res"
+#define PRED_BYTE_RESULT_FILE_P "out/pred_byte_p.res"
+#define PRED_BIT_RESULT_FILE_P "out/pred_bit_p.res"
+#define PRED_BYTE_RESULT_FILE_U "out/pred_byte_u.res"
+#define PRED_BIT_RESULT_FILE_U "out/pred_bit_u.res"
+#define PRED_BYTE_RESULT_FILE_I "out/pred_byte_i.res"
+#define PRED_BIT_RESULT_FILE_I "out/pred_bit_i.res"
+
+/*   Lossless result (-x), the CSV doubles through the XOR float codec        */
+#define XOR_RESULT_FILE_P "out/xor_p.res"
+#define XOR_RESULT_FILE_U "out/xor_u.res"
+#define XOR_RESULT_FILE_I "out/xor_i.res"
+
 /* File for round-trip verify (bit → byte)                                 */
 #define BYTE_REVERSE_FILE "byte_reverse.b"
 
 
-#define PRINT_SAMPLE_LINES 10 /* how many lines to show for demo      */
 #define BYTE_CONVERSION 0
 #define BIT_CONVERSION 1
 
-typedef unsigned char BYTE;
-typedef unsigned short WORD;
-typedef unsigned int DWORD;
-
-
-typedef struct struct_raw_pui
-{
-    int index;
-    double p;
-	double u;
-	double i;
-}RAW_PUI;
-
-typedef struct struct_bin_pui
-{
-  	DWORD p;     /* power   scaled by 10   -> 4 bytes                     */
-	WORD u; /* voltage scaled by 10   -> 2 bytes                     */
-	DWORD i;/* current scaled by 1000 -> 4 bytes                     */
-}__attribute__ ((packed)) BIN_PUI;
-
 
 void usage()
 {
 	printf("Usage:\n");
 	printf("\t ./pre_reassemble\n");
-	printf("\t ./pre_reassemble <lines>\n");
+	printf("\t ./pre_reassemble [-t threads] [-j workers] [-S] [-s size] [-b] [-c channels] [-v variants] [-P predictors] [-L lag] [-z outputs [-w bits] [-m level] [-C chain]] [-e] [-A file] [-x] [-D file] [-R file] <lines>\n");
+	printf("\t   -t  CSV parse threads (default: online CPUs)\n");
+	printf("\t   -j  segment workers (default: online CPUs)\n");
+	printf("\t   -S  report the segment stage scaling from 1 to -j workers (at most\n");
+	printf("\t       one per segment), one channel after the other\n");
+	printf("\t   -s  streaming mode, convert the CSV and read the channel file in\n");
+	printf("\t       windows within <size> bytes, or with a K/M/G suffix\n");
+	printf("\t   -b  skip the CSV, use the existing binary input files\n");
+	printf("\t   -C  codec chain for -z chain, comma separated stages, e.g.\n");
+	printf("\t       delta:zigzag,byte,bit,szr,deflate:15:8; stages: delta[:signmag|zigzag],\n");
+	printf("\t       zigzag, byte[:size], bit, pmap[:planes], bitpack, szr,\n");
+	printf("\t       deflate[:bits[:level]], entropy[:plane_len]\n");
+	printf("\t   -D  decode the chain file <file> (any .NN.c) into <file>.dec and exit\n");
+	printf("\t   -x  lossless: the CSV doubles p/u/i through the XOR float codec into\n");
+	printf("\t       out/xor_*.res, then read back and checked; nothing else is run\n");
+	printf("\t   -c  channels, comma separated p,u,i,puis (default: all)\n");
+	printf("\t   -v  variants to write, comma separated (default: raw .. diff_bit)\n");
+	printf("\t       raw,byte,bit,diff,diff_byte,diff_bit,pred,pred_byte,pred_bit, or all\n");
+	printf("\t   -P  predictors the pred variants choose from per segment (default: all)\n");
+	printf("\t       none,delta,dod,xor,lag,lag_delta\n");
+	printf("\t   -L  lag of the lag predictors in records (default: estimated per segment)\n");
+	printf("\t   -z  what to write per segment, comma separated (default: plain)\n");
+	printf("\t       plain (.NN), deflate (.NN.z), szr (.NN.s),\n");
+	printf("\t       bitpack (.NN.p, raw/diff/pred of WORD and DWORD channels)\n");
+	printf("\t       entropy (.NN.e, a Huffman table per byte/bit plane)\n");
+	printf("\t       chain (.NN.c, the -C chain, where its lane / plane stages\n");
+	printf("\t       fit the data)\n");
+	printf("\t   -w  deflate windowBits 8..15 (default: 15)\n");
+	printf("\t   -m  deflate memLevel 1..9 (default: 8)\n");
+	printf("\t   -e  write byte/bit variants as a plane map, all-zero and constant\n");
+	printf("\t       planes left out of the payload\n");
+	printf("\t   -A  write every segment output into the archive <file> instead of\n");
+	printf("\t       out/*.res.NN*, with a directory of offsets, records and ranges\n");
+	printf("\t   -R  list the archive <file> and decode every segment with -j workers,\n");
+	printf("\t       then exit\n");
+}
+
+/*------------------------------------------------------------------------
+ * parse_size() - "512K", "64M", "2G" or plain bytes
+ *------------------------------------------------------------------------*/
+uint64_t parse_size(const char *arg)
+{
+	char *end;
+	uint64_t v=strtoull(arg, &end, 0);
+	switch(*end){
+		case 'g': case 'G': v<<=10; /* fall through */
+		case 'm': case 'M': v<<=10; /* fall through */
+		case 'k': case 'K': v<<=10; break;
+		default: break;
+		}
+	return v;
 }
 
 /*------------------------------------------------------------------------
@@ -119,97 +174,179 @@ void raw2bin(RAW_PUI * raw, BIN_PUI * pui)
  *      b) p channel     -> BIN_INPUT_FILE_P
  *      c) u channel     -> BIN_INPUT_FILE_U
  *      d) i channel     -> BIN_INPUT_FILE_I
+ *  The CSV is parsed by csv_ingest() (mmap, <threads> workers, direct
+ *  decimal to fixed-point), each file is written with a single fwrite.
+ *  The parsed columns are handed back in <keep>; with <mem_limit> set
+ *  (-s) the CSV is converted window by window and nothing is kept.
  *------------------------------------------------------------------------*/
-int prepare_binary_pui_file(char * rawfile, char * binfile, int max_lines)
+int prepare_binary_pui_file(char * rawfile, char * binfile, uint64_t max_lines, int threads,
+				uint64_t mem_limit, PUI_COLUMNS * keep)
 {
-	int ret, lines=0;
-	char raw_file[512]="";
-	char bin_file[512]="";
-	char buf[512]="";
-	RAW_PUI readPUI;
-	BIN_PUI binPUI;
-    FILE * fp=NULL, *fpw=NULL, *fpw_u=NULL,*fpw_p=NULL,*fpw_i=NULL;
-
-	memset(&readPUI, 0x0, sizeof(readPUI));
-	memset(&binPUI, 0x0, sizeof(binPUI));
+	int ret;
+	PUI_COLUMNS cols;
 
 	if(!rawfile || !binfile){
 		printf("%s, invalid parameters\n", __FUNCTION__);
 		return -1;
 	}
-	strncpy(raw_file, rawfile,sizeof(raw_file)-1);
-	raw_file[sizeof(raw_file)-1]=0x0;
-	strncpy(bin_file, binfile,sizeof(bin_file)-1);
-	bin_file[sizeof(bin_file)-1]=0x0;
-	
-	printf("%s, prepare %s from %s\n", __FUNCTION__, bin_file, raw_file);
-    fp=fopen(raw_file, "r");
-    if(!fp){
-        printf("%s failed, open %s!!!\n", __FUNCTION__, raw_file);
-        return -1;
-        }
-    fpw=fopen(bin_file, "wb");
-    if(!fpw){
-        printf("%s failed, open %s!!!\n", __FUNCTION__, bin_file);
-        ret=-1;
-        goto err;
-        }
+	printf("%s, prepare %s from %s\n", __FUNCTION__, binfile, rawfile);
+	if(mem_limit)
+		return csv_ingest_stream(rawfile, max_lines, threads, mem_limit, binfile,
+					BIN_INPUT_FILE_P, BIN_INPUT_FILE_U, BIN_INPUT_FILE_I);
+	ret=csv_ingest(rawfile, max_lines, threads, &cols);
+	if(ret!=0)
+		return ret;
+	ret=csv_ingest_write(&cols, binfile, BIN_INPUT_FILE_P, BIN_INPUT_FILE_U, BIN_INPUT_FILE_I);
+	if(ret==0 && keep)
+		*keep=cols;
+	else
+		csv_ingest_free(&cols);
+	return ret;
+}
 
-    fpw_u=fopen(BIN_INPUT_FILE_U, "wb");
-    if(!fpw_u){
-        printf("%s failed, open %s!!!\n", __FUNCTION__, BIN_INPUT_FILE_U);
-        ret=-1;
-        goto err;
-        }
-    fpw_p=fopen(BIN_INPUT_FILE_P, "wb");
-    if(!fpw_u){
-        printf("%s failed, open %s!!!\n", __FUNCTION__, BIN_INPUT_FILE_P);
-        ret=-1;
-        goto err;
-        }
+/*------------------------------------------------------------------------
+ * parse_raw_pui() - sscanf("%d,%lf,%lf,%lf") == 4, into RAW_PUI
+ *------------------------------------------------------------------------*/
+static int parse_raw_pui(const char *s, RAW_PUI *raw)
+{
+	char *e;
 
-    fpw_i=fopen(BIN_INPUT_FILE_I, "wb");
-    if(!fpw_u){
-        printf("%s failed, open %s!!!\n", __FUNCTION__, BIN_INPUT_FILE_I);
-        ret=-1;
-        goto err;
-        }
-    while(1){
-        if(NULL == fgets(buf,sizeof(buf),fp)){
-                printf("fgets end of file %s\n", raw_file);
-           break;
-            }
-		
-		if (sscanf(buf, "%d,%lf,%lf,%lf", &readPUI.index, &readPUI.p, &readPUI.u, &readPUI.i) != 4) {
-			printf("Invalid line format: %s\n", buf);
-			continue; 
-		}
-		if(lines++<max_lines){
-			raw2bin(&readPUI, &binPUI);
-			fwrite(&binPUI, sizeof(binPUI), 1, fpw);
-			fwrite(&binPUI.p, sizeof(binPUI.p), 1, fpw_p);
-			fwrite(&binPUI.u, sizeof(binPUI.u), 1, fpw_u);
-			fwrite(&binPUI.i, sizeof(binPUI.i), 1, fpw_i);
-		
-			if(readPUI.index<PRINT_SAMPLE_LINES){
-				printf("read %s\n", buf);
-				printf("index %d, p %f, u %f, i %f\n", readPUI.index, readPUI.p,readPUI.u, readPUI.i);;
-				printf("\tp %u, u %u, i %u\n", binPUI.p, binPUI.u, binPUI.i);
-				}
-			}
-        }
+	raw->index=(int)strtol(s, &e, 10);
+	if(e==s || *e++!=',')
+		return -1;
+	raw->p=strtod(s=e, &e);
+	if(e==s || *e++!=',')
+		return -1;
+	raw->u=strtod(s=e, &e);
+	if(e==s || *e++!=',')
+		return -1;
+	raw->i=strtod(s=e, &e);
+	return e==s ? -1 : 0;
+}
 
+/* bits of the doubles, to check the read back                            */
+static uint64_t hash_doubles(uint64_t h, const double *v, size_t n)
+{
+	size_t k;
+	for(k=0;k<n;k++){
+		uint64_t b;
+		memcpy(&b, &v[k], sizeof(b));
+		h=(h^b)*0x100000001b3ull;
+		}
+	return h;
+}
 
-	
-		ret=0;
-	err:
-		if(fp) fclose(fp);
-		if(fpw) fclose(fpw);
-		if(fpw_u) fclose(fpw_u);
-		if(fpw_p) fclose(fpw_p);
-		if(fpw_i) fclose(fpw_i);
-		return ret;
-	
+/*------------------------------------------------------------------------
+ * lossless_pui_files()
+ *  Stream at most <max_lines> records of <rawfile> into XOR_RESULT_FILE_*,
+ *  the p/u/i doubles as parsed, without the double2long() scaling; then
+ *  decode each file and compare with what went in.
+ *------------------------------------------------------------------------*/
+#define LOSSLESS_BATCH 4096
+
+int lossless_pui_files(char * rawfile, uint64_t max_lines)
+{
+	static const char *file[3]={XOR_RESULT_FILE_P, XOR_RESULT_FILE_U, XOR_RESULT_FILE_I};
+	static double v[3][LOSSLESS_BATCH];
+	FILE *fp=NULL, *fpw[3]={NULL, NULL, NULL};
+	XORF_WRITER w[3];
+	uint64_t lines=0, hash[3];
+	char *line=NULL;
+	size_t cap=0, n=0;
+	int c, opened=0, ret=-1;
+	double t0, elapsed;
+
+	fp=fopen(rawfile, "r");
+	if(!fp){
+		printf("%s failed, open %s!!!\n", __FUNCTION__, rawfile);
+		return -1;
+		}
+	for(c=0;c<3;c++){
+		fpw[c]=fopen(file[c], "wb");
+		if(!fpw[c] || xorf_writer_open(&w[c], fpw[c])!=0){
+			printf("%s failed, open %s!!!\n", __FUNCTION__, file[c]);
+			goto err;
+			}
+		opened++;
+		hash[c]=0xcbf29ce484222325ull;
+		}
+
+	t0=now_seconds();
+	while(lines<max_lines && getline(&line, &cap, fp)>0){
+		RAW_PUI raw;
+		if(parse_raw_pui(line, &raw)!=0)
+			continue;
+		v[0][n]=raw.p;
+		v[1][n]=raw.u;
+		v[2][n]=raw.i;
+		lines++;
+		if(++n==LOSSLESS_BATCH || lines==max_lines){
+			for(c=0;c<3;c++){
+				hash[c]=hash_doubles(hash[c], v[c], n);
+				if(xorf_write(&w[c], v[c], n)!=0)
+					goto err;
+				}
+			n=0;
+			}
+		}
+	for(c=0;c<3;c++){
+		hash[c]=hash_doubles(hash[c], v[c], n);
+		if(xorf_write(&w[c], v[c], n)!=0)
+			goto err;
+		}
+	elapsed=now_seconds()-t0;
+	for(c=0;c<3;c++){
+		if(xorf_writer_close(&w[c])!=0 || fclose(fpw[c])!=0){
+			fpw[c]=NULL;
+			goto err;
+			}
+		fpw[c]=NULL;
+		printf("%s, %s: %llu doubles, %llu bytes, %.3f bits/value\n", __FUNCTION__, file[c],
+			(unsigned long long)w[c].values, (unsigned long long)w[c].bytes,
+			w[c].values ? 8.0*w[c].bytes/w[c].values : 0.0);
+		}
+	opened=0;
+	printf("%s, %llu lines parsed and encoded in %.3f s\n", __FUNCTION__,
+		(unsigned long long)lines, elapsed);
+
+	/* read back, the bits must be the ones parsed                        */
+	t0=now_seconds();
+	for(c=0;c<3;c++){
+		XORF_READER r;
+		uint64_t h=0xcbf29ce484222325ull, got=0;
+		long k;
+		FILE *fpr=fopen(file[c], "rb");
+		if(!fpr || xorf_reader_open(&r, fpr)!=0){
+			printf("%s failed, open %s!!!\n", __FUNCTION__, file[c]);
+			if(fpr) fclose(fpr);
+			goto err;
+			}
+		while((k=xorf_read(&r, v[0], LOSSLESS_BATCH))>0){
+			h=hash_doubles(h, v[0], k);
+			got+=k;
+			}
+		xorf_reader_close(&r);
+		fclose(fpr);
+		if(k<0 || got!=lines || h!=hash[c]){
+			printf("%s, %s does not read back (%llu of %llu values)\n", __FUNCTION__,
+				file[c], (unsigned long long)got, (unsigned long long)lines);
+			goto err;
+			}
+		}
+	elapsed=now_seconds()-t0;
+	printf("%s, read back OK, %.0f MB/s of doubles\n", __FUNCTION__,
+		elapsed > 0 ? 3.0*8*lines/elapsed/1e6 : 0.0);
+	ret=0;
+err:
+	for(c=0;c<3;c++){
+		if(c<opened)
+			xorf_writer_close(&w[c]);
+		if(fpw[c])
+			fclose(fpw[c]);
+		}
+	free(line);
+	fclose(fp);
+	return ret;
 }
 
 /*------------------------------------------------------------------------
@@ -283,10 +420,11 @@ int convert_according_to_diff(char * wfile, int lines, BYTE* puis, int puis_size
  *  convert_according_to_byte2()
  * Byte-plane interleave
  *      Output order =   B0(P1,P2,…Pn)  B1(P1,P2,…Pn) …  (for generic stream)
+ *      (built by the tiled kernels in byteshuffle.c)
  ******************************************************************************/
 int convert_according_to_byte2(char * wfile, int lines, BYTE* puis, int puis_size)
 {
-	int i, j, count=0, ret, bytes_len;
+	int ret, bytes_len;
 	BYTE * bytes=NULL;
     FILE *fpw=NULL;
 
@@ -297,13 +435,9 @@ int convert_according_to_byte2(char * wfile, int lines, BYTE* puis, int puis_siz
 		ret=-1;
 		goto err;
 		}
-  for(j=0;j<puis_size;j++){
-		for(i=0;i<lines;i++){
-			bytes[count++]=get_byte_from_puis2(j, (void *)&puis[i*puis_size], puis_size);
-			}
-		}
+	byteshuffle_encode(puis, bytes, puis_size, lines);
 
-	printf("%d, %d, %d\n", i*lines+j, bytes_len, count);
+	printf("%d, %d, %d\n", lines, puis_size, bytes_len);
     fpw=fopen(wfile, "wb");
     if(!fpw){
         printf("%s failed, open %s!!!\n", __FUNCTION__, wfile);
@@ -321,7 +455,8 @@ int convert_according_to_byte2(char * wfile, int lines, BYTE* puis, int puis_siz
 }
 
 /* get_byte_from_bytes()
- * See classical “bit-plane” transform: take every bit-plane sequentially */
+ * See classical “bit-plane” transform: take every bit-plane sequentially
+ * Per-byte reference form of the layout, bytes2bits() uses bitshuffle.c   */
 int get_byte_from_bytes(BYTE* bytes, int bytes_len, int index)
 {
 	int i, bit_val;
@@ -363,34 +498,23 @@ int get_byte_from_bits(BYTE* bits, int bytes_len, int index)
 }
 
 
-/* bytes → bits (bit-plane), keeps length                                    */
+/* bytes → bits (bit-plane), keeps length
+ * Same layout as get_byte_from_bytes() per index, done by the 8x8
+ * transpose engine in bitshuffle.c                                          */
 int bytes2bits(BYTE *bytes, BYTE *bits, int bytes_len) {
-	int i;
 	if(!bytes || !bits || bytes_len <= 0 || bytes_len%8!=0){
 		printf("%s, invalid bytes_len %d\n", __FUNCTION__, bytes_len);
 		return -1;
 		}
-	for(i=0;i<bytes_len;i++){
-		bits[i]=get_byte_from_bytes(bytes, bytes_len, i);
-		}
-
-
-    return 0; // 
+	return bitshuffle_encode(bytes, bits, bytes_len);
 }
 
-/* bits → bytes (reverse)                                                    */
+/* bits → bytes (reverse), same as get_byte_from_bits() per index          */
 int bits2bytes(BYTE *bits, BYTE *bytes_reversed, int bytes_len) {
-	int i;
-	
     if (!bits || !bytes_reversed || bytes_len <= 0 || bytes_len % 8 != 0) {
         return -1; 
     }
-
-	for(i=0;i<bytes_len;i++){
-		bytes_reversed[i]=get_byte_from_bits(bits, bytes_len, i);
-		}
-
-    return 0; 
+	return bitshuffle_decode(bits, bytes_reversed, bytes_len);
 }
 
 
@@ -400,7 +524,7 @@ int bits2bytes(BYTE *bits, BYTE *bytes_reversed, int bytes_len) {
  ******************************************************************************/
 int convert_according_to_bit2(char * wfile, int lines, BYTE* puis, int puis_size)
 {
-	int i, j, count=0, ret, bytes_len;
+	int ret, bytes_len;
 	BYTE * bytes=NULL;
 	BYTE * bits=NULL;
 	BYTE * bytes_back=NULL;
@@ -418,13 +542,9 @@ int convert_according_to_bit2(char * wfile, int lines, BYTE* puis, int puis_size
 		ret=-1;
 		goto err;
 		}
-  for(j=0;j<puis_size;j++){
-		for(i=0;i<lines;i++){
-			bytes[count++]=get_byte_from_puis2(j, (void *)&puis[i*puis_size], puis_size);
-			}
-		}
+	byteshuffle_encode(puis, bytes, puis_size, lines);
 
-	printf("**%d, %d, %d\n", i*lines+j, bytes_len, count);
+	printf("**%d, %d, %d\n", lines, puis_size, bytes_len);
 	bytes2bits(bytes, bits, bytes_len);
 	bits2bytes(bits, bytes_back, bytes_len);
     fpw=fopen(wfile, "wb");
@@ -704,97 +824,590 @@ int test()
 
 
 
+typedef enum {
+	TEST_PUIS =0,
+	TEST_P,
+	TEST_U,
+	TEST_I,
+	TEST_MAX
+}TEST_ITEM;
+static char *test_case[TEST_MAX]={"test puis", "test power", "test voltage", "test current"};
+static char *test_name[TEST_MAX]={"puis", "p", "u", "i"};
+static char *input_file[TEST_MAX]={BIN_INPUT_FILE, BIN_INPUT_FILE_P, BIN_INPUT_FILE_U, BIN_INPUT_FILE_I};
+
+/* P keeps the ZigZag difference, U and I the sign/magnitude one          */
+static PIPE_CHANNEL channel[TEST_MAX]={
+	{sizeof(BIN_PUI), DELTA_SIGNMAG, {NULL, BYTE_RESULT_FILE, BIT_RESULT_FILE}},
+	{sizeof(DWORD), DELTA_ZIGZAG, {RAW_RESULT_FILE_P, BYTE_RESULT_FILE_P, BIT_RESULT_FILE_P,
+			DIFF_RESULT_FILE_P, DIFF_BYTE_RESULT_FILE_P, DIFF_BIT_RESULT_FILE_P,
+			PRED_RESULT_FILE_P, PRED_BYTE_RESULT_FILE_P, PRED_BIT_RESULT_FILE_P}},
+	{sizeof(WORD), DELTA_SIGNMAG, {RAW_RESULT_FILE_U, BYTE_RESULT_FILE_U, BIT_RESULT_FILE_U,
+			DIFF_RESULT_FILE_U, DIFF_BYTE_RESULT_FILE_U, DIFF_BIT_RESULT_FILE_U,
+			PRED_RESULT_FILE_U, PRED_BYTE_RESULT_FILE_U, PRED_BIT_RESULT_FILE_U}},
+	{sizeof(DWORD), DELTA_SIGNMAG, {RAW_RESULT_FILE_I, BYTE_RESULT_FILE_I, BIT_RESULT_FILE_I,
+			DIFF_RESULT_FILE_I, DIFF_BYTE_RESULT_FILE_I, DIFF_BIT_RESULT_FILE_I,
+			PRED_RESULT_FILE_I, PRED_BYTE_RESULT_FILE_I, PRED_BIT_RESULT_FILE_I}},
+};
+
+#define SEGMENTS 10
+
+/* "p,u,i,puis" -> channel mask, 0 on unknown names                       */
+static unsigned parse_channels(const char *list)
+{
+	unsigned mask=0;
+	char *copy=strdup(list), *save=NULL, *tok;
+	int t;
+
+	if(!copy)
+		return 0;
+	for(tok=strtok_r(copy, ",", &save);tok;tok=strtok_r(NULL, ",", &save)){
+		int found=0;
+		if(!strcmp(tok, "all")){
+			mask|=(1u<<TEST_MAX)-1;
+			continue;
+			}
+		for(t=0;t<TEST_MAX;t++)
+			if(!strcmp(tok, test_name[t])){
+				mask|=1u<<t;
+				found=1;
+				}
+		if(!found){
+			printf("%s, unknown channel %s\n", __FUNCTION__, tok);
+			mask=0;
+			break;
+			}
+		}
+	free(copy);
+	return mask;
+}
+
+/* One channel chain, run on its own thread                               */
+typedef struct {
+	TEST_ITEM  t;
+	const BYTE *puis;	/* shared parsed column, NULL: read the file     */
+	uint64_t   lines;
+	unsigned   variants;
+	const PIPE_ENCODER *enc;
+	int        workers;
+	int        scaling;
+	uint64_t   mem_limit;
+	int        ret;
+} CHANNEL_JOB;
+
+static void *run_channel(void *arg)
+{
+	CHANNEL_JOB *job=arg;
+	PIPE_CHANNEL *ch=&channel[job->t];
+	BYTE *puis=NULL;
+
+	printf("%s, segments %d, segsize %d*%llu\n", test_case[job->t], SEGMENTS,
+		ch->unit_size, (unsigned long long)job->lines/SEGMENTS);
+	if(job->mem_limit){
+		/* bounded memory: the channel file is read window by window     */
+		job->ret=pipeline_stream(ch, input_file[job->t], job->lines, SEGMENTS,
+					job->variants, job->enc, job->workers, job->mem_limit);
+		return NULL;
+		}
+	if(!job->puis){
+		job->ret=read_puis(input_file[job->t], job->lines, &puis, ch->unit_size);
+		if(job->ret!=0)
+			return NULL;
+		}
+	if(job->scaling)
+		job->ret=pipeline_scaling(ch, job->puis ? job->puis : puis, job->lines, SEGMENTS,
+					job->variants, job->enc, job->workers);
+	else
+		job->ret=pipeline_run(ch, job->puis ? job->puis : puis, job->lines, SEGMENTS,
+					job->variants, job->enc, job->workers);
+	free(puis);
+	return NULL;
+}
+
+/* Archive read back by a pool of workers, see read_archive()            */
+typedef struct {
+	const ARCHIVE *a;
+	uint64_t   next;	/* next entry to hand out (atomic)              */
+	uint64_t   failed;
+	uint64_t   bytes;	/* decoded                                      */
+} ARCHIVE_JOB;
+
+/* the plain entry of <variant> of the same channel and segment as <e>  */
+static const ARCHIVE_ENTRY *plain_entry(const ARCHIVE *a, const ARCHIVE_ENTRY *e, int variant)
+{
+	uint64_t i;
+
+	for(i=0;i<a->count;i++){
+		const ARCHIVE_ENTRY *p=&a->dir[i];
+		if(p->output==OUT_PLAIN && p->channel==e->channel && p->variant==variant
+			&& p->segment==e->segment)
+			return p;
+		}
+	return NULL;
+}
+
+/*------------------------------------------------------------------------
+ * check_records()
+ *  The <len> bytes of records recovered from <e>: against the plain raw
+ *  output of the segment when the archive holds one, and against the
+ *  directory's min / max.
+ *------------------------------------------------------------------------*/
+static int check_records(const ARCHIVE *a, const ARCHIVE_ENTRY *e, const BYTE *rec, size_t len)
+{
+	const ARCHIVE_ENTRY *p=plain_entry(a, e, VAR_RAW);
+	size_t unit=channel[e->channel].unit_size;
+
+	if(p && p!=e && (p->length!=len || memcmp(a->map+p->offset, rec, len))){
+		printf("%s, %s: records differ from %s\n", __FUNCTION__, e->name, p->name);
+		return -1;
+		}
+	if((e->flags & ARCHIVE_F_RANGE) && (unit==2 || unit==4)){
+		int64_t lo=INT64_MAX, hi=INT64_MIN, x;
+		size_t k;
+		for(k=0;k<e->records;k++){
+			if(unit==2){
+				WORD w;
+				memcpy(&w, rec+k*2, 2);
+				x=w;
+			}else{
+				DWORD d;
+				memcpy(&d, rec+k*4, 4);
+				x=d;
+				}
+			lo=x<lo ? x : lo;
+			hi=x>hi ? x : hi;
+			}
+		if(e->records && (lo!=e->min || hi!=e->max)){
+			printf("%s, %s: range %lld..%lld, directory %lld..%lld\n", __FUNCTION__, e->name,
+				(long long)lo, (long long)hi, (long long)e->min, (long long)e->max);
+			return -1;
+			}
+		}
+	return 0;
+}
+
+/* residuals behind the PRED_HEADER of <pred> back to the records        */
+static int unpredict(const ARCHIVE_ENTRY *e, const BYTE *pred, size_t len, BYTE **rec)
+{
+	PRED_HEADER h;
+	int unit=channel[e->channel].unit_size;
+
+	*rec=NULL;
+	if(len<sizeof(h))
+		return -1;
+	memcpy(&h, pred, sizeof(h));
+	if(memcmp(h.magic, PRED_MAGIC, sizeof(h.magic)) || h.unit_size!=unit){
+		printf("%s, %s: bad predictor header\n", __FUNCTION__, e->name);
+		return -1;
+		}
+	*rec=malloc(len-sizeof(h)+1);
+	if(!*rec)
+		return -1;
+	return predictor_decode(h.id, h.lag, pred+sizeof(h), *rec, e->records, unit);
+}
+
+/*------------------------------------------------------------------------
+ * unplane()
+ *  The planes of byte / bit variant <e> (<hl> header bytes in front, a
+ *  plane map with ARCHIVE_F_PMAP) back to the lanes they were cut from:
+ *  *lanes holds the header and the records of raw, diff or pred.
+ *------------------------------------------------------------------------*/
+static int unplane(const ARCHIVE_ENTRY *e, const BYTE *out, size_t out_len, size_t hl,
+			BYTE **lanes)
+{
+	size_t unit=channel[e->channel].unit_size, len=e->records*unit, n;
+	BYTE *planes, *bytes;
+	int ret=-1;
+
+	*lanes=NULL;
+	if(e->records > (SIZE_MAX-hl)/unit/2 || out_len<hl)
+		return -1;
+	planes=malloc(2*len+1);
+	*lanes=malloc(hl+len+1);
+	if(!planes || !*lanes)
+		goto err;
+	if(e->flags & ARCHIVE_F_PMAP){
+		/* planemap_decode() of the elided planes                      */
+		if(planemap_size(out+hl, out_len-hl, &n)!=0 || n!=len
+			|| planemap_decode(out+hl, out_len-hl, planes, len, &n)!=0)
+			goto err;
+	}else if(out_len-hl!=len)
+		goto err;
+	else
+		memcpy(planes, out+hl, len);
+	bytes=planes;
+	if(VAR_MASK(e->variant) & VAR_BIT_ANY){
+		bytes=planes+len;
+		if(bitshuffle_decode(planes, bytes, len)!=0)
+			goto err;
+		}
+	memcpy(*lanes, out, hl);
+	ret=byteshuffle_decode(bytes, *lanes+hl, unit, e->records);
+err:
+	if(ret)
+		printf("%s, %s: planes of %llu bytes do not make %llu records\n", __FUNCTION__,
+			e->name, (unsigned long long)out_len-hl, (unsigned long long)e->records);
+	free(planes);
+	return ret;
+}
+
+/*------------------------------------------------------------------------
+ * check_entry()
+ *  Decode one archived segment on its own and check it: against the
+ *  plain output of the same segment when the archive holds one, the
+ *  lane variants against the record count, raw and the records pred
+ *  predictor_decode()s to with check_records().  Byte / bit variants are
+ *  unplane()d first and checked as their lane variant.
+ *------------------------------------------------------------------------*/
+static int check_entry(ARCHIVE_JOB *job, uint64_t i)
+{
+	const ARCHIVE_ENTRY *e=&job->a->dir[i], *p;
+	const BYTE *in;
+	BYTE *out=NULL, *rec=NULL, *lanes=NULL;
+	size_t len, out_len, hl, unit;
+	int ret=-1, v;
+
+	in=archive_segment(job->a, i, &len);
+	if(e->channel>=TEST_MAX || e->variant>=VAR_MAX
+		|| pipeline_decode_output(e->variant, e->output, in, len, &out, &out_len)!=0)
+		goto err;
+	__atomic_add_fetch(&job->bytes, out_len, __ATOMIC_RELAXED);
+	unit=channel[e->channel].unit_size;
+	hl=(VAR_MASK(e->variant) & VAR_PRED_ANY) ? sizeof(PRED_HEADER) : 0;
+	p=(e->output==OUT_PLAIN) ? NULL : plain_entry(job->a, e, e->variant);
+	if(p && (p->length!=out_len || memcmp(job->a->map+p->offset, out, out_len))){
+		printf("%s, %s differs from %s\n", __FUNCTION__, e->name, p->name);
+		goto err;
+		}
+	if((e->variant==VAR_RAW || e->variant==VAR_DIFF || e->variant==VAR_PRED)
+		&& (out_len<hl || (out_len-hl)%unit || (out_len-hl)/unit!=e->records)){
+		printf("%s, %s: %llu bytes for %llu records\n", __FUNCTION__, e->name,
+			(unsigned long long)out_len, (unsigned long long)e->records);
+		goto err;
+		}
+	/* byte / bit planes: the lanes of raw, diff or pred they came from  */
+	v=e->variant;
+	if(VAR_MASK(v) & ~(VAR_MASK(VAR_RAW) | VAR_MASK(VAR_DIFF) | VAR_MASK(VAR_PRED))){
+		v=(VAR_MASK(v) & VAR_DIFF_ANY) ? VAR_DIFF : (VAR_MASK(v) & VAR_PRED_ANY) ? VAR_PRED : VAR_RAW;
+		if(unplane(e, out, out_len, hl, &lanes)!=0)
+			goto err;
+		out_len=hl+e->records*unit;
+		p=plain_entry(job->a, e, v);
+		if(p && (p->length!=out_len || memcmp(job->a->map+p->offset, lanes, out_len))){
+			printf("%s, %s: lanes differ from %s\n", __FUNCTION__, e->name, p->name);
+			goto err;
+			}
+		}
+	if(v==VAR_RAW && check_records(job->a, e, lanes ? lanes : out, out_len)!=0)
+		goto err;
+	if(v==VAR_PRED && (unpredict(e, lanes ? lanes : out, out_len, &rec)!=0
+		|| check_records(job->a, e, rec, out_len-hl)!=0))
+		goto err;
+	ret=0;
+err:
+	if(ret)
+		printf("%s, %s failed\n", __FUNCTION__, e->name);
+	free(rec);
+	free(lanes);
+	free(out);
+	return ret;
+}
+
+static void *archive_worker(void *arg)
+{
+	ARCHIVE_JOB *job=arg;
+	uint64_t i;
+
+	while((i=__atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->a->count)
+		if(check_entry(job, i)!=0)
+			__atomic_add_fetch(&job->failed, 1, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/*------------------------------------------------------------------------
+ * read_archive()
+ *  List the directory of <file> and decode every segment, <workers>
+ *  threads side by side straight from the one mapping.
+ *------------------------------------------------------------------------*/
+static int read_archive(const char *file, int workers)
+{
+	ARCHIVE a;
+	ARCHIVE_JOB job;
+	pthread_t *tid;
+	uint64_t i;
+	int t, started=0;
+	double t0, elapsed;
+
+	if(archive_open(&a, file)!=0)
+		return -1;
+	for(i=0;i<a.count;i++){
+		const ARCHIVE_ENTRY *e=&a.dir[i];
+		printf("%-28s %-5s %-9s %-7s %10llu %9llu  records %llu+%llu",
+			e->name, e->channel<TEST_MAX ? test_name[e->channel] : "?",
+			pipeline_variant_name(e->variant), pipeline_output_name(e->output),
+			(unsigned long long)e->offset, (unsigned long long)e->length,
+			(unsigned long long)e->first, (unsigned long long)e->records);
+		if(e->flags & ARCHIVE_F_RANGE)
+			printf("  %lld..%lld", (long long)e->min, (long long)e->max);
+		if(e->output==OUT_PLAIN && (VAR_MASK(e->variant) & VAR_PRED_ANY)
+			&& e->length>=sizeof(PRED_HEADER)){
+			PRED_HEADER h;
+			memcpy(&h, a.map+e->offset, sizeof(h));
+			printf("  %s", h.id<PRED_MAX ? predictor_name(h.id) : "?");
+			if(h.lag)
+				printf(":%u", h.lag);
+			}
+		if(e->output==OUT_CHAIN && e->length>=sizeof(CHAIN_HEADER)+sizeof(CHAIN_ENTRY)){
+			CHAIN_HEADER h;
+			CHAIN_ENTRY c;
+			int k;
+			memcpy(&h, a.map+e->offset, sizeof(h));
+			printf("  ");
+			for(k=0;k<h.nstages && e->length>=sizeof(h)+(k+1)*sizeof(c);k++){
+				memcpy(&c, a.map+e->offset+sizeof(h)+k*sizeof(c), sizeof(c));
+				printf("%s%s", k ? "," : "", chain_stage_name(c.id));
+				}
+			}
+		printf("\n");
+		}
+
+	memset(&job, 0, sizeof(job));
+	job.a=&a;
+	if(workers<=0)
+		workers=online_cpus();
+	t0=now_seconds();
+	tid=calloc(workers, sizeof(*tid));
+	for(t=0;tid && t<workers;t++)
+		if(pthread_create(&tid[started], NULL, archive_worker, &job)==0)
+			started++;
+	if(started==0)
+		archive_worker(&job);
+	for(t=0;t<started;t++)
+		pthread_join(tid[t], NULL);
+	free(tid);
+	elapsed=now_seconds()-t0;
+	printf("%s: %llu segments, %llu failed, %llu bytes decoded in %.3f s (%.1f MB/s, %d workers)\n",
+		file, (unsigned long long)a.count, (unsigned long long)job.failed,
+		(unsigned long long)job.bytes, elapsed,
+		elapsed > 0 ? job.bytes/elapsed/1e6 : 0.0, started ? started : 1);
+	archive_close(&a);
+	return job.failed ? -1 : 0;
+}
+
 int main(int argc, char * argv[])
 {
-	int ret, lines;
+	int ret, opt, t, threads=0, workers=0, scaling=0, skip_csv=0, lossless=0, nch=0;
+	uint64_t lines, mem_limit=0;
+	unsigned variants=VAR_CLASSIC, channels=(1u<<TEST_MAX)-1, predictors=PRED_ALL;
+	uint32_t lag=0;
+	PIPE_ENCODER enc={OUT_MASK(OUT_PLAIN), 15, 8, 0, NULL, NULL};
+	ARCHIVE_WRITER archive;
+	const char *archive_file=NULL, *read_file=NULL;
+	CODEC_CHAIN chain;
+	PUI_COLUMNS cols;
+	CHANNEL_JOB job[TEST_MAX];
+	pthread_t tid[TEST_MAX];
+	int started[TEST_MAX]={0};
 
 
 //	test(); return 0;
 
-	if(argc != 1 && argc != 2){
+	while((opt=getopt(argc, argv, "t:j:Ss:bc:v:P:L:z:w:m:exC:D:A:R:")) != -1){
+		switch(opt){
+			case 't':
+				threads=atoi(optarg);
+				break;
+			case 'j':
+				workers=atoi(optarg);
+				break;
+			case 'S':
+				scaling=1;
+				break;
+			case 's':
+				mem_limit=parse_size(optarg);
+				break;
+			case 'b':
+				skip_csv=1;
+				break;
+			case 'c':
+				channels=parse_channels(optarg);
+				if(!channels){
+					usage();
+					return -1;
+					}
+				break;
+			case 'v':
+				variants=pipeline_parse_variants(optarg);
+				if(!variants){
+					usage();
+					return -1;
+					}
+				break;
+			case 'P':
+				predictors=predictor_parse(optarg);
+				if(!predictors){
+					usage();
+					return -1;
+					}
+				break;
+			case 'L':
+				lag=strtoul(optarg, NULL, 0);
+				break;
+			case 'z':
+				enc.outputs=pipeline_parse_outputs(optarg);
+				if(!enc.outputs){
+					usage();
+					return -1;
+					}
+				break;
+			case 'w':
+				enc.wbits=atoi(optarg);
+				break;
+			case 'm':
+				enc.mlevel=atoi(optarg);
+				break;
+			case 'e':
+				enc.elide=1;
+				break;
+			case 'x':
+				lossless=1;
+				break;
+			case 'C':
+				if(chain_parse(optarg, &chain)!=0){
+					usage();
+					return -1;
+					}
+				enc.chain=&chain;
+				break;
+			case 'D':
+				{
+				char out[PATH_MAX];
+				snprintf(out, sizeof(out), "%s.dec", optarg);
+				ret=chain_decode_file(optarg, out);
+				printf("%s -> %s: %s\n", optarg, out, ret ? "failed" : "OK");
+				return ret;
+				}
+			case 'A':
+				archive_file=optarg;
+				break;
+			case 'R':
+				read_file=optarg;
+				break;
+			default:
+				usage();
+				return -1;
+			}
+		}
+	if(read_file)
+		return read_archive(read_file, workers);
+	if(archive_file && scaling){
+		printf("-S writes the outputs once per worker count, not into an archive\n");
+		usage();
+		return -1;
+		}
+	if(((enc.outputs & OUT_MASK(OUT_CHAIN)) != 0) != (enc.chain != NULL)){
+		printf("-z chain and -C go together\n");
 		usage();
 		return -1;
 		}
-	if(argc==1)
+	if(argc-optind > 1 || enc.wbits < 8 || enc.wbits > 15 || enc.mlevel < 1 || enc.mlevel > 9){
+		usage();
+		return -1;
+		}
+	if(optind==argc)
 		lines=102400;
 	else
-		lines=atoi(argv[1]);
+		lines=strtoull(argv[optind], NULL, 0);
+	/* -x streams the CSV itself, any line count goes                    */
+	if(lossless)
+		return lossless_pui_files(TXT_RAW_FILE, lines);
+	if(!mem_limit && lines > INT_MAX){
+		printf("%llu lines need the streaming mode (-s)\n", (unsigned long long)lines);
+		return -1;
+		}
 
 
-	ret=prepare_binary_pui_file(TXT_RAW_FILE, BIN_INPUT_FILE, lines);
-	if(ret!=0){
-		printf("FATAL error, %s failed\n",__FUNCTION__);
-		return ret;
+	/* the CSV is parsed once, the chains share the columns read-only     */
+	memset(&cols, 0, sizeof(cols));
+	if(!skip_csv){
+		ret=prepare_binary_pui_file(TXT_RAW_FILE, BIN_INPUT_FILE, lines, threads,
+						mem_limit, &cols);
+		if(ret!=0){
+			printf("FATAL error, %s failed\n",__FUNCTION__);
+			return ret;
+			}
+		if(!mem_limit && cols.lines < lines){
+			printf("only %llu valid lines in %s\n", (unsigned long long)cols.lines, TXT_RAW_FILE);
+			csv_ingest_free(&cols);
+			return -1;
+			}
 		}
 	//////// bin pui file is OK ///////////
 	pirnt_binary_pui_file(BIN_INPUT_FILE);
 	printf("struct %ld, ul %ld, ui %ld, us %ld\n", sizeof(BIN_PUI), sizeof(unsigned long), sizeof(unsigned int), sizeof(unsigned short));
 	printf("Now start processing...\n");
 
-
-
-typedef enum {
-	TEST_PUIS =0,
-	TEST_P,
-	TEST_U,
-	TEST_I,
-	TEST_MAX
-}TEST_ITEM;
-char *test_case[TEST_MAX]={"test puis", "test power", "test voltage", "test current"};
-int unit_size[TEST_MAX]={10, 4, 2, 4};
-
-BYTE *puis=NULL, *puis_p=NULL, *puis_u=NULL, *puis_i=NULL;
-
-#define SEGMENTS 10
-
-TEST_ITEM t=TEST_I;
-char buf[512];
-sprintf(buf, "echo \"####  %s, segments %d, segsize %d*%d  ####\"> out/readme", 
-						test_case[t], SEGMENTS, unit_size[t], lines/SEGMENTS);
-system(buf);
-switch(t){
-	case TEST_PUIS:
-		read_puis(BIN_INPUT_FILE, lines, &puis, sizeof(BIN_PUI));
-		convert_according_to_bytebit(BYTE_RESULT_FILE, lines, puis, sizeof(BIN_PUI), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(BIT_RESULT_FILE, lines, puis, sizeof(BIN_PUI), SEGMENTS, IS_BIT);
-		if(puis) free(puis);
-		break;
-	case TEST_P:
-		read_puis(BIN_INPUT_FILE_P, lines, &puis_p, sizeof(DWORD));
-		convert_according_to_bytebit(RAW_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_RAW);
-		convert_according_to_bytebit(BYTE_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(BIT_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_BIT);
-		puis_diff_zigzag(lines, puis_p, sizeof(DWORD));
-		convert_according_to_bytebit(DIFF_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_DIFF);
-		convert_according_to_bytebit(DIFF_BYTE_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(DIFF_BIT_RESULT_FILE_P, lines, puis_p, sizeof(DWORD), SEGMENTS, IS_BIT);
-		if(puis_p) free(puis_p);
-		break;
-	case TEST_U:
-		read_puis(BIN_INPUT_FILE_U, lines, &puis_u, sizeof(WORD));
-		convert_according_to_bytebit(RAW_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_RAW);
-		convert_according_to_bytebit(BYTE_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(BIT_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_BIT);
-		puis_diff(lines, puis_u, sizeof(WORD));
-		convert_according_to_bytebit(DIFF_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_DIFF);
-		convert_according_to_bytebit(DIFF_BYTE_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(DIFF_BIT_RESULT_FILE_U, lines, puis_u, sizeof(WORD), SEGMENTS, IS_BIT);
-		if(puis_u) free(puis_u);
-		break;
-	case TEST_I:
-		read_puis(BIN_INPUT_FILE_I, lines, &puis_i, sizeof(DWORD));
-		convert_according_to_bytebit(RAW_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_RAW);
-		convert_according_to_bytebit(BYTE_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(BIT_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_BIT);
-		puis_diff(lines, puis_i, sizeof(DWORD));
-		convert_according_to_bytebit(DIFF_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_DIFF);
-		convert_according_to_bytebit(DIFF_BYTE_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_BYTE);
-		convert_according_to_bytebit(DIFF_BIT_RESULT_FILE_I, lines, puis_i, sizeof(DWORD), SEGMENTS, IS_BIT);
-		if(puis_i) free(puis_i);
-		break;
-	default:
-		break;
-}
-	return 0;
+	for(t=0;t<TEST_MAX;t++)
+		if(channels & (1u<<t))
+			nch++;
+	/* one readme line per channel, step*.sh name their statistics after
+	 * the first one                                                      */
+	FILE *readme=fopen("out/readme", "w");
+	for(t=0;readme && t<TEST_MAX;t++)
+		if(channels & (1u<<t))
+			fprintf(readme, "####  %s, segments %d, segsize %d*%llu  ####\n",
+				test_case[t], SEGMENTS, channel[t].unit_size, (unsigned long long)lines/SEGMENTS);
+	if(readme)
+		fclose(readme);
+
+	if(archive_file){
+		if(archive_create(&archive, archive_file)!=0)
+			return -1;
+		enc.archive=&archive;
+		}
+	if(workers<=0)
+		workers=online_cpus();
+	for(t=0;t<TEST_MAX;t++){
+		memset(&job[t], 0, sizeof(job[t]));
+		if(!(channels & (1u<<t)))
+			continue;
+		channel[t].id=t;
+		channel[t].predictors=predictors;
+		channel[t].lag=lag;
+		job[t].t=t;
+		job[t].lines=lines;
+		job[t].variants=variants;
+		job[t].enc=&enc;
+		/* -S times one channel at a time on all the workers, the other
+		 * channels running alongside would skew its speed-ups          */
+		job[t].workers=scaling ? workers : workers/nch > 0 ? workers/nch : 1;
+		job[t].scaling=scaling;
+		job[t].mem_limit=mem_limit/nch;
+		if(cols.lines)
+			job[t].puis=(t==TEST_PUIS) ? (BYTE*)cols.puis : (t==TEST_P) ? (BYTE*)cols.p
+					: (t==TEST_U) ? (BYTE*)cols.u : (BYTE*)cols.i;
+		if(!scaling && pthread_create(&tid[t], NULL, run_channel, &job[t]) == 0)
+			started[t]=1;
+		else
+			run_channel(&job[t]);
+		}
+	ret=0;
+	for(t=0;t<TEST_MAX;t++){
+		if(!(channels & (1u<<t)))
+			continue;
+		if(started[t])
+			pthread_join(tid[t], NULL);
+		if(job[t].ret){
+			printf("%s failed, %d\n", test_case[t], job[t].ret);
+			ret=job[t].ret;
+			}
+		}
+	/* a channel that failed left segments out, no archive then         */
+	if(enc.archive && ret)
+		archive_abort(enc.archive);
+	else if(enc.archive && archive_finish(enc.archive)!=0){
+		printf("%s failed\n", archive_file);
+		ret=-1;
+		}
+	csv_ingest_free(&cols);
+	return ret;
 }
-
@@ -0,0 +1,217 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "predictor.h"
+
+static const char *pred_name[PRED_MAX] = {
+	"none", "delta", "dod", "xor", "lag", "lag_delta"
+};
+
+const char *predictor_name(PRED_ID id)
+{
+	return (unsigned)id < PRED_MAX ? pred_name[id] : "unknown";
+}
+
+/*------------------------------------------------------------------------
+ * predictor_parse() - comma separated names, or "all"
+ *------------------------------------------------------------------------*/
+unsigned predictor_parse(const char *list)
+{
+	unsigned mask = 0;
+	const char *s = list;
+
+	if(!list)
+		return 0;
+	while(*s){
+		const char *e = strchr(s, ',');
+		size_t len = e ? (size_t)(e - s) : strlen(s);
+		int p, found = 0;
+
+		if(len == 3 && !strncmp(s, "all", 3)){
+			mask |= PRED_ALL;
+			found = 1;
+			}
+		for(p=0;p<PRED_MAX && !found;p++){
+			if(strlen(pred_name[p]) == len && !strncmp(s, pred_name[p], len)){
+				mask |= PRED_MASK(p);
+				found = 1;
+				}
+			}
+		if(!found){
+			printf("%s, unknown predictor %.*s\n", __FUNCTION__, (int)len, s);
+			return 0;
+			}
+		s += len;
+		if(*s == ',')
+			s++;
+		}
+	return mask;
+}
+
+/*------------------------------------------------------------------------
+ * Kernels for one lane type
+ *  predictN() is the prediction of x[k] from x[0..k-1]; encode feeds it
+ *  the input, decode the values restored so far.
+ *------------------------------------------------------------------------*/
+#define PRED_KERNELS(W, T, ST)							\
+static inline T predict##W(PRED_ID id, const T *x, size_t k, uint32_t lag)	\
+{										\
+	if(k == 0 || id == PRED_NONE)						\
+		return 0;							\
+	switch(id){								\
+		case PRED_DOD:							\
+			return k >= 2 ? (T)(2*x[k-1] - x[k-2]) : x[k-1];	\
+		case PRED_LAG:							\
+			return k >= lag ? x[k-lag] : x[k-1];			\
+		case PRED_LAG_DELTA:						\
+			return k > lag ? (T)(x[k-1] + x[k-lag] - x[k-lag-1]) : x[k-1]; \
+		default:							\
+			return x[k-1];						\
+		}								\
+}										\
+										\
+static inline T zigzag##W(T r)							\
+{										\
+	return (T)((T)(r << 1) ^ (T)((ST)r >> (W - 1)));			\
+}										\
+										\
+static inline T unzigzag##W(T z)						\
+{										\
+	return (T)((z >> 1) ^ (T)(-(T)(z & 1)));				\
+}										\
+										\
+static void encode##W(PRED_ID id, uint32_t lag, const T *x, T *out, size_t n)	\
+{										\
+	size_t k;								\
+										\
+	for(k=0;k<n;k++){							\
+		T p = predict##W(id, x, k, lag);				\
+		out[k] = (id == PRED_XOR) ? (T)(x[k] ^ p)			\
+			: (id == PRED_NONE) ? x[k] : zigzag##W((T)(x[k] - p));	\
+		}								\
+}										\
+										\
+static void decode##W(PRED_ID id, uint32_t lag, const T *in, T *x, size_t n)	\
+{										\
+	size_t k;								\
+										\
+	for(k=0;k<n;k++){							\
+		T p = predict##W(id, x, k, lag);				\
+		x[k] = (id == PRED_XOR) ? (T)(in[k] ^ p)			\
+			: (id == PRED_NONE) ? in[k] : (T)(unzigzag##W(in[k]) + p); \
+		}								\
+}										\
+										\
+static uint64_t cost##W(PRED_ID id, uint32_t lag, const T *x, size_t n)	\
+{										\
+	uint64_t bits = 0;							\
+	size_t k;								\
+										\
+	for(k=0;k<n;k++){							\
+		T p = predict##W(id, x, k, lag);				\
+		uint32_t r = (id == PRED_XOR) ? (T)(x[k] ^ p)			\
+			: (id == PRED_NONE) ? x[k] : zigzag##W((T)(x[k] - p));	\
+		if(r)								\
+			bits += 32 - __builtin_clz(r);				\
+		}								\
+	return bits;								\
+}
+
+PRED_KERNELS(16, uint16_t, int16_t)
+PRED_KERNELS(32, uint32_t, int32_t)
+
+static int check_args(PRED_ID id, uint32_t lag, int unit_size)
+{
+	if((unsigned)id >= PRED_MAX || (unit_size != 2 && unit_size != 4)){
+		printf("%s, invalid predictor %d or unit size %d\n", __FUNCTION__, id, unit_size);
+		return -1;
+		}
+	if((id == PRED_LAG || id == PRED_LAG_DELTA) && lag < 1){
+		printf("%s, %s needs a lag\n", __FUNCTION__, predictor_name(id));
+		return -1;
+		}
+	return 0;
+}
+
+int predictor_encode(PRED_ID id, uint32_t lag, const uint8_t *in, uint8_t *out, size_t n, int unit_size)
+{
+	if(!in || !out || check_args(id, lag, unit_size))
+		return -1;
+	if(unit_size == 2)
+		encode16(id, lag, (const uint16_t *)in, (uint16_t *)out, n);
+	else
+		encode32(id, lag, (const uint32_t *)in, (uint32_t *)out, n);
+	return 0;
+}
+
+int predictor_decode(PRED_ID id, uint32_t lag, const uint8_t *in, uint8_t *out, size_t n, int unit_size)
+{
+	if(!in || !out || check_args(id, lag, unit_size))
+		return -1;
+	if(unit_size == 2)
+		decode16(id, lag, (const uint16_t *)in, (uint16_t *)out, n);
+	else
+		decode32(id, lag, (const uint32_t *)in, (uint32_t *)out, n);
+	return 0;
+}
+
+/* values looked at by predictor_estimate_lag()                          */
+#define LAG_PROBE 4096
+
+uint32_t predictor_estimate_lag(const uint8_t *in, size_t n, int unit_size, uint32_t max_lag)
+{
+	uint64_t best_cost = UINT64_MAX;
+	uint32_t lag, best = 0;
+	size_t k, m = n < LAG_PROBE ? n : LAG_PROBE;
+
+	if(!in || (unit_size != 2 && unit_size != 4))
+		return 0;
+	if(max_lag > m/2)
+		max_lag = m/2;
+	for(lag=2;lag<=max_lag;lag++){
+		uint64_t c = 0;
+		for(k=lag;k<m;k++){
+			int64_t d = (unit_size == 2)
+				? (int64_t)((const uint16_t *)in)[k] - ((const uint16_t *)in)[k-lag]
+				: (int64_t)((const uint32_t *)in)[k] - ((const uint32_t *)in)[k-lag];
+			c += d < 0 ? -d : d;
+			}
+		/* normalise to the number of terms, longer lags sum fewer; a
+		 * multiple of the period must do clearly better to win        */
+		c = c * 1024 / (m - lag);
+		if(c < best_cost - best_cost/16){
+			best_cost = c;
+			best = lag;
+			}
+		}
+	return best;
+}
+
+PRED_ID predictor_select(const uint8_t *in, size_t n, int unit_size, unsigned allowed,
+			uint32_t lag, uint64_t *cost)
+{
+	PRED_ID best = PRED_DELTA;
+	uint64_t best_cost = UINT64_MAX;
+	int p;
+
+	if(!in || (unit_size != 2 && unit_size != 4))
+		return PRED_DELTA;
+	for(p=0;p<PRED_MAX;p++){
+		uint64_t c;
+		if(!(allowed & PRED_MASK(p)))
+			continue;
+		if((p == PRED_LAG || p == PRED_LAG_DELTA) && lag < 1)
+			continue;
+		c = (unit_size == 2) ? cost16(p, lag, (const uint16_t *)in, n)
+				: cost32(p, lag, (const uint32_t *)in, n);
+		if(c < best_cost){
+			best_cost = c;
+			best = p;
+			}
+		}
+	if(cost)
+		*cost = best_cost;
+	return best;
+}
@@ -0,0 +1,65 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Predictors for WORD / DWORD streams
+ *      res[k] = map(x[k] - pred(x[0..k-1]))
+ *  Arithmetic wraps in the lane width and map is ZigZag (XOR is stored
+ *  as is), so every predictor is exactly invertible.  Only values of the
+ *  same segment are used: where a predictor lacks history it falls back
+ *  to the first-order difference, and x[0] is predicted by 0, so each
+ *  segment decodes on its own.
+ *------------------------------------------------------------------------*/
+typedef enum {
+	PRED_NONE = 0,	/* x                                                  */
+	PRED_DELTA,	/* x - x[k-1]                                         */
+	PRED_DOD,	/* x - (2x[k-1] - x[k-2]), delta-of-delta / linear    */
+	PRED_XOR,	/* x ^ x[k-1]                                         */
+	PRED_LAG,	/* x - x[k-L], one mains cycle ago                    */
+	PRED_LAG_DELTA,	/* x - (x[k-1] + x[k-L] - x[k-L-1])                   */
+	PRED_MAX
+} PRED_ID;
+
+#define PRED_MASK(p)	(1u << (p))
+#define PRED_ALL	(PRED_MASK(PRED_MAX) - 1)
+
+/* Longest lag tried by predictor_estimate_lag() callers                 */
+#define PRED_MAX_LAG	512
+
+/* Recorded in front of every predicted segment                          */
+#define PRED_MAGIC	"PR"
+#pragma pack(push,1)
+typedef struct {
+	char     magic[2];
+	uint8_t  id;		/* PRED_ID                                   */
+	uint8_t  unit_size;	/* 2 or 4                                    */
+	uint32_t lag;		/* L of the lag predictors, 0 otherwise      */
+} PRED_HEADER;
+#pragma pack(pop)
+
+const char *predictor_name(PRED_ID id);
+
+/* "delta,dod,lag" -> predictor mask, 0 on unknown names                 */
+unsigned predictor_parse(const char *list);
+
+/* lag in [2, max_lag] with the smallest |x[k] - x[k-L]| on the head of
+ * the segment, 0 when the segment is too short                          */
+uint32_t predictor_estimate_lag(const uint8_t *in, size_t n, int unit_size, uint32_t max_lag);
+
+/*------------------------------------------------------------------------
+ * predictor_select()
+ *  Residual cost (sum of the significant bits of every residual) of each
+ *  predictor in <allowed> on <n> values, returns the cheapest one.
+ *------------------------------------------------------------------------*/
+PRED_ID predictor_select(const uint8_t *in, size_t n, int unit_size, unsigned allowed,
+			uint32_t lag, uint64_t *cost);
+
+/* <n> values -> residuals and back, <in> and <out> must not overlap.
+ * Return 0, or -1 on an unsupported id / unit size.                     */
+int predictor_encode(PRED_ID id, uint32_t lag, const uint8_t *in, uint8_t *out, size_t n, int unit_size);
+int predictor_decode(PRED_ID id, uint32_t lag, const uint8_t *in, uint8_t *out, size_t n, int unit_size);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "xorfloat.h"
+
+/* 2 + 3 + 64 bits per value at most, plus the reader's zero padding    */
+#define BLOCK_PAD	16
+#define BLOCK_BYTES	((size_t)XORF_BLOCK * 9 + BLOCK_PAD)
+/* lead of no code 3 yet, or of one invalidated by codes 0 / 1           */
+#define NO_LEAD		65
+
+static const uint8_t lead_class[8] = {0, 8, 12, 16, 18, 20, 22, 24};
+
+/* clz -> class index, rounded down                                      */
+static uint8_t lead_index[65];
+
+static void init_lead_index(void)
+{
+	int z, c = 0;
+
+	if(lead_index[64])
+		return;
+	for(z=0;z<=64;z++){
+		while(c < 7 && lead_class[c+1] <= z)
+			c++;
+		lead_index[z] = c;
+		}
+}
+
+/*------------------------------------------------------------------------
+ * Bit writer, at most 32 bits per put
+ *------------------------------------------------------------------------*/
+static inline void put_bits(XORF_WRITER *w, uint32_t v, int n)
+{
+	w->acc |= (uint64_t)v << w->fill;
+	w->fill += n;
+	if(w->fill >= 32){
+		uint32_t word = (uint32_t)w->acc;
+		memcpy(w->buf + w->len, &word, 4);
+		w->len += 4;
+		w->acc >>= 32;
+		w->fill -= 32;
+		}
+}
+
+static inline void put_bits64(XORF_WRITER *w, uint64_t v, int n)
+{
+	if(n > 32){
+		put_bits(w, (uint32_t)v, 32);
+		put_bits(w, (uint32_t)(v >> 32), n - 32);
+	}else{
+		put_bits(w, (uint32_t)v, n);
+		}
+}
+
+static int write_all(FILE *fp, const void *p, size_t len)
+{
+	if(len && fwrite(p, 1, len, fp) != len){
+		printf("%s, write failed\n", __FUNCTION__);
+		return -1;
+		}
+	return 0;
+}
+
+/* the open block to <fp>, whole bytes                                   */
+static int flush_block(XORF_WRITER *w)
+{
+	uint32_t head[2];
+
+	if(!w->count)
+		return 0;
+	for(;w->fill>0;w->fill-=8,w->acc>>=8)
+		w->buf[w->len++] = (uint8_t)w->acc;
+	w->fill = 0;
+	w->acc = 0;
+	head[0] = w->count;
+	head[1] = w->len;
+	if(write_all(w->fp, head, sizeof(head)) || write_all(w->fp, w->buf, w->len))
+		return -1;
+	w->bytes += sizeof(head) + w->len;
+	w->len = 0;
+	w->count = 0;
+	return 0;
+}
+
+int xorf_writer_open(XORF_WRITER *w, FILE *fp)
+{
+	uint8_t hdr[4] = {XORF_MAGIC[0], XORF_MAGIC[1], XORF_VERSION, 0};
+
+	if(!w || !fp)
+		return -1;
+	init_lead_index();
+	memset(w, 0, sizeof(*w));
+	w->fp = fp;
+	w->lead = NO_LEAD;
+	w->buf = malloc(BLOCK_BYTES);
+	if(!w->buf){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		return -1;
+		}
+	if(write_all(fp, hdr, sizeof(hdr))){
+		free(w->buf);
+		w->buf = NULL;
+		return -1;
+		}
+	w->bytes = sizeof(hdr);
+	return 0;
+}
+
+int xorf_write(XORF_WRITER *w, const double *v, size_t n)
+{
+	size_t k;
+
+	for(k=0;k<n;k++){
+		uint64_t bits, x;
+		memcpy(&bits, &v[k], sizeof(bits));
+		x = bits ^ w->prev;
+		w->prev = bits;
+		if(x == 0){
+			put_bits(w, 0, 2);
+			w->lead = NO_LEAD;
+		}else{
+			int c = lead_index[__builtin_clzll(x)];
+			int lead = lead_class[c];
+			int trail = __builtin_ctzll(x);
+			if(trail > 6){
+				int centre = 64 - lead - trail;
+				put_bits(w, 1 | c << 2 | centre << 5, 11);
+				put_bits64(w, x >> trail, centre);
+				w->lead = NO_LEAD;
+			}else if(lead == w->lead){
+				put_bits(w, 2, 2);
+				put_bits64(w, x, 64 - lead);
+			}else{
+				put_bits(w, 3 | c << 2, 5);
+				put_bits64(w, x, 64 - lead);
+				w->lead = lead;
+				}
+			}
+		w->values++;
+		if(++w->count == XORF_BLOCK && flush_block(w))
+			return -1;
+		}
+	return 0;
+}
+
+int xorf_writer_close(XORF_WRITER *w)
+{
+	uint32_t end[2] = {0, 0};
+	int ret;
+
+	if(!w || !w->buf)
+		return -1;
+	ret = flush_block(w);
+	if(!ret)
+		ret = write_all(w->fp, end, sizeof(end));
+	w->bytes += sizeof(end);
+	free(w->buf);
+	w->buf = NULL;
+	return ret;
+}
+
+/*------------------------------------------------------------------------
+ * Bit reader over one block; <buf> carries BLOCK_PAD zero bytes behind
+ * the codes so a refill never checks the length, the position is
+ * checked once per value instead (a value refills 3 times at most).
+ *------------------------------------------------------------------------*/
+static inline uint32_t get_bits(XORF_READER *r, int n)
+{
+	uint32_t v;
+
+	if(r->have < n){
+		uint32_t word;
+		memcpy(&word, r->buf + r->pos, 4);
+		r->pos += 4;
+		r->acc |= (uint64_t)word << r->have;
+		r->have += 32;
+		}
+	v = (uint32_t)(r->acc & ((1ull << n) - 1));
+	r->acc >>= n;
+	r->have -= n;
+	return v;
+}
+
+static inline uint64_t get_bits64(XORF_READER *r, int n)
+{
+	if(n > 32){
+		uint64_t lo = get_bits(r, 32);
+		return lo | (uint64_t)get_bits(r, n - 32) << 32;
+		}
+	return get_bits(r, n);
+}
+
+static int read_block(XORF_READER *r)
+{
+	uint32_t head[2];
+
+	if(fread(head, sizeof(head), 1, r->fp) != 1){
+		printf("%s, truncated stream\n", __FUNCTION__);
+		return -1;
+		}
+	if(head[0] == 0){
+		r->done = 1;
+		return 0;
+		}
+	if(head[0] > XORF_BLOCK || head[1] > BLOCK_BYTES - BLOCK_PAD
+		|| fread(r->buf, 1, head[1], r->fp) != head[1]){
+		printf("%s, corrupt or truncated block\n", __FUNCTION__);
+		return -1;
+		}
+	memset(r->buf + head[1], 0, BLOCK_PAD);
+	r->len = head[1];
+	r->pos = 0;
+	r->acc = 0;
+	r->have = 0;
+	r->left = head[0];
+	return 0;
+}
+
+int xorf_reader_open(XORF_READER *r, FILE *fp)
+{
+	uint8_t hdr[4];
+
+	if(!r || !fp)
+		return -1;
+	memset(r, 0, sizeof(*r));
+	r->fp = fp;
+	r->lead = NO_LEAD;
+	if(fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr)
+		|| memcmp(hdr, XORF_MAGIC, 2) || hdr[2] != XORF_VERSION || hdr[3]){
+		printf("%s, not an XOR float stream\n", __FUNCTION__);
+		return -1;
+		}
+	r->buf = malloc(BLOCK_BYTES);
+	if(!r->buf){
+		printf("%s, malloc failed\n", __FUNCTION__);
+		return -1;
+		}
+	return 0;
+}
+
+long xorf_read(XORF_READER *r, double *v, size_t n)
+{
+	size_t k = 0;
+
+	if(!r || !r->buf)
+		return -1;
+	while(k < n && !r->done){
+		if(!r->left){
+			if(read_block(r))
+				return -1;
+			continue;
+			}
+		for(;k<n && r->left;k++){
+			uint64_t x;
+			switch(get_bits(r, 2)){
+				case 0:
+					x = 0;
+					r->lead = NO_LEAD;
+					break;
+				case 1: {
+					uint32_t h = get_bits(r, 9);
+					int lead = lead_class[h & 7];
+					int centre = h >> 3;
+					if(centre == 0 || lead + centre > 57)
+						goto bad;
+					x = get_bits64(r, centre) << (64 - lead - centre);
+					r->lead = NO_LEAD;
+					break;
+					}
+				case 2:
+					if(r->lead == NO_LEAD)
+						goto bad;
+					x = get_bits64(r, 64 - r->lead);
+					break;
+				default:
+					r->lead = lead_class[get_bits(r, 3)];
+					x = get_bits64(r, 64 - r->lead);
+					break;
+				}
+			if(r->pos > r->len + 4)
+				goto bad;
+			r->prev ^= x;
+			memcpy(&v[k], &r->prev, sizeof(r->prev));
+			r->left--;
+			}
+		/* every code of the block is consumed, and no more             */
+		if(!r->left && (r->pos*8 - r->have + 7)/8 != r->len)
+			goto bad;
+		}
+	return (long)k;
+bad:
+	printf("%s, corrupt block\n", __FUNCTION__);
+	return -1;
+}
+
+void xorf_reader_close(XORF_READER *r)
+{
+	if(r){
+		free(r->buf);
+		r->buf = NULL;
+		}
+}
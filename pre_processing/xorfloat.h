@@ -0,0 +1,74 @@
+#ifndef XORFLOAT_H
+#define XORFLOAT_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*------------------------------------------------------------------------
+ * Lossless XOR codec for IEEE doubles (Gorilla / Chimp)
+ *  Every value is XORed with the previous one (0 before the first) and
+ *  the XOR is written behind a 2-bit control code:
+ *      0   XOR is 0, the value repeats
+ *      1   more than 6 trailing zeros: 3-bit leading zero class,
+ *          6-bit length, the centre bits
+ *      2   same leading zero class as the last code 3: 64 - lead bits
+ *      3   3-bit leading zero class, 64 - lead bits
+ *  Leading zero counts are rounded down to 0,8,12,16,18,20,22,24.
+ *  Bits are written LSB first.
+ *
+ *  Stream: "XF", version, reserved byte, then blocks of
+ *      uint32 count, uint32 bytes, <bytes> of codes
+ *  each block ending on a byte boundary; the XOR state runs on over the
+ *  blocks.  A block with count 0 ends the stream.
+ *------------------------------------------------------------------------*/
+#define XORF_MAGIC	"XF"
+#define XORF_VERSION	1
+#define XORF_BLOCK	65536	/* values per block                          */
+
+typedef struct {
+	FILE     *fp;
+	uint64_t prev;
+	int      lead;		/* leading zero class of the last code 3     */
+	uint64_t acc;		/* pending bits                              */
+	int      fill;
+	uint8_t  *buf;		/* codes of the open block                   */
+	size_t   len;
+	uint32_t count;
+	uint64_t values;	/* totals, for the reports                   */
+	uint64_t bytes;
+} XORF_WRITER;
+
+typedef struct {
+	FILE     *fp;
+	uint64_t prev;
+	int      lead;
+	uint8_t  *buf;		/* the current block, zero padded            */
+	size_t   len;
+	size_t   pos;
+	uint64_t acc;
+	int      have;
+	uint32_t left;		/* values still in the block                 */
+	int      done;
+} XORF_READER;
+
+/* Start a stream on <fp>, which stays owned by the caller.
+ * Returns 0, or -1 when out of memory or the header cannot be written. */
+int xorf_writer_open(XORF_WRITER *w, FILE *fp);
+
+/* Append <n> values.  Returns 0, or -1 on a write error.                */
+int xorf_write(XORF_WRITER *w, const double *v, size_t n);
+
+/* Flush the open block and the end marker, release <w>.  Returns 0/-1. */
+int xorf_writer_close(XORF_WRITER *w);
+
+/* Check the header of the stream on <fp>.  Returns 0, or -1.            */
+int xorf_reader_open(XORF_READER *r, FILE *fp);
+
+/* Up to <n> values into <v>: the number read, 0 at the end of the
+ * stream, -1 on a corrupt or truncated stream.                          */
+long xorf_read(XORF_READER *r, double *v, size_t n);
+
+void xorf_reader_close(XORF_READER *r);
+
+#endif
@@ -0,0 +1,31 @@
+#!/bin/bash
+# mydeflate -f with a line that decompresses what the line before it
+# compressed, on two workers: the second must wait for the first.
+HOME=`pwd`
+MYDEFLATE=$HOME/../encoding/mydeflate/mydeflate
+
+STEP=batch_check
+WORK=$HOME/$STEP
+RUNS=5
+
+echo ""
+echo "$0 $STEP"
+rm -rf $WORK
+mkdir -p $WORK
+cd $WORK
+seq 1 4000000 > big
+
+bad=0
+for run in `seq 1 $RUNS`; do
+	rm -f dep.z dep.out
+	printf "c 15 8 big dep.z\nx 15 8 dep.z dep.out\n" | $MYDEFLATE -j 2 -f - > log.txt 2>&1
+	if ! cmp -s big dep.out; then
+		echo "run $run: dep.out differs from big"
+		bad=$((bad+1))
+	fi
+done
+cd $HOME
+rm -rf $WORK
+
+echo "$STEP: $RUNS runs, $bad bad"
+[ $bad -eq 0 ]
@@ -0,0 +1,54 @@
+#!/bin/bash
+# Every -z chain output of pre_processing decoded with -D and compared
+# with the plain segment it stands for.  Segments are run at a length
+# that is a multiple of 8 but not of 16 or 32 as well, where the plane
+# stages cannot take every chain and it must be skipped, not fail.
+HOME=`pwd`
+PRE=$HOME/../pre_processing/pre_processing
+CSV=$HOME/../pre_processing/pui.org.csv
+
+STEP=chain_check
+WORK=$HOME/$STEP
+
+echo ""
+echo "$0 $STEP"
+if [ ! -e $CSV ]; then
+	echo "no $CSV, nothing to check"
+	exit 1
+fi
+
+CHAINS="delta:zigzag,byte,bit,szr,deflate:15:8 byte,bit,pmap byte,bit,pmap,entropy delta:signmag,bitpack zigzag,byte,pmap,deflate"
+# 102400: 10240 records a segment; 10040: 1004, 4016 / 2008 bytes
+LINES="102400 10040"
+
+files=0
+bad=0
+for lines in $LINES; do
+	for chain in $CHAINS; do
+		rm -rf $WORK
+		mkdir -p $WORK/out
+		cd $WORK
+		ln -s $CSV .
+		if ! $PRE -v all -z plain,chain -C $chain $lines > log.txt 2>&1; then
+			echo "$lines lines, $chain: run failed"
+			tail -3 log.txt
+			bad=$((bad+1))
+			cd $HOME
+			continue
+		fi
+		for file in out/*.c; do
+			[ -e $file ] || continue
+			files=$((files+1))
+			$PRE -D $file > /dev/null 2>&1
+			if ! cmp -s $file.dec ${file%.c}; then
+				echo "$lines lines, $chain: $file does not decode"
+				bad=$((bad+1))
+			fi
+		done
+		cd $HOME
+	done
+done
+rm -rf $WORK
+
+echo "$STEP: $files chain files, $bad bad"
+[ $bad -eq 0 ]
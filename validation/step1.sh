@@ -13,15 +13,31 @@ MYSHRINK=$HOME/../encoding/zerobyte_suppression/zerobyte_suppression
 echo ""
 echo "$0 $STEP"
 cat $OUT/readme
-filenamez=$HOME/$STEP/$(cat $OUT/readme | awk '{print $3}' | sed 's/,//').statis.z.$STEP.csv
-filenames=$HOME/$STEP/$(cat $OUT/readme | awk '{print $3}' | sed 's/,//').statis.s.$STEP.csv
-echo "statistics file :$filenamez"
+# one readme line per channel, "####  test power, segments ..."
+CHANNELS=$(awk '{print $3}' $OUT/readme | sed 's/,//')
 echo ""
 
 mkdir -p $HOME/$STEP/out.z  $HOME/$STEP/out.s 
 rm -f $HOME/$STEP/*sta*csv $HOME/$STEP/out*/*
 
 
+# result file suffix of a readme channel, puis has byte / bit files only
+suffix()
+{
+	case $1 in
+		power) echo _p;;
+		voltage) echo _u;;
+		current) echo _i;;
+		*) echo "";;
+	esac
+}
+
+# size of $1, empty when the channel has no such file
+flen()
+{
+	[ -e $1 ] && ls -l $1 | awk '{print $5}'
+}
+
 stati()
 {
 	bfile=$1
@@ -33,12 +49,12 @@ stati()
 	rawfile=$(echo $bfile | sed 's/byte/raw/g')	
 	diff_bytefile=$(echo $bfile | sed 's/byte/diff_byte/g')	
 	diff_bitfile=$(echo $bitfile | sed 's/bit/diff_bit/g')	
-	bytefile_len=$(ls -l $bfile | awk '{print $5}')
-	bitfile_len=$(ls -l $bitfile | awk '{print $5}')
-	difffile_len=$(ls -l $difffile | awk '{print $5}')
-	rawfile_len=$(ls -l $rawfile | awk '{print $5}')
-	diff_bytefile_len=$(ls -l $diff_bytefile | awk '{print $5}')
-	diff_bitfile_len=$(ls -l $diff_bitfile | awk '{print $5}')
+	bytefile_len=$(flen $bfile)
+	bitfile_len=$(flen $bitfile)
+	difffile_len=$(flen $difffile)
+	rawfile_len=$(flen $rawfile)
+	diff_bytefile_len=$(flen $diff_bytefile)
+	diff_bitfile_len=$(flen $diff_bitfile)
 	echo "$count:   raw $rawfile_len, diff $difffile_len, byte $bytefile_len, bit $bitfile_len, diff_byte $diff_bytefile_len, diff_bit $diff_bitfile_len"
 	echo "$count,$rawfile_len,$difffile_len,$bytefile_len,$bitfile_len,$diff_bytefile_len,$diff_bitfile_len" >> $wfile
 }
@@ -47,23 +63,33 @@ stati()
 
 echo "Enter $OUT, deflate *"
 cd $OUT
+# one mydeflate process for every file, see "mydeflate -f"
+for file in ./*res*; do
+	echo "c 15 8 $OUT/$file $OUTZ/$file.z"
+done | $MYDEFLATE -f -
 for file in ./*res*; do
-	$MYDEFLATE -w 15 -m 8 -c $OUT/$file $OUTZ/$file.z
 	$MYSHRINK  -c $OUT/$file $OUTS/$file.s
 done
 
 cd $HOME
 
 echo "####mydeflate####"
-echo ",raw,diff,byte,bit,diff_byte,diff_bit" > $filenamez
-for bytefile in $OUTZ/byt*z; do
-	stati $bytefile $filenamez
+for ch in $CHANNELS; do
+	filenamez=$HOME/$STEP/$ch.statis.z.$STEP.csv
+	echo "statistics file :$filenamez"
+	echo ",raw,diff,byte,bit,diff_byte,diff_bit" > $filenamez
+	for bytefile in $OUTZ/byte$(suffix $ch).res.*z; do
+		[ -e $bytefile ] && stati $bytefile $filenamez
+	done
 done
 
 #echo "####shrnk####"
-#echo ",raw,diff,byte,bit,diff_byte,diff_bit" > $filenames
-#for bytefile in $OUTS/byt*s; do
-#	stati $bytefile $filenames
+#for ch in $CHANNELS; do
+#	filenames=$HOME/$STEP/$ch.statis.s.$STEP.csv
+#	echo ",raw,diff,byte,bit,diff_byte,diff_bit" > $filenames
+#	for bytefile in $OUTS/byte$(suffix $ch).res.*s; do
+#		[ -e $bytefile ] && stati $bytefile $filenames
+#	done
 #done
 #
 #cd $OUT
@@ -19,14 +19,25 @@ SMALL_NAME=$SMALL_W-$SMALL_M
 echo ""
 echo "$0 $STEP"
 cat $OUT/readme
-filenamez=$HOME/$STEP/$(cat $OUT/readme | awk '{print $3}' | sed 's/,//').statis.$STEP.$SMALL_NAME.csv
-echo "statistics file :$filenamez"
+# one readme line per channel, "####  test power, segments ..."
+CHANNELS=$(awk '{print $3}' $OUT/readme | sed 's/,//')
 echo ""
 
 mkdir -p $HOME/$STEP/out.z  $HOME/$STEP/out
 rm -f $HOME/$STEP/*sta*csv $HOME/$STEP/ou*/*
 
 
+# result file suffix of a readme channel, puis has no raw / diff_bit files
+suffix()
+{
+	case $1 in
+		power) echo _p;;
+		voltage) echo _u;;
+		current) echo _i;;
+		*) echo "";;
+	esac
+}
+
 stati()
 {
 	bfile=$1
@@ -54,13 +65,12 @@ cp $OUT/raw*res* $OUT/diff_bit*res* $MYOUT/.
 
 echo "Enter $MYOUT, deflate *"
 cd $MYOUT
-for file in ./raw*; do
-	$MYDEFLATE -w $DEFAULT_W -m $DEFAULT_M -c $OUT/$file $OUTZ/$file.$DEFAULT_NAME.z
-	$MYDEFLATE -w $SMALL_W -m $SMALL_M -c $OUT/$file $OUTZ/$file.$SMALL_NAME.z
-done
+# both parameter sets of every file in one mydeflate process
+for file in ./raw* ./diff_bit*; do
+	echo "c $DEFAULT_W $DEFAULT_M $OUT/$file $OUTZ/$file.$DEFAULT_NAME.z"
+	echo "c $SMALL_W $SMALL_M $OUT/$file $OUTZ/$file.$SMALL_NAME.z"
+done | $MYDEFLATE -f -
 for file in ./diff_bit*; do
-	$MYDEFLATE -w $DEFAULT_W -m $DEFAULT_M -c $OUT/$file $OUTZ/$file.$DEFAULT_NAME.z
-	$MYDEFLATE -w $SMALL_W -m $SMALL_M -c $OUT/$file $OUTZ/$file.$SMALL_NAME.z
 	$MYSHRINK  -c $OUT/$file $OUTZ/$file.s
 done
 
@@ -68,9 +78,15 @@ done
 cd $HOME
 
 echo "####$STEP statistics####"
-echo ",raw,rawsmall,db,dbsmall,dbzero" > $filenamez
-for bitdiff_file in $OUTZ/diff_bit*$DEFAULT_NAME*z; do
-	stati $bitdiff_file $filenamez
+for ch in $CHANNELS; do
+	sfx=$(suffix $ch)
+	[ -n "$sfx" ] || continue
+	filenamez=$HOME/$STEP/$ch.statis.$STEP.$SMALL_NAME.csv
+	echo "statistics file :$filenamez"
+	echo ",raw,rawsmall,db,dbsmall,dbzero" > $filenamez
+	for bitdiff_file in $OUTZ/diff_bit$sfx.res.*.$DEFAULT_NAME.z; do
+		[ -e $bitdiff_file ] && stati $bitdiff_file $filenamez
+	done
 done
 
 